@@ -0,0 +1,95 @@
+#pragma once
+#include <rack.hpp>
+
+using namespace rack;
+
+// pulses per quarter note for the external clock modes, the first mode is CV
+inline int getPPQN(int bpmMode) {
+    static const int ppqns[] = {1, 2, 4, 8, 12, 24};
+    return ppqns[clamp(bpmMode, 0, 5)];
+}
+
+// follows an external clock. the rising edges are found in between samples and
+// fed to a delay locked loop (https://kokkinizita.linuxaudio.org/papers/usingdll.pdf),
+// so a jittery clock gives a steady tempo instead of jumping on every pulse
+struct ClockFollower {
+    enum SmoothingIds {
+        SMOOTHING_OFF,
+        SMOOTHING_LIGHT,
+        SMOOTHING_HEAVY,
+        NUM_SMOOTHINGS
+    };
+    int smoothing = SMOOTHING_LIGHT;
+    float lastVoltage = 0.0;
+    bool high = false;
+    double time = 0.0;
+    double lastEdge = 0.0;
+    double nextEdge = 0.0; // where the loop expects the next pulse
+    double period = 0.0; // seconds per pulse
+    double interval = 0.0; // seconds between the last expected pulse and the next one
+    int edges = 0;
+
+    void reset() {
+        time = 0.0;
+        lastEdge = 0.0;
+        nextEdge = 0.0;
+        edges = 0;
+    }
+
+    // true on every rising edge, same thresholds as dsp::SchmittTrigger
+    bool process(float voltage, float sampleTime) {
+        time += sampleTime;
+        bool edge = false;
+        if (high) {
+            if (voltage <= 0.f) high = false;
+        } else if (voltage >= 1.f) {
+            high = true;
+            edge = true;
+            // how far back between the last sample and this one it crossed 1V
+            float frac = (voltage > lastVoltage) ? (voltage - 1.f) / (voltage - lastVoltage) : 0.f;
+            onEdge(time - clamp(frac, 0.f, 1.f) * sampleTime);
+        }
+        lastVoltage = voltage;
+        return edge;
+    }
+
+    void onEdge(double t) {
+        if (edges > 1 && t - lastEdge > 4.0 * period) {
+            // the clock stopped for a while, start over from this pulse
+            edges = 0;
+        }
+        if (edges > 0) {
+            double measured = t - lastEdge;
+            double error = t - nextEdge;
+            if (edges == 1 || smoothing == SMOOTHING_OFF || std::fabs(error) > 0.5 * period) {
+                // (re)locks straight to the last period
+                period = measured;
+                nextEdge = t + period;
+                interval = period;
+            } else {
+                double w = 2.0 * M_PI * ((smoothing == SMOOTHING_LIGHT) ? 0.03 : 0.01);
+                // from one expected pulse to the next, so the phase follows the loop
+                interval = period + std::sqrt(2.0) * w * error;
+                nextEdge += interval;
+                period += w * w * error;
+            }
+            interval = std::max(interval, 1e-4);
+        }
+        lastEdge = t;
+        edges++;
+    }
+
+    // needs two pulses before it knows the tempo
+    bool isLocked() {
+        return edges > 1;
+    }
+
+    // quarter notes per second
+    float getFrequency(int ppqn) {
+        return 1.0 / (interval * ppqn);
+    }
+
+    float getTimeSinceEdge() {
+        return time - lastEdge;
+    }
+};
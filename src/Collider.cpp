@@ -1,6 +1,38 @@
 #include "plugin.hpp"
 
+using simd::float_4;
+
 #define MIN_SHAKE_ENERGY 0.001
+#define RESONATOR_Q 10.0
+#define AUDIO_GAIN 6.0
+
+// 2-pole resonators with zeros at DC and nyquist like the ones in Perry Cook's PhISEM,
+// one resonator per SIMD lane
+struct Resonators {
+    float_4 gain = 0.f;
+    float_4 a1 = 0.f;
+    float_4 a2 = 0.f;
+    float_4 x1 = 0.f, x2 = 0.f;
+    float_4 y1 = 0.f, y2 = 0.f;
+
+    void setFreqs(float_4 freqs, float sampleRate) {
+        float_4 f = simd::clamp(freqs / sampleRate, 0.0001f, 0.45f);
+        float_4 r = simd::exp(float(-M_PI / RESONATOR_Q) * f);
+        a1 = -2.f * r * simd::cos(float(2.0 * M_PI) * f);
+        a2 = r * r;
+        // wider bands pass more noise, so even out the loudness across the spectrum
+        gain = (1.f - a2) * 0.5f * float(AUDIO_GAIN) / simd::sqrt(f);
+    }
+
+    float_4 process(float_4 in) {
+        float_4 out = gain * (in - x2) - a1 * y1 - a2 * y2;
+        x2 = x1;
+        x1 = in;
+        y2 = y1;
+        y1 = out;
+        return out;
+    }
+};
 
 struct Collider : Module {
     enum ParamIds {
@@ -54,7 +86,52 @@ struct Collider : Module {
     float percentageObj = numOfParticles * 0.027;
     int currentChannel = 0;
     int channels = 1;
-    int checkParams = 0;
+    enum ControlIds {
+        SHAKE_CONTROL,
+        SHAKE_CV_CONTROL,
+        VEL_CV_CONTROL,
+        RANDOMIZE_CONTROL,
+        PARTICLES_CONTROL,
+        PARTICLES_CV_CONTROL,
+        CENTER_FREQ_CONTROL,
+        CENTER_FREQ_CV_CONTROL,
+        FREQ_RANGE_CONTROL,
+        FREQ_RANGE_CV_CONTROL,
+        NUM_CONTROLS
+    };
+    ControlRate<NUM_CONTROLS> controls;
+
+    // polyphonic mode: every voice is its own shaker, 4 voices per SIMD lane
+    bool polyMode = false;
+    bool wasPolyMode = false;
+    int voices = 1;
+    float_4 voiceEnergy[4] = {};
+    float_4 voiceAmp[4] = {};
+    float_4 voicePercentage[4];
+    float_4 voiceFreqs[4][3];
+    float_4 voicePulse[4] = {};
+    int voiceNoteIndex[16] = {};
+    float_4 voiceCenter[4];
+    float_4 voiceRange[4];
+
+    // audio rendered on the VEL output: 3 resonators in one lane group for the mono
+    // shaker, one lane group per resonator for every 4 poly voices
+    bool audioOut = false;
+    float sampleRate = 44100.f;
+    Resonators resonators;
+    Resonators voiceResonators[4][3];
+
+    FastRandom rng;
+    uint64_t seed = random::u64();
+    bool fixedSeed = false;
+
+    enum PerfPhases {
+        PARAMS_PHASE,
+        SHAKER_PHASE,
+        RESONATORS_PHASE,
+        NUM_PERF_PHASES
+    };
+    Profiler<NUM_PERF_PHASES> profiler{"Params", "Shaker", "Resonators"};
 
     Collider() {
         config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
@@ -75,6 +152,42 @@ struct Collider : Module {
         configOutput(VEL_OUTPUT, "Velocity");
 
         initNotes(centerFreq);
+        for (int b = 0; b < 4; b++) {
+            voicePercentage[b] = percentageObj;
+            initVoiceNotes(b, centerFreq, freqRange);
+        }
+        rng.seed(seed);
+
+        controls.configParam(SHAKE_CONTROL, SHAKE_PARAM);
+        controls.configInput(SHAKE_CV_CONTROL, SHAKE_INPUT);
+        controls.configInput(VEL_CV_CONTROL, VEL_INPUT);
+        controls.configParam(RANDOMIZE_CONTROL, RANDOMIZE_PARAM);
+        controls.configParam(PARTICLES_CONTROL, PARTICLES_PARAM);
+        controls.configInput(PARTICLES_CV_CONTROL, PARTICLES_INPUT);
+        controls.configParam(CENTER_FREQ_CONTROL, CENTER_FREQ_PARAM);
+        controls.configInput(CENTER_FREQ_CV_CONTROL, CENTER_FREQ_INPUT);
+        controls.configParam(FREQ_RANGE_CONTROL, FREQ_RANGE_PARAM);
+        controls.configInput(FREQ_RANGE_CV_CONTROL, FREQ_RANGE_INPUT);
+    }
+
+    void initVoiceNotes(int b, float_4 center, float_4 range) {
+        voiceCenter[b] = center;
+        voiceRange[b] = range;
+        voiceFreqs[b][0] = center;
+        voiceFreqs[b][1] = center * (1.f - range);
+        voiceFreqs[b][2] = center * (1.f + range);
+        for (int k = 0; k < 3; k++) {
+            voiceResonators[b][k].setFreqs(voiceFreqs[b][k], sampleRate);
+        }
+    }
+
+    void updateResonators() {
+        resonators.setFreqs(float_4(freqs[0], freqs[1], freqs[2], 0.f), sampleRate);
+        for (int b = 0; b < 4; b++) {
+            for (int k = 0; k < 3; k++) {
+                voiceResonators[b][k].setFreqs(voiceFreqs[b][k], sampleRate);
+            }
+        }
     }
 
     void initNotes(float center) {
@@ -86,11 +199,18 @@ struct Collider : Module {
         freqs[0] = centerFreq;
         freqs[1] = centerFreq * (1.0 - freqRange);
         freqs[2] = centerFreq * (1.0 + freqRange);
+
+        resonators.setFreqs(float_4(freqs[0], freqs[1], freqs[2], 0.f), sampleRate);
     }
 
     json_t *dataToJson() override {
         json_t *rootJ = json_object();
         json_object_set_new(rootJ, "channels", json_integer(channels));
+        json_object_set_new(rootJ, "polyMode", json_boolean(polyMode));
+        json_object_set_new(rootJ, "audioOut", json_boolean(audioOut));
+        if (fixedSeed)
+            json_object_set_new(rootJ, "seed", json_integer((json_int_t)seed));
+        setProfilerJson(rootJ, profiler);
 
         return rootJ;
     }
@@ -98,93 +218,237 @@ struct Collider : Module {
     void dataFromJson(json_t *rootJ) override {
         json_t *channelsJ = json_object_get(rootJ, "channels");
         if (channelsJ) channels = json_integer_value(channelsJ);
+
+        json_t *polyModeJ = json_object_get(rootJ, "polyMode");
+        if (polyModeJ) polyMode = json_boolean_value(polyModeJ);
+
+        json_t *audioOutJ = json_object_get(rootJ, "audioOut");
+        if (audioOutJ) audioOut = json_boolean_value(audioOutJ);
+
+        json_t *seedJ = json_object_get(rootJ, "seed");
+        if (seedJ) {
+            fixedSeed = true;
+            seed = (uint64_t)json_integer_value(seedJ);
+            rng.seed(seed);
+        } else {
+            fixedSeed = false;
+            seed = random::u64();
+            rng.seed(seed);
+        }
     }
 
     void process(const ProcessArgs &args) override {
-        if (checkParams == 0) {
-            if (params[SHAKE_PARAM].getValue() + inputs[SHAKE_INPUT].getVoltage()) {
+        if (args.sampleRate != sampleRate) {
+            sampleRate = args.sampleRate;
+            updateResonators();
+        }
+
+        if (polyMode != wasPolyMode) {
+            // the other mode didn't keep its derived values up to date
+            wasPolyMode = polyMode;
+            controls.invalidate();
+        }
+
+        if (polyMode) {
+            processPoly(args);
+            return;
+        }
+
+        if (controls.process(this, args.sampleRate)) {
+            PROFILE_SCOPE(profiler, PARAMS_PHASE);
+            if (controls.get(SHAKE_CONTROL) + controls.get(SHAKE_CV_CONTROL)) {
                 shakeEnergy = velocity;
             }
 
-            if (inputs[VEL_INPUT].isConnected()) {
-                float volts = inputs[VEL_INPUT].getVoltage() / 10.0;
-                if (volts != velocity) {
-                    velocity = volts;
-                }
+            if (controls.isConnected(VEL_CV_CONTROL)) {
+                velocity = controls.get(VEL_CV_CONTROL) / 10.0;
             } else {
                 velocity = 1.0;
             }
 
-            freqRandomize = params[RANDOMIZE_PARAM].getValue();
+            freqRandomize = controls.get(RANDOMIZE_CONTROL);
 
-            if (inputs[PARTICLES_INPUT].isConnected()) {
-                float cv = inputs[PARTICLES_INPUT].getVoltage() / 10.0;
-                cv = cv * cv;
-                numOfParticles = (int)rescale(cv, 0.0, 1.0, 1.0, 150.0);
-                percentageObj = numOfParticles * 0.027;
-            } else if (params[PARTICLES_PARAM].getValue() != numOfParticles) {
-                numOfParticles = (int)params[PARTICLES_PARAM].getValue();
+            if (controls.changed(PARTICLES_CONTROL) || controls.changed(PARTICLES_CV_CONTROL)) {
+                if (controls.isConnected(PARTICLES_CV_CONTROL)) {
+                    float cv = controls.get(PARTICLES_CV_CONTROL) / 10.0;
+                    cv = cv * cv;
+                    numOfParticles = (int)rescale(cv, 0.0, 1.0, 1.0, 150.0);
+                } else {
+                    numOfParticles = (int)controls.get(PARTICLES_CONTROL);
+                }
                 percentageObj = numOfParticles * 0.027;
             }
 
-            if (inputs[CENTER_FREQ_INPUT].isConnected()) {
-                if (inputs[CENTER_FREQ_INPUT].getVoltage() != centerVoltage) {
-                    centerVoltage = inputs[CENTER_FREQ_INPUT].getVoltage();
+            bool centerChanged = controls.changed(CENTER_FREQ_CONTROL) || controls.changed(CENTER_FREQ_CV_CONTROL);
+            if (centerChanged) {
+                if (controls.isConnected(CENTER_FREQ_CV_CONTROL)) {
+                    centerVoltage = controls.get(CENTER_FREQ_CV_CONTROL);
                     centerFreq = dsp::FREQ_C4 * pow(2, centerVoltage);
-                    initNotes(centerFreq);
+                } else {
+                    centerFreq = controls.get(CENTER_FREQ_CONTROL);
                 }
-            } else if (params[CENTER_FREQ_PARAM].getValue() != centerFreq) {
-                initNotes(params[CENTER_FREQ_PARAM].getValue());
             }
 
-            if (inputs[FREQ_RANGE_INPUT].isConnected()) {
-                float cv = clamp(inputs[FREQ_RANGE_INPUT].getVoltage() / 10.f, 0.0, 0.95);
-                cv = cv * cv; // square it so it's easy to get low values
-                if (cv != freqRange) {
-                    freqRange = cv;
-                    initNotes(centerFreq);
+            bool rangeChanged = controls.changed(FREQ_RANGE_CONTROL) || controls.changed(FREQ_RANGE_CV_CONTROL);
+            if (rangeChanged) {
+                if (controls.isConnected(FREQ_RANGE_CV_CONTROL)) {
+                    float cv = clamp(controls.get(FREQ_RANGE_CV_CONTROL) / 10.f, 0.0, 0.95);
+                    freqRange = cv * cv; // square it so it's easy to get low values
+                } else {
+                    freqRange = clamp(controls.get(FREQ_RANGE_CONTROL), 0.0, 0.95);
                 }
-            } else if (params[FREQ_RANGE_PARAM].getValue() != freqRange) {
-                freqRange = clamp(params[FREQ_RANGE_PARAM].getValue(), 0.0, 0.95);
-                initNotes(centerFreq);
             }
+
+            if (centerChanged || rangeChanged)
+                initNotes(centerFreq);
         }
-        checkParams = (checkParams + 1) % 4;
 
         // this algorithm inspired by Perry Cook's Phisem
 
-        if (shakeEnergy > MIN_SHAKE_ENERGY) {
-            shakeEnergy *= systemDecay;
-            if (randRange(1024.f) < percentageObj) {
-                currentChannel = (currentChannel + 1) % channels;
-                ampLevel += shakeEnergy;
+        float excite = 0.0;
+        {
+            PROFILE_SCOPE(profiler, SHAKER_PHASE);
+            if (shakeEnergy > MIN_SHAKE_ENERGY) {
+                shakeEnergy *= systemDecay;
+                if (rng.uniform() * 1024.f < percentageObj) {
+                    currentChannel = (currentChannel + 1) % channels;
+                    ampLevel += shakeEnergy;
 
-                pulses[currentChannel].trigger(1e-3f);
+                    pulses[currentChannel].trigger(1e-3f);
 
-                float freq = freqs[noteIndex] * (1.0 + (freqRandomize * randRange(-1.0, 1.0)));
-                float volts = freqToVolts(freq);
-                noteIndex = (noteIndex + 1) % 3;
-                outputs[VOLT_OUTPUT].setVoltage(volts, currentChannel);
+                    float freq = freqs[noteIndex] * (1.0 + (freqRandomize * rng.range(-1.f, 1.f)));
+                    float volts = freqToVolts(freq);
+                    noteIndex = (noteIndex + 1) % 3;
+                    outputs[VOLT_OUTPUT].setVoltage(volts, currentChannel);
 
-                outputs[VEL_OUTPUT].setVoltage(ampLevel * 10.0, currentChannel);
-            }
-            ampLevel *= soundDecay;
+                    if (!audioOut)
+                        outputs[VEL_OUTPUT].setVoltage(ampLevel * 10.0, currentChannel);
+                }
+                excite = ampLevel * rng.range(-1.f, 1.f);
+                ampLevel *= soundDecay;
 
-            bool pulse = pulses[currentChannel].process(args.sampleTime);
-            outputs[GATE_OUTPUT].setVoltage(pulse ? 10.0 : 0.0, currentChannel);
+                bool pulse = pulses[currentChannel].process(args.sampleTime);
+                outputs[GATE_OUTPUT].setVoltage(pulse ? 10.0 : 0.0, currentChannel);
 
-        } else {
-            for (int i = 0; i < channels; i++) {
-                bool pulse = pulses[i].process(args.sampleTime);
-                outputs[GATE_OUTPUT].setVoltage(pulse ? 10.0 : 0.0, i);
+            } else {
+                for (int i = 0; i < channels; i++) {
+                    bool pulse = pulses[i].process(args.sampleTime);
+                    outputs[GATE_OUTPUT].setVoltage(pulse ? 10.0 : 0.0, i);
+                }
             }
         }
 
-        outputs[VEL_OUTPUT].setChannels(channels);
+        if (audioOut) {
+            PROFILE_SCOPE(profiler, RESONATORS_PHASE);
+            float_4 out = resonators.process(excite);
+            outputs[VEL_OUTPUT].setVoltage(out[0] + out[1] + out[2]);
+            outputs[VEL_OUTPUT].setChannels(1);
+        } else {
+            outputs[VEL_OUTPUT].setChannels(channels);
+        }
         outputs[GATE_OUTPUT].setChannels(channels);
         outputs[VOLT_OUTPUT].setChannels(channels);
 
     }
+
+    void checkPolyParams() {
+        // voice count follows the shake input, otherwise the polyphony menu
+        voices = inputs[SHAKE_INPUT].isConnected() ? inputs[SHAKE_INPUT].getChannels() : channels;
+        freqRandomize = params[RANDOMIZE_PARAM].getValue();
+
+        float button = params[SHAKE_PARAM].getValue();
+        float particlesParam = (int)params[PARTICLES_PARAM].getValue();
+        float centerParam = params[CENTER_FREQ_PARAM].getValue();
+        float rangeParam = clamp(params[FREQ_RANGE_PARAM].getValue(), 0.0, 0.95);
+
+        for (int c = 0; c < voices; c += 4) {
+            int b = c / 4;
+
+            float_4 shake = button + inputs[SHAKE_INPUT].getPolyVoltageSimd<float_4>(c);
+            float_4 vel = 1.f;
+            if (inputs[VEL_INPUT].isConnected())
+                vel = inputs[VEL_INPUT].getPolyVoltageSimd<float_4>(c) / 10.f;
+            voiceEnergy[b] = simd::ifelse(shake != 0.f, vel, voiceEnergy[b]);
+
+            float_4 particles = particlesParam;
+            if (inputs[PARTICLES_INPUT].isConnected()) {
+                float_4 cv = inputs[PARTICLES_INPUT].getPolyVoltageSimd<float_4>(c) / 10.f;
+                cv = cv * cv;
+                particles = simd::floor(1.f + cv * 149.f);
+            }
+            voicePercentage[b] = particles * 0.027f;
+
+            float_4 center = centerParam;
+            if (inputs[CENTER_FREQ_INPUT].isConnected())
+                center = dsp::FREQ_C4 * simd::pow(2.f, inputs[CENTER_FREQ_INPUT].getPolyVoltageSimd<float_4>(c));
+
+            float_4 range = rangeParam;
+            if (inputs[FREQ_RANGE_INPUT].isConnected()) {
+                float_4 cv = simd::clamp(inputs[FREQ_RANGE_INPUT].getPolyVoltageSimd<float_4>(c) / 10.f, 0.f, 0.95f);
+                range = cv * cv;
+            }
+            // only touch the resonator coefficients when something moved
+            if (simd::movemask((center != voiceCenter[b]) | (range != voiceRange[b])))
+                initVoiceNotes(b, center, range);
+        }
+    }
+
+    void processPoly(const ProcessArgs &args) {
+        // the snapshot only tells when to look, the voices read every channel
+        if (controls.process(this, args.sampleRate)) {
+            PROFILE_SCOPE(profiler, PARAMS_PHASE);
+            checkPolyParams();
+        }
+
+        for (int c = 0; c < voices; c += 4) {
+            int b = c / 4;
+            float_4 active = voiceEnergy[b] > MIN_SHAKE_ENERGY;
+            float_4 excite = 0.f;
+
+            if (simd::movemask(active)) {
+                PROFILE_SCOPE(profiler, SHAKER_PHASE);
+                voiceEnergy[b] = simd::ifelse(active, voiceEnergy[b] * systemDecay, voiceEnergy[b]);
+
+                float_4 chance = rng.uniform4() * 1024.f;
+                float_4 hits = active & (chance < voicePercentage[b]);
+                voiceAmp[b] += simd::ifelse(hits, voiceEnergy[b], 0.f);
+
+                int hitMask = simd::movemask(hits);
+                for (int i = 0; hitMask && i < 4 && c + i < voices; i++) {
+                    if (!(hitMask & (1 << i))) continue;
+                    int ch = c + i;
+                    voicePulse[b][i] = 1e-3f;
+
+                    float freq = voiceFreqs[b][voiceNoteIndex[ch]][i] * (1.0 + (freqRandomize * rng.range(-1.f, 1.f)));
+                    voiceNoteIndex[ch] = (voiceNoteIndex[ch] + 1) % 3;
+                    outputs[VOLT_OUTPUT].setVoltage(freqToVolts(freq), ch);
+                    if (!audioOut)
+                        outputs[VEL_OUTPUT].setVoltage(voiceAmp[b][i] * 10.0, ch);
+                }
+                if (audioOut) {
+                    float_4 noise = rng.uniform4() * 2.f - 1.f;
+                    excite = simd::ifelse(active, voiceAmp[b] * noise, 0.f);
+                }
+                voiceAmp[b] = simd::ifelse(active, voiceAmp[b] * soundDecay, voiceAmp[b]);
+            }
+
+            if (audioOut) {
+                PROFILE_SCOPE(profiler, RESONATORS_PHASE);
+                float_4 out = voiceResonators[b][0].process(excite);
+                out += voiceResonators[b][1].process(excite);
+                out += voiceResonators[b][2].process(excite);
+                outputs[VEL_OUTPUT].setVoltageSimd(out, c);
+            }
+
+            float_4 gate = voicePulse[b] > 0.f;
+            voicePulse[b] = simd::fmax(voicePulse[b] - args.sampleTime, 0.f);
+            outputs[GATE_OUTPUT].setVoltageSimd(simd::ifelse(gate, 10.f, 0.f), c);
+        }
+
+        outputs[VEL_OUTPUT].setChannels(voices);
+        outputs[GATE_OUTPUT].setChannels(voices);
+        outputs[VOLT_OUTPUT].setChannels(voices);
+    }
 };
 
 namespace ColliderNS {
@@ -259,6 +523,12 @@ struct ColliderWidget : ModuleWidget {
         channelItem->rightText = string::f("%d", module->channels) + " " + RIGHT_ARROW;
         channelItem->module = module;
         menu->addChild(channelItem);
+
+        menu->addChild(createBoolPtrMenuItem("Independent voices", "", &module->polyMode));
+        menu->addChild(createBoolPtrMenuItem("Audio on VEL output", "", &module->audioOut));
+        menu->addChild(createBoolPtrMenuItem("Fixed random seed", "", &module->fixedSeed));
+
+        module->profiler.appendMenu(menu);
     }
 };
 
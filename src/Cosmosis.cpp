@@ -120,10 +120,34 @@ struct Cosmosis : Module, Constellations, Quantize {
     float seqSpeed = 1.0;
     bool isPlaying = false;
     bool pitchChoice = false;
-    int checkParams = 0;
+    enum ControlIds {
+        PLAY_CONTROL,
+        PLAY_CV_CONTROL,
+        RESET_CV_CONTROL,
+        CLEAR_CONTROL,
+        RANDOM_POS_CONTROL,
+        RANDOM_POS_CV_CONTROL,
+        RANDOM_RAD_CONTROL,
+        RANDOM_RAD_CV_CONTROL,
+        MODE_CONTROL,
+        PITCH_CONTROL,
+        SPEED_CONTROL,
+        SPEED_CV_CONTROL,
+        PATTERN_CONTROL,
+        NUM_CONTROLS
+    };
+    ControlRate<NUM_CONTROLS> controls;
     int processStars = 0;
     int channels = 1;
 
+    enum PerfPhases {
+        PARAMS_PHASE,
+        SEQUENCER_PHASE,
+        STARS_PHASE,
+        NUM_PERF_PHASES
+    };
+    Profiler<NUM_PERF_PHASES> profiler{"Params", "Sequencer", "Stars & outputs"};
+
     Cosmosis() {
         config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
         configParam(SPEED_PARAM, -2.0, 2.0, 0.0, "Line speed");
@@ -152,6 +176,20 @@ struct Cosmosis : Module, Constellations, Quantize {
         configOutput(VOLT_OUT, "Pitch (V/OCT)");
         configOutput(GATE_OUT, "Trigger");
 
+        controls.configParam(PLAY_CONTROL, PLAY_PARAM);
+        controls.configInput(PLAY_CV_CONTROL, EXT_PLAY_INPUT);
+        controls.configInput(RESET_CV_CONTROL, RESET_INPUT);
+        controls.configParam(CLEAR_CONTROL, CLEAR_STARS_PARAM);
+        controls.configParam(RANDOM_POS_CONTROL, RANDOM_POS_PARAM);
+        controls.configInput(RANDOM_POS_CV_CONTROL, RANDOM_POS_INPUT);
+        controls.configParam(RANDOM_RAD_CONTROL, RANDOM_RAD_PARAM);
+        controls.configInput(RANDOM_RAD_CV_CONTROL, RANDOM_RAD_INPUT);
+        controls.configParam(MODE_CONTROL, MODE_PARAM);
+        controls.configParam(PITCH_CONTROL, PITCH_PARAM);
+        controls.configParam(SPEED_CONTROL, SPEED_PARAM);
+        controls.configInput(SPEED_CV_CONTROL, SPEED_INPUT);
+        controls.configParam(PATTERN_CONTROL, PATTERN_PARAM);
+
         Vec corner = Vec(0, 0);
         Vec dir = corner.minus(center);
         maxDist = sqrt(dir.x * dir.x + dir.y * dir.y) * 0.5;
@@ -201,6 +239,7 @@ struct Cosmosis : Module, Constellations, Quantize {
         json_object_set_new(rootJ, "channels", json_integer(channels));
         json_object_set_new(rootJ, "playing", json_boolean(isPlaying));
         json_object_set_new(rootJ, "stars", starsJ);
+        setProfilerJson(rootJ, profiler);
 
         return rootJ;
     }
@@ -237,33 +276,35 @@ struct Cosmosis : Module, Constellations, Quantize {
     }
 
     void process(const ProcessArgs &args) override {
-        // check params every 4th sample
-        if (checkParams == 0) {
-            if (playTrig.process(params[PLAY_PARAM].getValue() + inputs[EXT_PLAY_INPUT].getVoltage())) {
+        if (controls.process(this, args.sampleRate)) {
+            PROFILE_SCOPE(profiler, PARAMS_PHASE);
+            if (playTrig.process(controls.get(PLAY_CONTROL) + controls.get(PLAY_CV_CONTROL))) {
                 isPlaying = !isPlaying;
             }
-            if (resetTrig.process(inputs[RESET_INPUT].getVoltage())) {
+            if (resetTrig.process(controls.get(RESET_CV_CONTROL))) {
                 resetSeq();
             }
-            if (clearTrig.process(params[CLEAR_STARS_PARAM].getValue())) {
+            if (clearTrig.process(controls.get(CLEAR_CONTROL))) {
                 removeAllStars();
             }
-            if (rndPosTrig.process(params[RANDOM_POS_PARAM].getValue() + inputs[RANDOM_POS_INPUT].getVoltage())) {
+            if (rndPosTrig.process(controls.get(RANDOM_POS_CONTROL) + controls.get(RANDOM_POS_CV_CONTROL))) {
                 randomizePosition();
             }
-            if (rndRadTrig.process(params[RANDOM_RAD_PARAM].getValue() + inputs[RANDOM_RAD_INPUT].getVoltage())) {
+            if (rndRadTrig.process(controls.get(RANDOM_RAD_CONTROL) + controls.get(RANDOM_RAD_CV_CONTROL))) {
                 randomizeRadii();
             }
-            int mode = params[MODE_PARAM].getValue();
+            int mode = controls.get(MODE_CONTROL);
             if (mode != currentSeqMode) {
                 setSeqMode(mode);
             }
 
-            pitchChoice = params[PITCH_PARAM].getValue();
-            float scl = std::pow(2.0, params[SPEED_PARAM].getValue() + inputs[SPEED_INPUT].getVoltage() * 0.5);
-            seqSpeed = scl * (INTERNAL_SAMP_TIME / args.sampleRate * 60.0);
+            pitchChoice = controls.get(PITCH_CONTROL);
+            if (controls.changed(SPEED_CONTROL) || controls.changed(SPEED_CV_CONTROL)) {
+                float scl = std::pow(2.0, controls.get(SPEED_CONTROL) + controls.get(SPEED_CV_CONTROL) * 0.5);
+                seqSpeed = scl * (INTERNAL_SAMP_TIME / args.sampleRate * 60.0);
+            }
 
-            int paramVal = params[PATTERN_PARAM].getValue();
+            int paramVal = controls.get(PATTERN_CONTROL);
             if (currentConstellation != paramVal) {
                 currentConstellation = paramVal;
                 setConstellation(paramVal);
@@ -271,7 +312,6 @@ struct Cosmosis : Module, Constellations, Quantize {
 
             resizeConstellation();
         }
-        checkParams = (checkParams+1) % 4;
 
         if (processStars == 0) {
             int polyChannelIndex = 0;
@@ -298,9 +338,13 @@ struct Cosmosis : Module, Constellations, Quantize {
             }
 
             if (isPlaying) {
-                advanceSeqPos();
-                checkSeqEdges();
+                {
+                    PROFILE_SCOPE(profiler, SEQUENCER_PHASE);
+                    advanceSeqPos();
+                    checkSeqEdges();
+                }
 
+                PROFILE_SCOPE(profiler, STARS_PHASE);
                 int oct = params[OCTAVE_PARAM + getSeqMode()].getValue();
                 // change the MAX_STARS to the current length of selected constellation
                 for (int i = 0; i < MAX_STARS; i++) {
@@ -847,6 +891,8 @@ struct CosmosisWidget : ModuleWidget {
         channelItem->rightText = string::f("%d", module->channels) + " " + RIGHT_ARROW;
         channelItem->module = module;
         menu->addChild(channelItem);
+
+        module->profiler.appendMenu(menu);
     }
 };
 
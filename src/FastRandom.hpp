@@ -0,0 +1,92 @@
+#pragma once
+#include <rack.hpp>
+
+using namespace rack;
+
+// xoshiro128+ (https://prng.di.unimi.it) running 4 independent streams side by
+// side. one step makes 4 numbers with plain 32 bit ops the compiler can keep in
+// a single SIMD register, so batches are cheap. not for anything cryptographic
+struct FastRandom {
+    uint32_t s0[4], s1[4], s2[4], s3[4];
+    float batch[4];
+    int index = 4;
+
+    FastRandom() {
+        seed(random::u64());
+    }
+
+    explicit FastRandom(uint64_t s) {
+        seed(s);
+    }
+
+    // nearby seeds (like seed + 1) still give unrelated streams
+    void seed(uint64_t s) {
+        for (int i = 0; i < 4; i++) {
+            uint64_t a = splitMix(s);
+            uint64_t b = splitMix(s);
+            s0[i] = a;
+            s1[i] = a >> 32;
+            s2[i] = b;
+            s3[i] = (b >> 32) | 1; // never all zeros
+        }
+        index = 4;
+    }
+
+    static uint64_t splitMix(uint64_t &x) {
+        uint64_t z = (x += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+
+    // 4 uniform floats in [0, 1), one from each stream
+    void next(float *out) {
+        for (int i = 0; i < 4; i++) {
+            uint32_t result = s0[i] + s3[i];
+            uint32_t t = s1[i] << 9;
+            s2[i] ^= s0[i];
+            s3[i] ^= s1[i];
+            s1[i] ^= s2[i];
+            s0[i] ^= s3[i];
+            s2[i] ^= t;
+            s3[i] = (s3[i] << 11) | (s3[i] >> 21);
+            // top 24 bits
+            out[i] = (result >> 8) * (1.f / 16777216.f);
+        }
+    }
+
+    simd::float_4 uniform4() {
+        float out[4];
+        next(out);
+        return simd::float_4::load(out);
+    }
+
+    float uniform() {
+        if (index >= 4) {
+            next(batch);
+            index = 0;
+        }
+        return batch[index++];
+    }
+
+    void fill(float *out, int size) {
+        int i = 0;
+        for (; i + 4 <= size; i += 4) {
+            next(&out[i]);
+        }
+        for (; i < size; i++) {
+            out[i] = uniform();
+        }
+    }
+
+    // same as randRange() in plugin.hpp
+    float range(float min, float max) {
+        return uniform() * std::fabs(max - min) + min;
+    }
+};
+
+// for the randRange() helpers, each thread gets its own
+inline FastRandom &getFastRandom() {
+    static thread_local FastRandom rng;
+    return rng;
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <rack.hpp>
+
+using namespace rack;
+
+#define LOOKAHEAD_STEPS 32
+
+// the random numbers for the next steps of a sequence are rolled ahead of time
+// so the displays can show which steps are going to play. they only get compared
+// to the probabilities when they're used, so editing a slider doesn't throw them
+// away. with the same seed a patch plays the same every time
+struct Lookahead {
+    FastRandom rng;
+    float rolls[LOOKAHEAD_STEPS];
+    int head = 0;
+
+    Lookahead() {
+        seed(random::u64());
+    }
+
+    void seed(uint64_t s) {
+        rng.seed(s);
+        rng.fill(rolls, LOOKAHEAD_STEPS);
+        head = 0;
+    }
+
+    // random number for the step k steps from now, 0 is the next step
+    float peek(int k) {
+        return rolls[(head + k) % LOOKAHEAD_STEPS];
+    }
+
+    float next() {
+        float r = rolls[head];
+        rolls[head] = rng.uniform();
+        head = (head + 1) % LOOKAHEAD_STEPS;
+        return r;
+    }
+};
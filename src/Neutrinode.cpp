@@ -31,6 +31,8 @@ struct Pulse {
     float radius = 3;
     bool visible = false;
     bool isConnected = false;
+    float lineAlpha = 0.0;
+    float lineWidth = 0.0;
     bool triggered = false;
     bool blipTrigger = false;
     int haloTime = 0;
@@ -70,8 +72,6 @@ struct Node {
     NVGcolor color;
     NVGcolor lineColor;
     Pulse *pulses = new Pulse[MAX_PARTICLES];
-    float lineAlpha;
-    float lineWidth;
     int maxConnectedDist = 150;
     int currentConnects = 0;
     float initPhase;
@@ -112,8 +112,8 @@ struct Node {
         float d = dist(box.pos, p);
         if (d < maxConnectedDist) {
             pulses[index].isConnected = true;
-            lineAlpha = rescale(d, 0, maxConnectedDist, 255, 25);
-            lineWidth = rescale(d, 0, maxConnectedDist, 3.0, 1.5);
+            pulses[index].lineAlpha = rescale(d, 0, maxConnectedDist, 255, 25);
+            pulses[index].lineWidth = rescale(d, 0, maxConnectedDist, 3.0, 1.5);
             return true;
         } else {
             pulses[index].isConnected = false;
@@ -215,6 +215,35 @@ struct Neutrinode : Module, Quantize {
         PAUSE_LIGHT,
         NUM_LIGHTS
     };
+    enum CommandIds {
+        GRAB_OBJECT,
+        DRAG_OBJECT,
+        NUM_COMMANDS
+    };
+
+    // what the display draws, published by process() at about 60 hz
+    struct View {
+        Vec nodePos[NUM_OF_NODES];
+        NVGcolor nodeColor[NUM_OF_NODES];
+        NVGcolor lineColor[NUM_OF_NODES];
+        float nodeRadius[NUM_OF_NODES];
+        bool nodeVisible[NUM_OF_NODES] = {};
+        bool nodeStart[NUM_OF_NODES] = {};
+        bool nodeTriggered[NUM_OF_NODES] = {};
+        float nodeHaloAlpha[NUM_OF_NODES];
+        float nodeHaloRadius[NUM_OF_NODES];
+        Pulse pulses[NUM_OF_NODES][MAX_PARTICLES];
+        Vec particlePos[MAX_PARTICLES];
+        NVGcolor particleColor[MAX_PARTICLES];
+        float particleRadius[MAX_PARTICLES];
+        bool particleVisible[MAX_PARTICLES] = {};
+    };
+
+    // edits from the display, applied at the start of process()
+    struct Command {
+        int type;
+        Vec pos;
+    };
 
     dsp::SchmittTrigger moveTrig, rndTrig, clearTrig, pauseTrig;
     dsp::PulseGenerator gatePulsesAll[16];
@@ -230,10 +259,33 @@ struct Neutrinode : Module, Quantize {
     float clockStep;
     float maxConnectedDist = 150;
     float pulseSpeed = 1.0 / APP->engine->getSampleRate() * maxConnectedDist;
-    int checkParams = 0;
+    enum ControlIds {
+        CLEAR_CONTROL,
+        PLAY_CONTROL,
+        PLAY_CV_CONTROL,
+        MOVE_CONTROL,
+        MOVE_CV_CONTROL,
+        PITCH_CONTROL,
+        BPM_CONTROL,
+        BPM_CV_CONTROL,
+        NUM_CONTROLS
+    };
+    ControlRate<NUM_CONTROLS> controls;
     int processNodes = 0;
     int moveNodes = 0;
+    int processView = 0;
     int channels = 1;
+    TripleBuffer<View> view;
+    CommandQueue<Command, 64> commands;
+
+    enum PerfPhases {
+        PARAMS_PHASE,
+        MOVEMENT_PHASE,
+        CONNECTIONS_PHASE,
+        PULSES_PHASE,
+        NUM_PERF_PHASES
+    };
+    Profiler<NUM_PERF_PHASES> profiler{"Params", "Movement", "Connections", "Pulses & outputs"};
 
     Neutrinode() {
         config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
@@ -291,6 +343,14 @@ struct Neutrinode : Module, Quantize {
             oneShotStart[i] = false;
         }
 
+        controls.configParam(CLEAR_CONTROL, CLEAR_PARTICLES_PARAM);
+        controls.configParam(PLAY_CONTROL, PLAY_PARAM);
+        controls.configInput(PLAY_CV_CONTROL, PLAY_INPUT);
+        controls.configParam(MOVE_CONTROL, MOVE_PARAM);
+        controls.configInput(MOVE_CV_CONTROL, MOVE_INPUT);
+        controls.configParam(PITCH_CONTROL, PITCH_PARAM);
+        controls.configParam(BPM_CONTROL, BPM_PARAM);
+        controls.configInput(BPM_CV_CONTROL, BPM_INPUT);
     }
 
     ~Neutrinode() {
@@ -345,6 +405,7 @@ struct Neutrinode : Module, Quantize {
         json_object_set_new(rootJ, "channels", json_integer(channels));
         json_object_set_new(rootJ, "nodes", nodesJ);
         json_object_set_new(rootJ, "particles", particlesJ);
+        setProfilerJson(rootJ, profiler);
 
         return rootJ;
     }
@@ -430,15 +491,20 @@ struct Neutrinode : Module, Quantize {
     }
 
     void process(const ProcessArgs &args) override {
-        // checks param knobs every 4th sample
-        if (checkParams == 0) {
+        Command command;
+        while (commands.pop(command)) {
+            applyCommand(command);
+        }
+
+        if (controls.process(this, args.sampleRate)) {
+            PROFILE_SCOPE(profiler, PARAMS_PHASE);
             // if (rndTrig.process(params[RND_PARTICLES_PARAM].getValue())) {
             //     randomizeParticles();
             // }
-            if (clearTrig.process(params[CLEAR_PARTICLES_PARAM].getValue())) {
+            if (clearTrig.process(controls.get(CLEAR_CONTROL))) {
                 clearParticles();
             }
-            if (pauseTrig.process(params[PLAY_PARAM].getValue() + inputs[PLAY_INPUT].getVoltage())) {
+            if (pauseTrig.process(controls.get(PLAY_CONTROL) + controls.get(PLAY_CV_CONTROL))) {
                 if (oneShotMode) {
                     for (int i = 0; i < NUM_OF_NODES; i++) {
                         oneShotStart[i] = true;
@@ -448,17 +514,18 @@ struct Neutrinode : Module, Quantize {
                     toggleStart = !toggleStart;
                 }
             }
-            if (moveTrig.process(params[MOVE_PARAM].getValue() + inputs[MOVE_INPUT].getVoltage())) {
+            if (moveTrig.process(controls.get(MOVE_CONTROL) + controls.get(MOVE_CV_CONTROL))) {
                 movement = !movement;
             }
             // movement = params[MOVE_PARAM].getValue();
-            pitchChoice = params[PITCH_PARAM].getValue();
+            pitchChoice = controls.get(PITCH_CONTROL);
 
-            clockStep = (params[BPM_PARAM].getValue() + (inputs[BPM_INPUT].getVoltage() * 5.0)) / 60.0;
-            clockStep = (clockStep / (args.sampleRate / INTERNAL_SAMP_TIME)) / 2;
-            pulseSpeed = clockStep * maxConnectedDist * 2;
+            if (controls.changed(BPM_CONTROL) || controls.changed(BPM_CV_CONTROL)) {
+                clockStep = (controls.get(BPM_CONTROL) + (controls.get(BPM_CV_CONTROL) * 5.0)) / 60.0;
+                clockStep = (clockStep / (args.sampleRate / INTERNAL_SAMP_TIME)) / 2;
+                pulseSpeed = clockStep * maxConnectedDist * 2;
+            }
         }
-        checkParams = (checkParams+1) % 4;
 
         if (processNodes == 0) {
             bool lightOn = oneShotMode ? oneShotStart[0] : toggleStart;
@@ -466,6 +533,7 @@ struct Neutrinode : Module, Quantize {
 
             if (movement) {
                 if (moveNodes == 0) {
+                    PROFILE_SCOPE(profiler, MOVEMENT_PHASE);
                     updateNodePos();
                     if (nodeCollisionMode) checkCollisions();
                 }
@@ -490,7 +558,17 @@ struct Neutrinode : Module, Quantize {
                     nodes[i].visible = !nodes[i].visible;
                 }
 
+                // connections are decided here, the display only draws them
+                if (nodes[i].visible) {
+                    PROFILE_SCOPE(profiler, CONNECTIONS_PHASE);
+                    for (int j = 0; j < MAX_PARTICLES; j++) {
+                        if (particles[j].visible)
+                            nodes[i].connected(particles[j].box.getCenter(), j);
+                    }
+                }
+
                 if (nodes[i].visible && nodes[i].start) {
+                    PROFILE_SCOPE(profiler, PULSES_PHASE);
                     int oct = params[OCTAVE_PARAMS + i].getValue();
 
                     for (int j = 0; j < MAX_PARTICLES; j++) {
@@ -540,11 +618,105 @@ struct Neutrinode : Module, Quantize {
 
             outputs[GATES_ALL_OUTPUTS].setChannels(channels);
             outputs[VOLTS_ALL_OUTPUTS].setChannels(channels);
+
+            if (processView == 0) publishView();
+            processView = (processView+1) % static_cast<int>(args.sampleRate/60.0/INTERNAL_SAMP_TIME); // 60 hz
         }
         processNodes = (processNodes+1) % INTERNAL_SAMP_TIME;
 
     }
 
+    void publishView() {
+        View &v = view.write();
+        for (int i = 0; i < NUM_OF_NODES; i++) {
+            v.nodePos[i] = nodes[i].box.getCenter();
+            v.nodeColor[i] = nodes[i].color;
+            v.lineColor[i] = nodes[i].lineColor;
+            v.nodeRadius[i] = nodes[i].radius;
+            v.nodeVisible[i] = nodes[i].visible;
+            v.nodeStart[i] = nodes[i].start;
+            v.nodeTriggered[i] = nodes[i].triggered;
+            v.nodeHaloAlpha[i] = nodes[i].haloAlpha;
+            v.nodeHaloRadius[i] = nodes[i].haloRadius;
+            for (int j = 0; j < MAX_PARTICLES; j++) {
+                v.pulses[i][j] = nodes[i].pulses[j];
+            }
+        }
+        for (int i = 0; i < MAX_PARTICLES; i++) {
+            v.particlePos[i] = particles[i].box.getCenter();
+            v.particleColor[i] = particles[i].color;
+            v.particleRadius[i] = particles[i].radius;
+            v.particleVisible[i] = particles[i].visible;
+        }
+        view.publish();
+    }
+
+    // GUI thread only
+    void sendCommand(int type, Vec pos) {
+        commands.push({type, pos});
+    }
+
+    void applyCommand(const Command &command) {
+        switch (command.type) {
+            case GRAB_OBJECT:
+                grabObject(command.pos);
+                break;
+            case DRAG_OBJECT:
+                for (int i = 0; i < NUM_OF_NODES; i++) {
+                    if (!nodes[i].locked) {
+                        nodes[i].box.pos = command.pos;
+                        checkEdges(i);
+                    }
+                }
+                for (int i = 0; i < MAX_PARTICLES; i++) {
+                    if (!particles[i].locked && particles[i].visible) {
+                        particles[i].box.pos = command.pos;
+                        checkEdgesForDelete(i);
+                    }
+                }
+                break;
+        }
+    }
+
+    // a node or particle under the mouse follows it, otherwise a new particle goes there
+    void grabObject(Vec pos) {
+        bool clickedOnObj = false;
+        int nextAvailableIndex = 0;
+        for (int i = 0; i < NUM_OF_NODES; i++) {
+            if (nodes[i].visible && !clickedOnObj && dist(pos, nodes[i].box.getCenter()) < 16) {
+                nodes[i].box.pos = pos;
+                nodes[i].locked = false;
+                clickedOnObj = true;
+            } else {
+                nodes[i].locked = true;
+            }
+        }
+        for (int i = 0; i < MAX_PARTICLES; i++) {
+            if (particles[i].visible) {
+                if (!clickedOnObj && dist(pos, particles[i].box.getCenter()) < particles[i].radius) {
+                    particles[i].box.pos = pos;
+                    particles[i].locked = false;
+                    clickedOnObj = true;
+                } else {
+                    particles[i].locked = true;
+                }
+            } else {
+                nextAvailableIndex = i;
+            }
+        }
+
+        if (!clickedOnObj && visibleParticles < MAX_PARTICLES)
+            addParticle(pos, nextAvailableIndex);
+    }
+
+    // particles dragged off the display get deleted
+    void checkEdgesForDelete(int index) {
+        float r = particles[index].radius;
+        Vec pos = particles[index].box.pos;
+        if (pos.x < r || pos.x > DISPLAY_SIZE - r || pos.y < r || pos.y > DISPLAY_SIZE - r)
+            removeParticle(index);
+    }
+
     void addParticle(Vec pos, int index) {
         visibleParticles++;
         particles[index].setPos(pos);
@@ -708,10 +880,6 @@ namespace NeutrinodeNS {
 
 struct NeutrinodeDisplay : Widget {
     Neutrinode *module;
-    float currentX = 0;
-    float currentY = 0;
-    float posX = 0;
-    float posY = 0;
     float initX = 0;
     float initY = 0;
     float dragX = 0;
@@ -724,56 +892,7 @@ struct NeutrinodeDisplay : Widget {
 			e.consume(this);
 			initX = e.pos.x;
 			initY = e.pos.y;
-            Vec inits = Vec(initX, initY);
-            bool clickedOnObj = false;
-            int nextAvailableIndex = 0;
-            for (int i = 0; i < NUM_OF_NODES; i++) {
-                if (module->nodes[i].visible) {
-                    Vec nodePos = module->nodes[i].box.getCenter();
-                    float d = dist(inits, nodePos);
-                    if (d < 16 && !clickedOnObj) {
-                        module->nodes[i].box.pos.x = initX;
-                        module->nodes[i].box.pos.y = initY;
-                        module->nodes[i].locked = false;
-                        clickedOnObj = true;
-                    } else {
-                        module->nodes[i].locked = true;
-                    }
-                } else {
-                    module->nodes[i].locked = true;
-                }
-            }
-            for (int i = 0; i < MAX_PARTICLES; i++) {
-                if (module->particles[i].visible) {
-                    Vec partPos = module->particles[i].box.getCenter();
-                    float d = dist(inits, partPos);
-                    float r = module->particles[i].radius;
-                    if (d < r && !clickedOnObj) {
-                        // module->particles.erase(module->particles.begin()+i);
-                        module->particles[i].box.pos.x = initX;
-                        module->particles[i].box.pos.y = initY;
-                        module->particles[i].locked = false;
-                        clickedOnObj = true;
-                    } else {
-                        module->particles[i].locked = true;
-                    }
-                } else {
-                    nextAvailableIndex = i;
-                }
-            }
-
-            if (!clickedOnObj && (module->visibleParticles < MAX_PARTICLES)) {
-                module->addParticle(inits, nextAvailableIndex);
-
-                // for (int i = 0; i < NUM_OF_NODES; i++) {
-                //     module->nodes[i].pulses[nextAvailableIndex].setPos(module->nodes[i].box.getCenter());
-                //     module->nodes[i].pulses[nextAvailableIndex].visible = true;
-
-                //     // Pulse pulse;
-                //     // module->nodes[i].pulses.push_back(pulse);
-                // }
-
-            }
+            module->sendCommand(Neutrinode::GRAB_OBJECT, Vec(initX, initY));
         } 
     }
 
@@ -786,53 +905,7 @@ struct NeutrinodeDisplay : Widget {
         float newDragX = APP->scene->rack->getMousePos().x;
         float newDragY = APP->scene->rack->getMousePos().y;
 
-        for (int i = 0; i < NUM_OF_NODES; i++) {
-            if (!module->nodes[i].locked) {
-                module->nodes[i].box.pos.x = initX + (newDragX-dragX);
-                module->nodes[i].box.pos.y = initY + (newDragY-dragY);
-                module->checkEdges(i);
-            }
-        }
-        for (int i = 0; i < MAX_PARTICLES; i++) {
-            if (!module->particles[i].locked && module->particles[i].visible) {
-                module->particles[i].box.pos.x = initX + (newDragX - dragX);
-                module->particles[i].box.pos.y = initY + (newDragY - dragY);
-                checkEdgesForDelete(i);
-            }
-        }
-        // posX = initX + (newDragX - dragX);
-        // posY = initY + (newDragY - dragY);
-
-        // // float dist = std::sqrt(std::pow(posX-currentX, 2) + std::pow(posY-currentY, 2));
-        // Vec inits = Vec(initX, initY);
-        // Vec nodePos = module->nodes[0].box.getCenter();
-        // float d = dist(inits, nodePos);
-        // if (d < 12) {
-        //     module->nodes[0].box.pos.x = initX;
-        //     module->nodes[0].box.pos.y = initY;
-        //     // currentX = posX;
-        //     // currentY = posY;
-        // }
-    }
-
-    void checkEdgesForDelete(int index) {
-        if (module != NULL) {
-            bool eraseParticle = false;
-            float r = module->particles[index].radius;
-
-            if (module->particles[index].box.pos.x < r) eraseParticle = true;
-            else if (module->particles[index].box.pos.x > box.size.x - r) eraseParticle = true;
-            else if (module->particles[index].box.pos.y < r) eraseParticle = true;
-            else if (module->particles[index].box.pos.y > box.size.y - r) eraseParticle = true;
-
-            if (eraseParticle) {
-                module->removeParticle(index);
-                // for (int i = 0; i < NUM_OF_NODES; i++) {
-                //     // module->nodes[i].pulses[index].visible = false;
-                //     // module->nodes[i].pulses.erase(module->nodes[i].pulses.begin() + index);
-                // }
-            }
-        }
+        module->sendCommand(Neutrinode::DRAG_OBJECT, Vec(initX + (newDragX-dragX), initY + (newDragY-dragY)));
     }
 
     void draw(const DrawArgs &args) override {
@@ -855,39 +928,36 @@ struct NeutrinodeDisplay : Widget {
 		if (module == NULL) return;
 
         if (layer == 1) {
-            
+            const Neutrinode::View &v = module->view.read();
+
             // draw nodes
             for (int i = 0; i < NUM_OF_NODES; i++) {
-                if (module->nodes[i].visible) {
+                if (v.nodeVisible[i]) {
                     // draw lines and pulses
-                    // Node n = module->nodes[i];
                     for (int j = 0; j < MAX_PARTICLES; j++) {
-                        if (module->particles[j].visible) {
-                            Vec particle = module->particles[j].box.getCenter();
-                            if (module->nodes[i].connected(particle, j)) {
-                                nvgStrokeColor(args.vg, nvgTransRGBA(module->nodes[i].lineColor, module->nodes[i].lineAlpha));
-                                nvgStrokeWidth(args.vg, module->nodes[i].lineWidth);
+                        if (v.particleVisible[j]) {
+                            Vec particle = v.particlePos[j];
+                            const Pulse *pulse = &v.pulses[i][j];
+                            if (pulse->isConnected) {
+                                nvgStrokeColor(args.vg, nvgTransRGBA(v.lineColor[i], pulse->lineAlpha));
+                                nvgStrokeWidth(args.vg, pulse->lineWidth);
                                 nvgBeginPath(args.vg);
-                                nvgMoveTo(args.vg, module->nodes[i].box.pos.x, module->nodes[i].box.pos.y);
+                                nvgMoveTo(args.vg, v.nodePos[i].x, v.nodePos[i].y);
                                 nvgLineTo(args.vg, particle.x, particle.y);
                                 nvgStroke(args.vg);
                             }
 
-                            if (module->nodes[i].start) {
-                                Pulse *pulse = &module->nodes[i].pulses[j];
+                            if (v.nodeStart[i]) {
                                 if (pulse->visible && pulse->isConnected) {
-
-
-                                    nvgFillColor(args.vg, nvgTransRGBA(module->nodes[i].color, 200));
+                                    nvgFillColor(args.vg, nvgTransRGBA(v.nodeColor[i], 200));
                                     nvgBeginPath(args.vg);
-                                    // Vec pulsePos = module->nodes[i].pulses[j].box.getCenter();
                                     nvgCircle(args.vg, pulse->box.pos.x, pulse->box.pos.y, pulse->radius);
                                     nvgFill(args.vg);
 
                                 }
                                 if (pulse->blipTrigger) {
                                     // pulse blip
-                                    nvgFillColor(args.vg, nvgTransRGBA(module->nodes[i].lineColor, pulse->haloAlpha));
+                                    nvgFillColor(args.vg, nvgTransRGBA(v.lineColor[i], pulse->haloAlpha));
                                     nvgBeginPath(args.vg);
                                     nvgCircle(args.vg, particle.x, particle.y, pulse->haloRadius);
                                     nvgFill(args.vg);
@@ -896,42 +966,39 @@ struct NeutrinodeDisplay : Widget {
                         }
                     }
 
-                    Vec pos = module->nodes[i].box.getCenter();
+                    Vec pos = v.nodePos[i];
                     // display halos
-                    if (module->nodes[i].triggered) {
-                        nvgStrokeColor(args.vg, nvgTransRGBA(module->nodes[i].color, module->nodes[i].haloAlpha));
+                    if (v.nodeTriggered[i]) {
+                        nvgStrokeColor(args.vg, nvgTransRGBA(v.nodeColor[i], v.nodeHaloAlpha[i]));
                         nvgStrokeWidth(args.vg, 2);
                         nvgBeginPath(args.vg);
-                        nvgCircle(args.vg, pos.x, pos.y, module->nodes[i].haloRadius);
+                        nvgCircle(args.vg, pos.x, pos.y, v.nodeHaloRadius[i]);
                         nvgStroke(args.vg);
                     }
                     // display nodes
-                    nvgStrokeColor(args.vg, module->nodes[i].color);
+                    nvgStrokeColor(args.vg, v.nodeColor[i]);
                     nvgStrokeWidth(args.vg, 2);
                     nvgBeginPath(args.vg);
-                    nvgCircle(args.vg, pos.x, pos.y, module->nodes[i].radius);
+                    nvgCircle(args.vg, pos.x, pos.y, v.nodeRadius[i]);
                     nvgStroke(args.vg);
 
-                    nvgFillColor(args.vg, module->nodes[i].color);
+                    nvgFillColor(args.vg, v.nodeColor[i]);
                     nvgBeginPath(args.vg);
-                    nvgCircle(args.vg, pos.x, pos.y, module->nodes[i].radius-3.5);
+                    nvgCircle(args.vg, pos.x, pos.y, v.nodeRadius[i]-3.5);
                     nvgFill(args.vg);
-
-                    module->checkEdges(i);
-                    // checkEdges(i);
                 }
             }
 
             // draw particles
             for (int i = 0; i < MAX_PARTICLES; i++) {
-                if (module->particles[i].visible) {
-                    Vec pos = module->particles[i].box.getCenter();
-                    nvgFillColor(args.vg, nvgTransRGBA(module->particles[i].color, 90));
+                if (v.particleVisible[i]) {
+                    Vec pos = v.particlePos[i];
+                    nvgFillColor(args.vg, nvgTransRGBA(v.particleColor[i], 90));
                     nvgBeginPath(args.vg);
-                    nvgCircle(args.vg, pos.x, pos.y, module->particles[i].radius);
+                    nvgCircle(args.vg, pos.x, pos.y, v.particleRadius[i]);
                     nvgFill(args.vg);
 
-                    nvgFillColor(args.vg, module->particles[i].color);
+                    nvgFillColor(args.vg, v.particleColor[i]);
                     nvgBeginPath(args.vg);
                     nvgCircle(args.vg, pos.x, pos.y, 2.5);
                     nvgFill(args.vg);
@@ -1041,6 +1108,8 @@ struct NeutrinodeWidget : ModuleWidget {
         channelItem->rightText = string::f("%d", module->channels) + " " + RIGHT_ARROW;
         channelItem->module = module;
         menu->addChild(channelItem);
+
+        module->profiler.appendMenu(menu);
     }
 };
 
@@ -32,10 +32,6 @@ struct Particle {
     float radius;
     bool visible;
     bool whiteTrails = true;
-    // std::vector<Trail> history;
-    Trail history[MAX_HISTORY];
-    int currentHistorySize;
-    int historyIndex;
 
     Particle() {
         box.pos.x = randRange(0, DISPLAY_SIZE_WIDTH);
@@ -46,8 +42,6 @@ struct Particle {
         radius = randRange(5, 12);
         mass = radius;
         visible = false;
-        currentHistorySize = 0;
-        historyIndex = 0;
     }
 
     void setPos(Vec _pos) {
@@ -76,28 +70,6 @@ struct Particle {
             trailColor = nvgLerpRGBA(red, blue, _u);
         }
     }
-
-    bool updateHistory() {
-        // trail
-        Vec v = box.getCenter();
-        Trail t = Trail(v.x, v.y, 255);
-
-        // shift elements to insert at beginning
-        for (int i = MAX_HISTORY-1; i > 0; i--) {
-            history[i] = history[i-1];
-        }
-        history[0] = t;
-
-        currentHistorySize = std::min(++currentHistorySize, MAX_HISTORY);
-        historyIndex = (historyIndex + 1) % MAX_HISTORY;
-
-        return true;
-    }
-
-    void clearHistory() {
-        currentHistorySize = 0;
-        historyIndex = 0;
-    }
 };
 
 struct Attractor {
@@ -185,6 +157,32 @@ struct Orbitones : Module {
 	enum LightIds {
 		NUM_LIGHTS
 	};
+    enum CommandIds {
+        ADD_PARTICLE,
+        GRAB_ATTRACTOR,
+        DRAG_ATTRACTORS,
+        NUM_COMMANDS
+    };
+
+    // what the display draws, published by process() at the orbit rate
+    struct View {
+        Vec particlePos[MAX_PARTICLES];
+        NVGcolor particleColor[MAX_PARTICLES];
+        NVGcolor trailColor[MAX_PARTICLES];
+        float particleRadius[MAX_PARTICLES];
+        bool particleVisible[MAX_PARTICLES] = {};
+        Vec attractorPos[NUM_ATTRACTORS];
+        NVGcolor attractorColor[NUM_ATTRACTORS];
+        float attractorRadius[NUM_ATTRACTORS];
+        bool attractorVisible[NUM_ATTRACTORS] = {};
+    };
+
+    // edits from the display, applied at the start of process()
+    struct Command {
+        int type;
+        int index;
+        Vec pos;
+    };
 
     dsp::SchmittTrigger removeTrig, clearTrig, moveTrig;
     Attractor *attractors = new Attractor[NUM_ATTRACTORS];
@@ -196,8 +194,19 @@ struct Orbitones : Module {
     int currentTrailId = 1;
     std::string trails[NUM_TRAIL] = {"off ", "white ", "red/blue shift "};
     int processOrbits = 0;
+
+    enum PerfPhases {
+        COMMANDS_PHASE,
+        ATTRACTORS_PHASE,
+        PARTICLES_PHASE,
+        VIEW_PHASE,
+        NUM_PERF_PHASES
+    };
+    Profiler<NUM_PERF_PHASES> profiler{"GUI commands", "Attractors", "Particles & outputs", "Display snapshot"};
     int visibleParticles = 2;
     int channels = 1;
+    TripleBuffer<View> view;
+    CommandQueue<Command, 64> commands;
 
     Orbitones() {
         config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
@@ -293,6 +302,7 @@ struct Orbitones : Module {
         json_object_set_new(rootJ, "visibleParticles", json_integer(visibleParticles));
         json_object_set_new(rootJ, "attractors", attractorsJ);
         json_object_set_new(rootJ, "particles", particlesJ);
+        setProfilerJson(rootJ, profiler);
 
         return rootJ;
     }
@@ -354,6 +364,14 @@ struct Orbitones : Module {
     }
 
     void process(const ProcessArgs &args) override {
+        {
+            PROFILE_SCOPE(profiler, COMMANDS_PHASE);
+            Command command;
+            while (commands.pop(command)) {
+                applyCommand(command);
+            }
+        }
+
         voltsOffset = params[OFFSET_PARAM].getValue();
         if (removeTrig.process(params[REMOVE_PARTICLE_PARAM].getValue())) {
             if (visibleParticles > 0) removeParticle(visibleParticles-1);
@@ -366,20 +384,23 @@ struct Orbitones : Module {
         }
         
         if (processOrbits == 0) {
-            for (int i = 0; i < NUM_ATTRACTORS; i++) {
-                if (inputs[GLOBAL_GRAVITY_INPUT].isConnected()) {
-                    attractors[i].G = params[GLOBAL_GRAVITY_PARAM].getValue() * std::pow(2.0, inputs[GLOBAL_GRAVITY_INPUT].getVoltage());
-                } else {
-                    attractors[i].G = params[GLOBAL_GRAVITY_PARAM].getValue();
-                }
-                attractors[i].gravityScl = params[GRAVITY_PARAMS + i].getValue();
-                if (attractors[i].toggleTrig.process(params[ON_PARAMS+i].getValue())) {
-                    attractors[i].visible = !attractors[i].visible;
+            {
+                PROFILE_SCOPE(profiler, ATTRACTORS_PHASE);
+                for (int i = 0; i < NUM_ATTRACTORS; i++) {
+                    if (inputs[GLOBAL_GRAVITY_INPUT].isConnected()) {
+                        attractors[i].G = params[GLOBAL_GRAVITY_PARAM].getValue() * std::pow(2.0, inputs[GLOBAL_GRAVITY_INPUT].getVoltage());
+                    } else {
+                        attractors[i].G = params[GLOBAL_GRAVITY_PARAM].getValue();
+                    }
+                    attractors[i].gravityScl = params[GRAVITY_PARAMS + i].getValue();
+                    if (attractors[i].toggleTrig.process(params[ON_PARAMS+i].getValue())) {
+                        attractors[i].visible = !attractors[i].visible;
+                    }
                 }
-            }
 
-            if (movement) {
-                updateAttractorPos();
+                if (movement) {
+                    updateAttractorPos();
+                }
             }
 
             outputs[X_POLY_OUTPUT].setChannels(channels);
@@ -389,49 +410,55 @@ struct Orbitones : Module {
             outputs[VEL_X_POLY_OUTPUT].setChannels(channels);
             outputs[VEL_Y_POLY_OUTPUT].setChannels(channels);
 
-            float scl = 1.0 / visibleParticles;
-            float currentAvgX = 0.0;
-            float currentAvgY = 0.0;
-            float maxX = -5.0;
-            float maxY = -5.0;
-            float minX = 5.0;
-            float minY = 5.0;
-
-            for (int i = 0; i < MAX_PARTICLES; i++) {
-                if (!drawTrails) particles[i].clearHistory();
-                if (particles[i].visible) {
-                    for (int j = 0; j < NUM_ATTRACTORS; j++) {
-                        if (attractors[j].visible) {
-                            Vec force = attractors[j].attract(particles[i]);
-                            particles[i].applyForce(force);
+            {
+                PROFILE_SCOPE(profiler, PARTICLES_PHASE);
+                float scl = 1.0 / visibleParticles;
+                float currentAvgX = 0.0;
+                float currentAvgY = 0.0;
+                float maxX = -5.0;
+                float maxY = -5.0;
+                float minX = 5.0;
+                float minY = 5.0;
+
+                for (int i = 0; i < MAX_PARTICLES; i++) {
+                    if (particles[i].visible) {
+                        for (int j = 0; j < NUM_ATTRACTORS; j++) {
+                            if (attractors[j].visible) {
+                                Vec force = attractors[j].attract(particles[i]);
+                                particles[i].applyForce(force);
+                            }
                         }
+                        particles[i].update();
+                        if (particleBoundary)
+                            checkEdgesParticle(i);
+
+                        float voltsX = rescale(particles[i].box.pos.x, 0, DISPLAY_SIZE_WIDTH, -5.0 + voltsOffset, 5.0 + voltsOffset);
+                        float voltsY = rescale(particles[i].box.pos.y, DISPLAY_SIZE_HEIGHT, 0, -5.0 + voltsOffset, 5.0 + voltsOffset);
+                        float voltsVelX = rescale(particles[i].vel.x, -12.0, 12.0, -5.0 + voltsOffset, 5.0 + voltsOffset);
+                        float voltsVelY = rescale(particles[i].vel.y, 12.0, -12.0, -5.0 + voltsOffset, 5.0 + voltsOffset);
+                        outputs[X_POLY_OUTPUT].setVoltage(voltsX, i);
+                        outputs[Y_POLY_OUTPUT].setVoltage(voltsY, i);
+                        outputs[NEG_X_POLY_OUTPUT].setVoltage(-voltsX, i);
+                        outputs[NEG_Y_POLY_OUTPUT].setVoltage(-voltsY, i);
+                        outputs[VEL_X_POLY_OUTPUT].setVoltage(voltsVelX, i);
+                        outputs[VEL_Y_POLY_OUTPUT].setVoltage(voltsVelY, i);
+                        currentAvgX += voltsX * scl;
+                        currentAvgY += voltsY * scl;
+                        maxX = std::max(maxX, voltsX);
+                        maxY = std::max(maxY, voltsY);
+                        minX = std::min(minX, voltsX);
+                        minY = std::min(minY, voltsY);
                     }
-                    particles[i].update();
-
-                    float voltsX = rescale(particles[i].box.pos.x, 0, DISPLAY_SIZE_WIDTH, -5.0 + voltsOffset, 5.0 + voltsOffset);
-                    float voltsY = rescale(particles[i].box.pos.y, DISPLAY_SIZE_HEIGHT, 0, -5.0 + voltsOffset, 5.0 + voltsOffset);
-                    float voltsVelX = rescale(particles[i].vel.x, -12.0, 12.0, -5.0 + voltsOffset, 5.0 + voltsOffset);
-                    float voltsVelY = rescale(particles[i].vel.y, 12.0, -12.0, -5.0 + voltsOffset, 5.0 + voltsOffset);
-                    outputs[X_POLY_OUTPUT].setVoltage(voltsX, i);
-                    outputs[Y_POLY_OUTPUT].setVoltage(voltsY, i);
-                    outputs[NEG_X_POLY_OUTPUT].setVoltage(-voltsX, i);
-                    outputs[NEG_Y_POLY_OUTPUT].setVoltage(-voltsY, i);
-                    outputs[VEL_X_POLY_OUTPUT].setVoltage(voltsVelX, i);
-                    outputs[VEL_Y_POLY_OUTPUT].setVoltage(voltsVelY, i);
-                    currentAvgX += voltsX * scl;
-                    currentAvgY += voltsY * scl;
-                    maxX = std::max(maxX, voltsX);
-                    maxY = std::max(maxY, voltsY);
-                    minX = std::min(minX, voltsX);
-                    minY = std::min(minY, voltsY);
                 }
+                outputs[MAX_X_OUTPUT].setVoltage(maxX);
+                outputs[MAX_Y_OUTPUT].setVoltage(maxY);
+                outputs[MIN_X_OUTPUT].setVoltage(minX);
+                outputs[MIN_Y_OUTPUT].setVoltage(minY);
+                outputs[AVG_X_OUTPUT].setVoltage(currentAvgX);
+                outputs[AVG_Y_OUTPUT].setVoltage(currentAvgY);
             }
-            outputs[MAX_X_OUTPUT].setVoltage(maxX);
-            outputs[MAX_Y_OUTPUT].setVoltage(maxY);
-            outputs[MIN_X_OUTPUT].setVoltage(minX);
-            outputs[MIN_Y_OUTPUT].setVoltage(minY);
-            outputs[AVG_X_OUTPUT].setVoltage(currentAvgX);
-            outputs[AVG_Y_OUTPUT].setVoltage(currentAvgY);
+
+            publishView();
         }
         processOrbits = (processOrbits + 1) % static_cast<int>(args.sampleRate / INTERNAL_SAMP_TIME); // check 60 hz;
     }
@@ -449,7 +476,6 @@ struct Orbitones : Module {
         particles[index].box.pos = Vec(0, 0);
         particles[index].vel = Vec(0, 0);
         particles[index].visible = false;
-        particles[index].clearHistory();
     }
 
     void clearParticles() {
@@ -457,11 +483,63 @@ struct Orbitones : Module {
             particles[i].box.pos = Vec(0, 0);
             particles[i].vel = Vec(0, 0);
             particles[i].visible = false;
-            particles[i].clearHistory();
         }
         visibleParticles = 0;
     }
 
+    void publishView() {
+        PROFILE_SCOPE(profiler, VIEW_PHASE);
+        View &v = view.write();
+        for (int i = 0; i < MAX_PARTICLES; i++) {
+            v.particlePos[i] = particles[i].box.getCenter();
+            v.particleColor[i] = particles[i].color;
+            v.trailColor[i] = particles[i].trailColor;
+            v.particleRadius[i] = particles[i].radius;
+            v.particleVisible[i] = particles[i].visible;
+        }
+        for (int i = 0; i < NUM_ATTRACTORS; i++) {
+            v.attractorPos[i] = attractors[i].box.getCenter();
+            v.attractorColor[i] = attractors[i].color;
+            v.attractorRadius[i] = attractors[i].radius;
+            v.attractorVisible[i] = attractors[i].visible;
+        }
+        view.publish();
+    }
+
+    // GUI thread only
+    void sendCommand(int type, int index, Vec pos) {
+        commands.push({type, index, pos});
+    }
+
+    void applyCommand(const Command &command) {
+        switch (command.type) {
+            case ADD_PARTICLE:
+                if (visibleParticles < MAX_PARTICLES)
+                    addParticle(command.pos, visibleParticles);
+                break;
+            case GRAB_ATTRACTOR:
+                // the grabbed one follows the mouse, the rest stay put
+                for (int i = 0; i < NUM_ATTRACTORS; i++) {
+                    if (!attractors[i].visible) continue;
+                    if (i == command.index) {
+                        attractors[i].box.pos = command.pos;
+                        attractors[i].locked = false;
+                    } else {
+                        attractors[i].locked = true;
+                    }
+                }
+                break;
+            case DRAG_ATTRACTORS:
+                for (int i = 0; i < NUM_ATTRACTORS; i++) {
+                    if (!attractors[i].locked) {
+                        attractors[i].box.pos = command.pos;
+                        checkEdges(i);
+                    }
+                }
+                break;
+        }
+    }
+
     void setTrails(int trailId) {
         if (trailId == Orbitones::TRAILS_OFF) {
             currentTrailId = Orbitones::TRAILS_OFF;
@@ -502,6 +580,26 @@ struct Orbitones : Module {
         }
     }
 
+    void checkEdgesParticle(int index) {
+        // x's
+        float radius = particles[index].radius;
+        if (particles[index].box.pos.x < radius) {
+            particles[index].box.pos.x = radius;
+            particles[index].vel.x *= -1;
+        } else if (particles[index].box.pos.x > DISPLAY_SIZE_WIDTH - radius) {
+            particles[index].box.pos.x = DISPLAY_SIZE_WIDTH - radius;
+            particles[index].vel.x *= -1;
+        }
+        // y's
+        if (particles[index].box.pos.y < radius) {
+            particles[index].box.pos.y = radius;
+            particles[index].vel.y *= -1;
+        } else if (particles[index].box.pos.y > DISPLAY_SIZE_HEIGHT - radius) {
+            particles[index].box.pos.y = DISPLAY_SIZE_HEIGHT - radius;
+            particles[index].vel.y *= -1;
+        }
+    }
+
     void checkEdges(int index) {
         // x's
         if (attractors[index].box.pos.x < 16) {
@@ -528,6 +626,9 @@ struct OrbitonesDisplay : Widget {
     float initY = 0;
     float dragX = 0;
     float dragY = 0;
+    // trails only exist on screen, so they're kept here instead of in the module
+    Trail history[MAX_PARTICLES][MAX_HISTORY];
+    int historySize[MAX_PARTICLES] = {};
 
     OrbitonesDisplay() {}
 
@@ -537,25 +638,18 @@ struct OrbitonesDisplay : Widget {
             initX = e.pos.x;
             initY = e.pos.y;
             Vec inits = Vec(initX, initY);
-            bool clickedOnObj = false;
+            const Orbitones::View &v = module->view.read();
+            int clicked = -1;
             for (int i = 0; i < Orbitones::NUM_ATTRACTORS; i++) {
-                if (module->attractors[i].visible) {
-                    Vec attPos = module->attractors[i].box.getCenter();
-                    float d = dist(inits, attPos);
-                    if (d < 16 && !clickedOnObj) {
-                        module->attractors[i].box.pos.x = initX;
-                        module->attractors[i].box.pos.y = initY;
-                        module->attractors[i].locked = false;
-                        clickedOnObj = true;
-                    } else {
-                        module->attractors[i].locked = true;
-                    }
+                if (v.attractorVisible[i] && dist(inits, v.attractorPos[i]) < 16) {
+                    clicked = i;
+                    break;
                 }
             }
 
-            if (!clickedOnObj && (module->visibleParticles < MAX_PARTICLES)) {
-                module->addParticle(inits, module->visibleParticles);
-            }
+            module->sendCommand(Orbitones::GRAB_ATTRACTOR, clicked, inits);
+            if (clicked < 0)
+                module->sendCommand(Orbitones::ADD_PARTICLE, 0, inits);
         }
     }
 
@@ -568,13 +662,16 @@ struct OrbitonesDisplay : Widget {
         float newDragX = APP->scene->rack->getMousePos().x;
         float newDragY = APP->scene->rack->getMousePos().y;
 
-        for (int i = 0; i < Orbitones::NUM_ATTRACTORS; i++) {
-            if (!module->attractors[i].locked) {
-                module->attractors[i].box.pos.x = initX + (newDragX - dragX);
-                module->attractors[i].box.pos.y = initY + (newDragY - dragY);
-                module->checkEdges(i);
-            }
+        module->sendCommand(Orbitones::DRAG_ATTRACTORS, 0, Vec(initX + (newDragX - dragX), initY + (newDragY - dragY)));
+    }
+
+    void updateHistory(int index, Vec pos) {
+        // shift elements to insert at beginning
+        for (int i = MAX_HISTORY-1; i > 0; i--) {
+            history[index][i] = history[index][i-1];
         }
+        history[index][0] = Trail(pos.x, pos.y, 255);
+        historySize[index] = std::min(historySize[index] + 1, MAX_HISTORY);
     }
 
     // void checkEdges(int index) {
@@ -598,28 +695,6 @@ struct OrbitonesDisplay : Widget {
     //     }
     // }
 
-    void checkEdgesParticle(int index) {
-        if (module != NULL) {
-            // x's
-            float radius = module->particles[index].radius;
-            if (module->particles[index].box.pos.x < radius) {
-                module->particles[index].box.pos.x = radius;
-                module->particles[index].vel.x *= -1;
-            } else if (module->particles[index].box.pos.x > box.size.x-radius) {
-                module->particles[index].box.pos.x = box.size.x-radius;
-                module->particles[index].vel.x *= -1;
-            }
-            // y's
-            if (module->particles[index].box.pos.y < radius) {
-                module->particles[index].box.pos.y = radius;
-                module->particles[index].vel.y *= -1;
-            } else if (module->particles[index].box.pos.y > box.size.y - radius) {
-                module->particles[index].box.pos.y = box.size.y - radius;
-                module->particles[index].vel.y *= -1;
-            }
-        }
-    }
-
     void draw(const DrawArgs &args) override {
         if (module == NULL) return;
 
@@ -639,58 +714,59 @@ struct OrbitonesDisplay : Widget {
         if (module == NULL) return;
 
         if (layer == 1) {
+            const Orbitones::View &v = module->view.read();
             for (int i = 0; i < Orbitones::NUM_ATTRACTORS; i++) {
-                if (module->attractors[i].visible) {
+                if (v.attractorVisible[i]) {
                     // display attractors
-                    Vec pos = module->attractors[i].box.getCenter();
-                    nvgStrokeColor(args.vg, module->attractors[i].color);
+                    Vec pos = v.attractorPos[i];
+                    nvgStrokeColor(args.vg, v.attractorColor[i]);
                     nvgStrokeWidth(args.vg, 2);
                     nvgBeginPath(args.vg);
-                    nvgCircle(args.vg, pos.x, pos.y, module->attractors[i].radius);
+                    nvgCircle(args.vg, pos.x, pos.y, v.attractorRadius[i]);
                     nvgStroke(args.vg);
 
-                    nvgFillColor(args.vg, module->attractors[i].color);
+                    nvgFillColor(args.vg, v.attractorColor[i]);
                     nvgBeginPath(args.vg);
-                    nvgCircle(args.vg, pos.x, pos.y, module->attractors[i].radius - 3.5);
+                    nvgCircle(args.vg, pos.x, pos.y, v.attractorRadius[i] - 3.5);
                     nvgFill(args.vg);
                 }
             }
             for (int i = 0; i < MAX_PARTICLES; i++) {
-                if (module->particles[i].visible) {
+                if (!v.particleVisible[i] || !module->drawTrails)
+                    historySize[i] = 0;
+                if (v.particleVisible[i]) {
+                    Vec pos = v.particlePos[i];
+
                     // trails
                     nvgScissor(args.vg, 0, 0, DISPLAY_SIZE_WIDTH, DISPLAY_SIZE_HEIGHT); // clip trails to display area
                     if (module->drawTrails) {
-                        bool updated = module->particles[i].updateHistory();
-                        if (!updated) break;
-                        for (int j = 1; j < module->particles[i].currentHistorySize; j++) {
-                            Trail trailPos = module->particles[i].history[j];
-                            Trail trailPosPrev = module->particles[i].history[j-1];
+                        updateHistory(i, pos);
+                        for (int j = 1; j < historySize[i]; j++) {
+                            Trail trailPos = history[i][j];
+                            Trail trailPosPrev = history[i][j-1];
                             nvgBeginPath(args.vg);
                             nvgMoveTo(args.vg, trailPos.x, trailPos.y);
                             nvgLineTo(args.vg, trailPosPrev.x, trailPosPrev.y);
-                            int _alpha = module->particles[i].history[j].alpha;
-                            module->particles[i].history[j].alpha -= 7;
+                            int _alpha = history[i][j].alpha;
+                            history[i][j].alpha -= 7;
                             if (_alpha < 0) _alpha = 0;
                             float trailWidth = rescale(_alpha, 255, 0, 2.0, 0.5);
-                            nvgStrokeColor(args.vg, nvgTransRGBA(module->particles[i].trailColor, _alpha));
+                            nvgStrokeColor(args.vg, nvgTransRGBA(v.trailColor[i], _alpha));
                             nvgStrokeWidth(args.vg, trailWidth);
                             nvgStroke(args.vg);
                         }
                     }
 
                     // particles
-                    Vec pos = module->particles[i].box.getCenter();
-                    nvgFillColor(args.vg, nvgTransRGBA(module->particles[i].color, 90));
+                    nvgFillColor(args.vg, nvgTransRGBA(v.particleColor[i], 90));
                     nvgBeginPath(args.vg);
-                    nvgCircle(args.vg, pos.x, pos.y, module->particles[i].radius);
+                    nvgCircle(args.vg, pos.x, pos.y, v.particleRadius[i]);
                     nvgFill(args.vg);
 
-                    nvgFillColor(args.vg, module->particles[i].color);
+                    nvgFillColor(args.vg, v.particleColor[i]);
                     nvgBeginPath(args.vg);
                     nvgCircle(args.vg, pos.x, pos.y, 2.5);
                     nvgFill(args.vg);
-                    if (module->particleBoundary)
-                        checkEdgesParticle(i);
                 }
             }
         }
@@ -794,6 +870,7 @@ struct OrbitonesWidget : ModuleWidget {
 
         menu->addChild(createBoolPtrMenuItem("Particle boundaries", "", &module->particleBoundary));
 
+        module->profiler.appendMenu(menu);
     }
 };
 
@@ -0,0 +1,67 @@
+#pragma once
+#include <rack.hpp>
+
+using namespace rack;
+
+// the sequencers save hundreds of probabilities & on/off flags. as JSON
+// arrays every one of them is its own json_t, which makes saving, undo and
+// preset browsing slow, so they're saved as base64 strings instead:
+// probabilities as 16 bit values and rhythms as 32 bit masks, little endian.
+// "dataVersion" says which one a patch has, older patches still load
+
+#define PACKED_DATA_VERSION 2
+
+inline void setDataVersion(json_t *rootJ) {
+    json_object_set_new(rootJ, "dataVersion", json_integer(PACKED_DATA_VERSION));
+}
+
+// 1 is everything from before there was a version
+inline int getDataVersion(json_t *rootJ) {
+    json_t *versionJ = json_object_get(rootJ, "dataVersion");
+    return versionJ ? json_integer_value(versionJ) : 1;
+}
+
+// probabilities from 0 to 1
+inline json_t *packProbabilities(const float *probs, int size) {
+    std::vector<uint8_t> bytes(size * 2);
+    for (int i = 0; i < size; i++) {
+        uint16_t value = (uint16_t)std::round(clamp(probs[i], 0.f, 1.f) * 65535.f);
+        bytes[i * 2] = value & 0xff;
+        bytes[i * 2 + 1] = value >> 8;
+    }
+    return json_string(string::toBase64(bytes).c_str());
+}
+
+// leaves the rest alone when the string is short
+inline void unpackProbabilities(json_t *probsJ, float *probs, int size) {
+    if (!json_is_string(probsJ)) return;
+    std::vector<uint8_t> bytes = string::fromBase64(json_string_value(probsJ));
+    int n = std::min(size, (int)bytes.size() / 2);
+    for (int i = 0; i < n; i++) {
+        uint16_t value = bytes[i * 2] | (bytes[i * 2 + 1] << 8);
+        probs[i] = value / 65535.f;
+    }
+}
+
+inline json_t *packMasks(const uint32_t *masks, int size) {
+    std::vector<uint8_t> bytes(size * 4);
+    for (int i = 0; i < size; i++) {
+        for (int b = 0; b < 4; b++) {
+            bytes[i * 4 + b] = (masks[i] >> (b * 8)) & 0xff;
+        }
+    }
+    return json_string(string::toBase64(bytes).c_str());
+}
+
+inline void unpackMasks(json_t *masksJ, uint32_t *masks, int size) {
+    if (!json_is_string(masksJ)) return;
+    std::vector<uint8_t> bytes = string::fromBase64(json_string_value(masksJ));
+    int n = std::min(size, (int)bytes.size() / 4);
+    for (int i = 0; i < n; i++) {
+        uint32_t mask = 0;
+        for (int b = 0; b < 4; b++) {
+            mask |= (uint32_t)bytes[i * 4 + b] << (b * 8);
+        }
+        masks[i] = mask;
+    }
+}
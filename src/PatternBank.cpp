@@ -0,0 +1,127 @@
+#include "plugin.hpp"
+
+#if defined ARCH_WIN
+    #define WIN32_LEAN_AND_MEAN
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+static bool isValidHeader(const PatternBankHeader &header) {
+    return std::memcmp(header.magic, "SBPB", 4) == 0 && header.version == PATTERN_BANK_VERSION
+        && header.recordSize == sizeof(PatternRecord);
+}
+
+// reads a byte from every page, so the audio thread never waits on a page
+// fault the first time it copies a record out
+static void touchPages(const uint8_t *data, size_t size) {
+    volatile uint8_t sum = 0;
+    for (size_t i = 0; i < size; i += 4096) sum += data[i];
+    (void)sum;
+}
+
+bool PatternBank::open(const std::string &path) {
+    close();
+
+#if defined ARCH_WIN
+    HANDLE file = CreateFileW(string::UTF8toUTF16(path).c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE,
+        NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) return false;
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart < (LONGLONG)sizeof(PatternBankHeader)) {
+        CloseHandle(file);
+        return false;
+    }
+    HANDLE mapping = CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    // the view keeps the file open on its own
+    CloseHandle(file);
+    if (!mapping) return false;
+    void *view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if (!view) return false;
+    size = (size_t)fileSize.QuadPart;
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(PatternBankHeader)) {
+        ::close(fd);
+        return false;
+    }
+#if defined ARCH_LIN
+    void *view = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED | MAP_POPULATE, fd, 0);
+#else
+    void *view = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+#endif
+    // the mapping keeps the file open on its own
+    ::close(fd);
+    if (view == MAP_FAILED) return false;
+#if !defined ARCH_LIN
+    madvise(view, st.st_size, MADV_WILLNEED);
+#endif
+    size = st.st_size;
+#endif
+
+    data = (const uint8_t *)view;
+    const PatternBankHeader *header = (const PatternBankHeader *)data;
+    // a short file only gets the records that are all there
+    size_t available = (size - sizeof(PatternBankHeader)) / sizeof(PatternRecord);
+    count = std::min((size_t)header->count, available);
+    if (!isValidHeader(*header) || count == 0) {
+        close();
+        return false;
+    }
+    touchPages(data, size);
+    this->path = path;
+    return true;
+}
+
+void PatternBank::close() {
+    if (data) {
+#if defined ARCH_WIN
+        UnmapViewOfFile(data);
+#else
+        munmap((void *)data, size);
+#endif
+    }
+    data = NULL;
+    size = 0;
+    count = 0;
+}
+
+// the bank might be mapped & playing, so the records go into a new file that
+// replaces it. the old mapping keeps the old file until it's unloaded
+bool appendPatternRecord(const std::string &path, const PatternRecord &record) {
+    PatternBankHeader header;
+    std::vector<PatternRecord> records;
+    FILE *file = std::fopen(path.c_str(), "rb");
+    if (file) {
+        bool ok = std::fread(&header, sizeof(header), 1, file) == 1 && isValidHeader(header);
+        if (ok) {
+            // only the whole records, in case the file got cut off
+            records.resize(header.count);
+            records.resize(std::fread(records.data(), sizeof(PatternRecord), records.size(), file));
+        }
+        std::fclose(file);
+        if (!ok) return false;
+    } else {
+        std::memcpy(header.magic, "SBPB", 4);
+        header.version = PATTERN_BANK_VERSION;
+        header.recordSize = sizeof(PatternRecord);
+    }
+    records.push_back(record);
+    header.count = records.size();
+
+    std::string tmpPath = path + ".tmp";
+    file = std::fopen(tmpPath.c_str(), "wb");
+    if (!file) return false;
+    bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1
+        && std::fwrite(records.data(), sizeof(PatternRecord), records.size(), file) == records.size();
+    ok = std::fclose(file) == 0 && ok;
+    if (ok) ok = system::rename(tmpPath, path);
+    if (!ok) system::remove(tmpPath);
+    return ok;
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <rack.hpp>
+
+using namespace rack;
+
+// a file of StochSeq4 patterns that gets memory mapped, so switching to one
+// is just a copy out of the mapping with no parsing or allocating on the
+// audio thread. the file is a PatternBankHeader and then fixed size
+// PatternRecords, all little endian. the mapping code is in PatternBank.cpp
+
+#define PATTERN_BANK_SEQS 4
+#define PATTERN_BANK_STEPS 32
+#define PATTERN_BANK_VERSION 1
+
+struct PatternBankHeader {
+    char magic[4]; // "SBPB"
+    uint32_t version;
+    uint32_t count;
+    uint32_t recordSize;
+};
+
+struct PatternRecord {
+    float probabilities[PATTERN_BANK_SEQS][PATTERN_BANK_STEPS];
+    int32_t lengths[PATTERN_BANK_SEQS]; // 0 leaves the length knob alone
+};
+
+struct PatternBank {
+    std::string path;
+    const uint8_t *data = NULL;
+    size_t size = 0;
+    int count = 0;
+
+    ~PatternBank() {
+        close();
+    }
+
+    // false if the file can't be mapped or isn't a pattern bank
+    bool open(const std::string &path);
+    void close();
+
+    const PatternRecord *get(int index) const {
+        return (const PatternRecord *)(data + sizeof(PatternBankHeader)) + index;
+    }
+};
+
+// makes the file when it doesn't exist yet
+bool appendPatternRecord(const std::string &path, const PatternRecord &record);
@@ -0,0 +1,78 @@
+#pragma once
+#include <rack.hpp>
+
+using namespace rack;
+
+// pattern transforms shared by StochSeq & StochSeq4. they all work in place
+// on an array of gate probabilities and only use stack storage, so they are
+// safe to call from process()
+#define MAX_PATTERN_LENGTH 32
+
+namespace transforms {
+
+inline void invert(float *probs, int size) {
+    for (int i = 0; i < size; i++) {
+        probs[i] = 1.0 - probs[i];
+    }
+}
+
+// every other step, played twice
+inline void diminish(float *probs, int size) {
+    float temp[MAX_PATTERN_LENGTH / 2];
+    int half = size / 2;
+    if (half < 1) return;
+    for (int i = 0; i < half; i++) {
+        temp[i] = probs[i * 2];
+    }
+    for (int i = 0; i < size; i++) {
+        probs[i] = temp[i % half];
+    }
+}
+
+// first half stretched to the whole pattern, the opposite of diminish
+inline void augment(float *probs, int size) {
+    for (int i = size - 1; i >= 0; i--) {
+        probs[i] = probs[i / 2];
+    }
+}
+
+// positive steps rotate to the right, negative to the left
+inline void rotate(float *probs, int size, int steps) {
+    float temp[MAX_PATTERN_LENGTH];
+    steps = ((steps % size) + size) % size;
+    for (int i = 0; i < size; i++) {
+        temp[(i + steps) % size] = probs[i];
+    }
+    for (int i = 0; i < size; i++) {
+        probs[i] = temp[i];
+    }
+}
+
+inline void reverse(float *probs, int size) {
+    for (int i = 0, j = size - 1; i < j; i++, j--) {
+        std::swap(probs[i], probs[j]);
+    }
+}
+
+// moves every probability up or down
+inline void shift(float *probs, int size, float amount) {
+    for (int i = 0; i < size; i++) {
+        probs[i] = clamp(probs[i] + amount, 0.f, 1.f);
+    }
+}
+
+// scales the distance from 50%, > 1 pushes towards 0 & 1, < 1 towards 50%
+inline void scale(float *probs, int size, float amount) {
+    for (int i = 0; i < size; i++) {
+        probs[i] = clamp((probs[i] - 0.5f) * amount + 0.5f, 0.f, 1.f);
+    }
+}
+
+// anything above the threshold always plays, the rest never does
+inline void threshold(float *probs, int size, float thresh = 0.5) {
+    for (int i = 0; i < size; i++) {
+        probs[i] = (probs[i] > thresh) ? 1.0 : 0.0;
+    }
+}
+
+} // namespace transforms
@@ -66,7 +66,20 @@ struct Photron : Module {
     int waveform = LINES;
     bool lissajous = true;
     int resetIndex = 0;
-    int checkParams = 0;
+    enum ControlIds {
+        WAVEFORM_CONTROL,
+        WAVEFORM_CV_CONTROL,
+        COLOR_CONTROL,
+        COLOR_CV_CONTROL,
+        PATTERN_CV_CONTROL,
+        SEPARATE_CV_CONTROL,
+        ALIGN_CV_CONTROL,
+        COHESION_CV_CONTROL,
+        TARGET_CV_CONTROL,
+        NUM_CONTROLS
+    };
+    ControlRate<NUM_CONTROLS> controls;
+    Vec3 targetColor;
     // int srIncrement = static_cast<int>(APP->engine->getSampleRate() /
     // INTERNAL_HZ);
     int hertzIndex = 2;
@@ -92,6 +105,16 @@ struct Photron : Module {
     Block rightOutputValues[rows];
     Block rightMessages[2][rows];
 
+    enum PerfPhases {
+        EXPANDER_IN_PHASE,
+        FLOCKING_PHASE,
+        METABALLS_PHASE,
+        EXPANDER_OUT_PHASE,
+        SCOPE_PHASE,
+        NUM_PERF_PHASES
+    };
+    Profiler<NUM_PERF_PHASES> profiler{"Expander in", "Flocking", "Metaballs", "Expander out", "Scope"};
+
     Photron() {
         config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
         configParam(X_POS_PARAM, -10.0, 10.0, 0.0, "X offset");
@@ -156,6 +179,16 @@ struct Photron : Module {
         }
 
         resetBlocks(RESET_PARAM);
+
+        controls.configParam(WAVEFORM_CONTROL, WAVEFORM_PARAM);
+        controls.configInput(WAVEFORM_CV_CONTROL, WAVEFORM_INPUT);
+        controls.configParam(COLOR_CONTROL, COLOR_PARAM);
+        controls.configInput(COLOR_CV_CONTROL, COLOR_TRIGGER_INPUT);
+        controls.configInput(PATTERN_CV_CONTROL, PATTERN_INPUT);
+        controls.configInput(SEPARATE_CV_CONTROL, SEPARATE_INPUT);
+        controls.configInput(ALIGN_CV_CONTROL, ALIGN_INPUT);
+        controls.configInput(COHESION_CV_CONTROL, COHESION_INPUT);
+        controls.configInput(TARGET_CV_CONTROL, TARGET_INPUT);
     }
 
     ~Photron() { json_decref(patternsRootJ); }
@@ -262,6 +295,7 @@ struct Photron : Module {
         json_object_set_new(rootJ, "blocks", blocksJ);
         json_object_set_new(rootJ, "pattern", json_integer(patternIndex));
         json_object_set_new(rootJ, "lockPattern", json_boolean(lockPattern));
+        setProfilerJson(rootJ, profiler);
         return rootJ;
     }
 
@@ -306,122 +340,137 @@ struct Photron : Module {
     }
 
     void process(const ProcessArgs &args) override {
-        if (checkParams == 0) {
-            if (waveTrig.process(params[WAVEFORM_PARAM].getValue() +
-                                 inputs[WAVEFORM_INPUT].getVoltage())) {
+        if (controls.process(this, args.sampleRate)) {
+            if (waveTrig.process(controls.get(WAVEFORM_CONTROL) +
+                                 controls.get(WAVEFORM_CV_CONTROL))) {
                 waveformLines = !waveformLines;
                 waveform = (waveform + 1) % NUM_WAVEFORMS;
             }
-            if (colorTrig.process(params[COLOR_PARAM].getValue() +
-                                  inputs[COLOR_TRIGGER_INPUT].getVoltage())) {
+            if (colorTrig.process(controls.get(COLOR_CONTROL) +
+                                  controls.get(COLOR_CV_CONTROL))) {
                 background = (background + 1) % NUM_BG;
             }
-            if (patternTrig.process(inputs[PATTERN_INPUT].getVoltage())) {
+            if (patternTrig.process(controls.get(PATTERN_CV_CONTROL))) {
                 // invertColors();
                 resetBlocks(RESET_PARAM);
             }
+            if (controls.changed(TARGET_CV_CONTROL)) {
+                NVGcolor rgbColor =
+                    nvgHSL(controls.get(TARGET_CV_CONTROL), 1.0, 0.5);
+                targetColor = Vec3(rgbColor.r, rgbColor.g, rgbColor.b).mult(255.0);
+            }
         }
-        checkParams = (checkParams + 1) % 4;
 
         if (sr == 0) {
             bool isParent = (leftExpander.module &&
                              (leftExpander.module->model == modelPhotron));
-            if (isParent) {
-                BlockMessage *outputFromParent =
-                    (BlockMessage *)(leftExpander.consumerMessage);
-                memcpy(outputValues, outputFromParent,
-                       sizeof(BlockMessage) * rows);
-
-                setHz(outputValues[0].hertzIndex);
-                background = (BackgroundIds)outputValues[0].colorMode;
-            }
-
             bool isRightExpander =
                 (rightExpander.module &&
                  (rightExpander.module->model == modelPhotron));
-            if (isRightExpander) {
-                Block *outputFromRight =
-                    (Block *)(rightExpander.consumerMessage);
-                memcpy(rightOutputValues, outputFromRight,
-                       sizeof(Block) * rows);
+            {
+                PROFILE_SCOPE(profiler, EXPANDER_IN_PHASE);
+                if (isParent) {
+                    BlockMessage *outputFromParent =
+                        (BlockMessage *)(leftExpander.consumerMessage);
+                    memcpy(outputValues, outputFromParent,
+                           sizeof(BlockMessage) * rows);
+
+                    setHz(outputValues[0].hertzIndex);
+                    background = (BackgroundIds)outputValues[0].colorMode;
+                }
+
+                if (isRightExpander) {
+                    Block *outputFromRight =
+                        (Block *)(rightExpander.consumerMessage);
+                    memcpy(rightOutputValues, outputFromRight,
+                           sizeof(Block) * rows);
+                }
             }
 
-            bool isTargetConnected = inputs[TARGET_INPUT].isConnected();
+            bool isTargetConnected = controls.isConnected(TARGET_CV_CONTROL);
 
-            for (int y = 0; y < rows; y++) {
-                for (int x = 0; x < cols; x++) {
-                    // TODO: clamp these input values?
-                    blocks[y][x].sepInput = inputs[SEPARATE_INPUT].getVoltage();
-                    blocks[y][x].aliInput = inputs[ALIGN_INPUT].getVoltage();
-                    blocks[y][x].cohInput = inputs[COHESION_INPUT].getVoltage();
-
-                    // adjacents
-                    Block west;
-                    Block east;
-                    Block north;
-                    Block south;
-                    if (isParent && x == 0)
-                        west = outputValues[y].block;
-                    else if (x > 0)
-                        west = blocks[y][x - 1];
-
-                    if (isRightExpander && x == cols - 1)
-                        east = rightOutputValues[y];
-                    else if (x < cols - 1)
-                        east = blocks[y][x + 1];
-
-                    if (y > 0) north = blocks[y - 1][x];
-                    if (y < rows - 1) south = blocks[y + 1][x];
-
-                    // corners
-                    Block northwest;
-                    Block northeast;
-                    Block southwest;
-                    Block southeast;
-
-                    if (isParent && (x == 0) && (y > 0))
-                        northwest = outputValues[y - 1].block;
-                    else if ((x > 0) && (y > 0))
-                        northwest = blocks[y - 1][x - 1];
-
-                    if (isRightExpander && (x == cols - 1) && (y > 0))
-                        northeast = rightOutputValues[y - 1];
-                    else if ((x < cols - 1) && (y > 0))
-                        northeast = blocks[y - 1][x + 1];
-
-                    if (isParent && (x == 0) && (y < rows - 1))
-                        southwest = outputValues[y + 1].block;
-                    else if ((y < rows - 1) && (x > 0))
-                        southwest = blocks[y + 1][x - 1];
-
-                    if (isRightExpander && (x == cols - 1) && (y < rows - 1))
-                        southeast = rightOutputValues[y + 1];
-                    else if ((y < rows - 1) && (x < cols - 1))
-                        southeast = blocks[y + 1][x + 1];
-
-                    Block b[8] = {west, east, north, south,
-                                  northwest, northeast, southwest, southeast};
-                    blocks[y][x].flock(b, 8);
-                    if (isTargetConnected) {
-                        NVGcolor rgbColor =
-                            nvgHSL(inputs[TARGET_INPUT].getVoltage(), 1.0, 0.5);
-                        Vec3 color = Vec3(rgbColor.r, rgbColor.g, rgbColor.b);
-                        Vec3 target = blocks[y][x].seek(color.mult(255.0));
-                        target = target.mult(0.7);
-                        blocks[y][x].applyForce(target);
-                    }
-
-                    blocks[y][x].update();
+            {
+                PROFILE_SCOPE(profiler, FLOCKING_PHASE);
+                for (int y = 0; y < rows; y++) {
+                    for (int x = 0; x < cols; x++) {
+                        // TODO: clamp these input values?
+                        blocks[y][x].sepInput = controls.get(SEPARATE_CV_CONTROL);
+                        blocks[y][x].aliInput = controls.get(ALIGN_CV_CONTROL);
+                        blocks[y][x].cohInput = controls.get(COHESION_CV_CONTROL);
+
+                        // adjacents
+                        Block west;
+                        Block east;
+                        Block north;
+                        Block south;
+                        if (isParent && x == 0)
+                            west = outputValues[y].block;
+                        else if (x > 0)
+                            west = blocks[y][x - 1];
+
+                        if (isRightExpander && x == cols - 1)
+                            east = rightOutputValues[y];
+                        else if (x < cols - 1)
+                            east = blocks[y][x + 1];
+
+                        if (y > 0) north = blocks[y - 1][x];
+                        if (y < rows - 1) south = blocks[y + 1][x];
+
+                        // corners
+                        Block northwest;
+                        Block northeast;
+                        Block southwest;
+                        Block southeast;
+
+                        if (isParent && (x == 0) && (y > 0))
+                            northwest = outputValues[y - 1].block;
+                        else if ((x > 0) && (y > 0))
+                            northwest = blocks[y - 1][x - 1];
+
+                        if (isRightExpander && (x == cols - 1) && (y > 0))
+                            northeast = rightOutputValues[y - 1];
+                        else if ((x < cols - 1) && (y > 0))
+                            northeast = blocks[y - 1][x + 1];
+
+                        if (isParent && (x == 0) && (y < rows - 1))
+                            southwest = outputValues[y + 1].block;
+                        else if ((y < rows - 1) && (x > 0))
+                            southwest = blocks[y + 1][x - 1];
+
+                        if (isRightExpander && (x == cols - 1) && (y < rows - 1))
+                            southeast = rightOutputValues[y + 1];
+                        else if ((y < rows - 1) && (x < cols - 1))
+                            southeast = blocks[y + 1][x + 1];
+
+                        Block b[8] = {west, east, north, south,
+                                      northwest, northeast, southwest, southeast};
+                        blocks[y][x].flock(b, 8);
+                        if (isTargetConnected) {
+                            Vec3 target = blocks[y][x].seek(targetColor);
+                            target = target.mult(0.7);
+                            blocks[y][x].applyForce(target);
+                        }
 
-                    // layer 1 marching stuff
-                    blockAlpha[y][x] = calculateCell(blocks[y][x].getCenter());
+                        blocks[y][x].update();
+                    }
                 }
             }
 
-            for (int i = 0; i < NUM_OF_MARCHING_CIRCLES; i++) {
-                circles[i].update();
+            {
+                PROFILE_SCOPE(profiler, METABALLS_PHASE);
+                // layer 1 marching stuff, each cell only depends on its own block
+                for (int y = 0; y < rows; y++) {
+                    for (int x = 0; x < cols; x++) {
+                        blockAlpha[y][x] = calculateCell(blocks[y][x].getCenter());
+                    }
+                }
+
+                for (int i = 0; i < NUM_OF_MARCHING_CIRCLES; i++) {
+                    circles[i].update();
+                }
             }
 
+            PROFILE_SCOPE(profiler, EXPANDER_OUT_PHASE);
             // to expander (right side)
             if (rightExpander.module &&
                 (rightExpander.module->model == modelPhotron)) {
@@ -459,6 +508,7 @@ struct Photron : Module {
         }
 
         /************ SCOPE STUFF ************/
+        PROFILE_SCOPE(profiler, SCOPE_PHASE);
         // Compute time
         float deltaTime =
             powf(2.0, -14.0);  // powf(2.0, params[TIME_PARAM].value);
@@ -1133,6 +1183,8 @@ struct PhotronWidget : ModuleWidget {
             [=](bool lock) {
                 module->setLockPattern(lock);
             }));
+
+        module->profiler.appendMenu(menu);
     }
 };
 
@@ -45,22 +45,25 @@ struct PolyrhythmClock : Module {
         NUM_LIGHTS
     };
 
-    dsp::SchmittTrigger toggleTrig, bpmInputTrig, resetTrig;
+    dsp::SchmittTrigger toggleTrig, resetTrig;
+    ClockFollower clockFollower;
+    LightDivider lightDivider;
     dsp::PulseGenerator gatePulses[4];
     bool tupletGates[4] = {};
     bool clockOn = false;
     int bpmInputMode = BPM_CV;
-    int extPulseIndex = 0;
     int extIntervalTime = 0; // keeps track of number of samples lapsed
-    int ppqn = 0;
-    float period = 0.0;
     int timeOut = 1; // seconds
     float currentBPM = 120.0;
     float clockFreq = 2.0; // Hz
-    float phases[4] = {};
     float randoms[4];
-    float currentRhythmFraction[3] = {};
-    float phase = 0;
+    float phase = 0; // main beat
+    // the tuplets are exact fractions of the main beat: tuplet i plays pulses[i]
+    // evenly spaced pulses every beats[i] main beats, so they can't drift apart
+    int pulses[4] = {1, 1, 1, 1};
+    int beats[4] = {1, 1, 1, 1};
+    int cycleBeat[4] = {}; // main beats into the current cycle
+    int pulseIndex[4] = {}; // last pulse in the current cycle
     float phaseTuplet1 = 0;
     float phaseTuplet2 = 0;
     float phaseTuplet3 = 0;
@@ -73,6 +76,14 @@ struct PolyrhythmClock : Module {
 
     int previousTheme = 0;
 
+    enum PerfPhases {
+        INPUTS_PHASE,
+        CLOCK_PHASE,
+        OUTPUTS_PHASE,
+        NUM_PERF_PHASES
+    };
+    Profiler<NUM_PERF_PHASES> profiler{"Tuplet inputs", "Clock & tuplets", "Outputs"};
+
     PolyrhythmClock() {
         config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
         configButton(CLOCK_TOGGLE_PARAM, "Toggle clock");
@@ -98,36 +109,66 @@ struct PolyrhythmClock : Module {
         configOutput(TUPLET2_OUTPUT, "Tuplet 2");
         configOutput(TUPLET3_OUTPUT, "Tuplet 3");
 
-        currentRhythmFraction[0] = params[TUPLET1_RHYTHM_PARAM].getValue() / params[TUPLET1_DUR_PARAM].getValue();
-        currentRhythmFraction[1] = params[TUPLET2_RHYTHM_PARAM].getValue() / params[TUPLET2_DUR_PARAM].getValue();
-        currentRhythmFraction[2] = params[TUPLET3_RHYTHM_PARAM].getValue() / params[TUPLET3_DUR_PARAM].getValue();
-
         for (int i = 0; i < 3; i++) {
             configParam(TUPLETS_RAND_PARAM+i, 0.0, 1.0, 1.0, "Probability", "%", 0, 100);
             randoms[i] = random::uniform();
         }
+        setFractionsFromParams();
     }
 
-    void checkPhases() {
-        for (int i = 0; i < 4; i++) {
-            if (phases[i] >= 1.0) {
-                phases[i] = 0.0;
-                if (i > 0) randoms[i] = random::uniform();
+    // new fractions start at the beginning of a main beat. the CVs are
+    // continuous, they're rounded to the nearest whole tuplet
+    void setFractions(float r1, float d1, float r2, float d2, float r3, float d3) {
+        int r[3] = {(int)std::round(r1), (int)std::round(r2), (int)std::round(r3)};
+        int d[3] = {(int)std::round(d1), (int)std::round(d2), (int)std::round(d3)};
+        int num = 1, den = 1;
+        for (int i = 1; i < 4; i++) {
+            // tuplets are nested, each one is a fraction of the one before
+            num *= std::max(r[i-1], 0);
+            den *= std::max(d[i-1], 1);
+            int g = gcd(num, den);
+            if (g > 1) {
+                num /= g;
+                den /= g;
             }
-
-            // TODO: this is awkward, i think it can be better
-            if (i > 0) {
-                if (randoms[i] < params[TUPLETS_RAND_PARAM + i-1].getValue())
-                    if (phases[i] == 0.0) gatePulses[i].trigger(1e-3f);
-            } else {
-                if (phases[i] == 0.0) gatePulses[i].trigger(1e-3f);
+            if (num != pulses[i] || den != beats[i]) {
+                pulses[i] = num;
+                beats[i] = den;
+                cycleBeat[i] = 0;
+                pulseIndex[i] = -1;
             }
         }
     }
 
+    // process() only picks up new fractions on a main beat, so a new or
+    // loaded module starts from its knobs
+    void setFractionsFromParams() {
+        setFractions(params[TUPLET1_RHYTHM_PARAM].getValue(), params[TUPLET1_DUR_PARAM].getValue(),
+            params[TUPLET2_RHYTHM_PARAM].getValue(), params[TUPLET2_DUR_PARAM].getValue(),
+            params[TUPLET3_RHYTHM_PARAM].getValue(), params[TUPLET3_DUR_PARAM].getValue());
+        resetPhases();
+    }
+
+    static int gcd(int a, int b) {
+        while (b != 0) {
+            int t = a % b;
+            a = b;
+            b = t;
+        }
+        return a;
+    }
+
+    void triggerTuplet(int i) {
+        randoms[i] = random::uniform();
+        if (randoms[i] < params[TUPLETS_RAND_PARAM + i-1].getValue())
+            gatePulses[i].trigger(1e-3f);
+    }
+
     void resetPhases() {
+        phase = 0.0;
         for (int i = 0; i < 4; i++) {
-            phases[i] = 0.0;
+            cycleBeat[i] = 0;
+            pulseIndex[i] = 0;
         }
     }
 
@@ -136,6 +177,8 @@ struct PolyrhythmClock : Module {
 
         json_object_set_new(rootJ, "clockOn", json_boolean(clockOn));
         json_object_set_new(rootJ, "extmode", json_integer(bpmInputMode));
+        json_object_set_new(rootJ, "clockSmoothing", json_integer(clockFollower.smoothing));
+        setProfilerJson(rootJ, profiler);
 
         return rootJ;
     }
@@ -146,6 +189,15 @@ struct PolyrhythmClock : Module {
 
         json_t *extmodeJ = json_object_get(rootJ, "extmode");
         if (extmodeJ) bpmInputMode = json_integer_value(extmodeJ);
+
+        json_t *clockSmoothingJ = json_object_get(rootJ, "clockSmoothing");
+        if (clockSmoothingJ) clockFollower.smoothing = json_integer_value(clockSmoothingJ);
+
+        setFractionsFromParams();
+    }
+
+    void onReset() override {
+        setFractionsFromParams();
     }
 
     void process(const ProcessArgs& args) override {
@@ -158,98 +210,67 @@ struct PolyrhythmClock : Module {
             clockOn = !clockOn;
         }
 
-        // fraction 1
-        if (inputs[TUPLET1_RHYTHM_INPUT].isConnected()) {
-            rhythm1 = inputs[TUPLET1_RHYTHM_INPUT].getVoltage() * 12.0;
-            rhythm1 = clamp(rhythm1, 0.f, 24.f);
-        } else {
-            rhythm1 = params[TUPLET1_RHYTHM_PARAM].getValue();
-        }
-        if (inputs[TUPLET1_DUR_INPUT].isConnected()) {
-            dur1 = inputs[TUPLET1_DUR_INPUT].getVoltage() * 12.0;
-            dur1 = clamp(dur1, 1.f, 24.f);
-        } else {
-            dur1 = params[TUPLET1_DUR_PARAM].getValue();
-        }
+        {
+            PROFILE_SCOPE(profiler, INPUTS_PHASE);
+            // fraction 1
+            if (inputs[TUPLET1_RHYTHM_INPUT].isConnected()) {
+                rhythm1 = inputs[TUPLET1_RHYTHM_INPUT].getVoltage() * 12.0;
+                rhythm1 = clamp(rhythm1, 0.f, 24.f);
+            } else {
+                rhythm1 = params[TUPLET1_RHYTHM_PARAM].getValue();
+            }
+            if (inputs[TUPLET1_DUR_INPUT].isConnected()) {
+                dur1 = inputs[TUPLET1_DUR_INPUT].getVoltage() * 12.0;
+                dur1 = clamp(dur1, 1.f, 24.f);
+            } else {
+                dur1 = params[TUPLET1_DUR_PARAM].getValue();
+            }
 
-        // fraction 2
-        if (inputs[TUPLET2_RHYTHM_INPUT].isConnected()) {
-            rhythm2 = inputs[TUPLET2_RHYTHM_INPUT].getVoltage() * 12.0;
-            rhythm2 = clamp(rhythm2, 0.f, 24.f);
-        } else {
-            rhythm2 = params[TUPLET2_RHYTHM_PARAM].getValue();
-        }
-        if (inputs[TUPLET2_DUR_INPUT].isConnected()) {
-            dur2 = inputs[TUPLET2_DUR_INPUT].getVoltage() * 12.0;
-            dur2 = clamp(dur2, 1.f, 24.f);
-        } else {
-            dur2 = params[TUPLET2_DUR_PARAM].getValue();
-        }
+            // fraction 2
+            if (inputs[TUPLET2_RHYTHM_INPUT].isConnected()) {
+                rhythm2 = inputs[TUPLET2_RHYTHM_INPUT].getVoltage() * 12.0;
+                rhythm2 = clamp(rhythm2, 0.f, 24.f);
+            } else {
+                rhythm2 = params[TUPLET2_RHYTHM_PARAM].getValue();
+            }
+            if (inputs[TUPLET2_DUR_INPUT].isConnected()) {
+                dur2 = inputs[TUPLET2_DUR_INPUT].getVoltage() * 12.0;
+                dur2 = clamp(dur2, 1.f, 24.f);
+            } else {
+                dur2 = params[TUPLET2_DUR_PARAM].getValue();
+            }
 
-        // fraction 3
-        if (inputs[TUPLET3_RHYTHM_INPUT].isConnected()) {
-            rhythm3 = inputs[TUPLET3_RHYTHM_INPUT].getVoltage() * 12.0;
-            rhythm3 = clamp(rhythm3, 0.f, 24.f);
-        } else {
-            rhythm3 = params[TUPLET3_RHYTHM_PARAM].getValue();
-        }
-        if (inputs[TUPLET3_DUR_INPUT].isConnected()) {
-            dur3 = inputs[TUPLET3_DUR_INPUT].getVoltage() * 12.0;
-            dur3 = clamp(dur3, 1.f, 24.f);
-        } else {
-            dur3 = params[TUPLET3_DUR_PARAM].getValue();
+            // fraction 3
+            if (inputs[TUPLET3_RHYTHM_INPUT].isConnected()) {
+                rhythm3 = inputs[TUPLET3_RHYTHM_INPUT].getVoltage() * 12.0;
+                rhythm3 = clamp(rhythm3, 0.f, 24.f);
+            } else {
+                rhythm3 = params[TUPLET3_RHYTHM_PARAM].getValue();
+            }
+            if (inputs[TUPLET3_DUR_INPUT].isConnected()) {
+                dur3 = inputs[TUPLET3_DUR_INPUT].getVoltage() * 12.0;
+                dur3 = clamp(dur3, 1.f, 24.f);
+            } else {
+                dur3 = params[TUPLET3_DUR_PARAM].getValue();
+            }
         }
 
-        lights[TOGGLE_LIGHT].setBrightness(clockOn ? 1.0 : 0.0);
+        if (lightDivider.process(args.sampleRate))
+            lights[TOGGLE_LIGHT].setBrightness(clockOn ? 1.0 : 0.0);
 
         for (int i = 0; i < 4; i++) {
             tupletGates[i] = false;
         }
 
-        // This could possibly be cleaned up in a later version
         bool bpmDetect = false;
         if (inputs[EXT_CLOCK_INPUT].isConnected()) {
             if (bpmInputMode == BPM_CV) {
                 clockFreq = 2.0 * std::pow(2.0, inputs[EXT_CLOCK_INPUT].getVoltage());
             } else {
-                bpmDetect = bpmInputTrig.process(inputs[EXT_CLOCK_INPUT].getVoltage());
+                bpmDetect = clockFollower.process(inputs[EXT_CLOCK_INPUT].getVoltage(), args.sampleTime);
                 if (bpmDetect)
                     clockOn = true;
-                switch(bpmInputMode) {
-                    case BPM_P2: 
-                        ppqn = 2; 
-                        break;
-                    case BPM_P4: 
-                        ppqn = 4;
-                        break;
-                    case BPM_P8:
-                        ppqn = 8;
-                        break;
-                    case BPM_P12:
-                        ppqn = 12;
-                        break;
-                    case BPM_P24:
-                        ppqn = 24;
-                        break;
-                }
             }
-            
-            // else if (bpmInputMode == BPM_P8) {
-            //     ppqn = 8;
-            //     bpmDetect = bpmInputTrig.process(inputs[EXT_CLOCK_INPUT].getVoltage());
-            //     if (bpmDetect)
-            //         clockOn = true;
-            // } else if (bpmInputMode == BPM_P12) {
-            //     ppqn = 12;
-            //     bpmDetect = bpmInputTrig.process(inputs[EXT_CLOCK_INPUT].getVoltage());
-            //     if (bpmDetect)
-            //         clockOn = true;
-            // } else if (bpmInputMode == BPM_P24) {
-            //     ppqn = 24;
-            //     bpmDetect = bpmInputTrig.process(inputs[EXT_CLOCK_INPUT].getVoltage());
-            //     if (bpmDetect)
-            //         clockOn = true;
-            // }
         } else {
             float bpmParam = params[BPM_PARAM].getValue();
             clockFreq = std::pow(2.0, bpmParam);
@@ -257,51 +278,44 @@ struct PolyrhythmClock : Module {
         currentBPM = clockFreq * 60;
 
         if (clockOn) {
+            PROFILE_SCOPE(profiler, CLOCK_PHASE);
             if (bpmInputMode != BPM_CV && inputs[EXT_CLOCK_INPUT].isConnected()) {
-                period += args.sampleTime;
-                if (period > timeOut) clockOn = false;
-                if (bpmDetect) {
-                    if (extPulseIndex > 1) {
-                        clockFreq = (1.0 / period) / (float)ppqn;
-                    }
-
-                    extPulseIndex++;
-                    if (extPulseIndex >= ppqn) extPulseIndex = 0;
-                    period = 0.0;
+                if (clockFollower.getTimeSinceEdge() > timeOut) {
+                    clockOn = false;
+                    clockFollower.reset();
                 }
+                if (bpmDetect && clockFollower.isLocked())
+                    clockFreq = clockFollower.getFrequency(getPPQN(bpmInputMode));
             }
 
-            float frac1 = rhythm1 / dur1;
-            float frac2 = rhythm2 / dur2;
-            float frac3 = rhythm3 / dur3;
-            if (currentRhythmFraction[0] != frac1 && phases[0] == 0.0) {
-                currentRhythmFraction[0] = frac1;
-                phases[1] = 0.0;
-            }
-            if (currentRhythmFraction[1] != frac2 && phases[1] == 0.0) {
-                currentRhythmFraction[1] = frac2;
-                phases[2] = 0.0;
-            }
-            if (currentRhythmFraction[2] != frac3 && phases[2] == 0.0) {
-                currentRhythmFraction[2] = frac3;
-                phases[3] = 0.0;
+            phase += clockFreq * args.sampleTime;
+            if (phase >= 1.0) {
+                phase -= std::floor(phase);
+                gatePulses[0].trigger(1e-3f);
+                for (int i = 1; i < 4; i++) {
+                    if (++cycleBeat[i] >= beats[i]) {
+                        cycleBeat[i] = 0;
+                        pulseIndex[i] = -1;
+                    }
+                }
+                setFractions(rhythm1, dur1, rhythm2, dur2, rhythm3, dur3);
             }
 
-            // calculate embedded tuplets
-            phases[0] += clockFreq * args.sampleTime;
-            float accFreq = clockFreq * currentRhythmFraction[0];
-            phases[1] += accFreq * args.sampleTime;
-            accFreq *= params[TUPLET2_RHYTHM_PARAM].getValue() / params[TUPLET2_DUR_PARAM].getValue();
-            phases[2] += accFreq * args.sampleTime;
-            accFreq *= params[TUPLET3_RHYTHM_PARAM].getValue() / params[TUPLET3_DUR_PARAM].getValue();
-            phases[3] += accFreq * args.sampleTime;
-
-            checkPhases();
+            // position in the cycle is exact beats + the main beat's phase
+            for (int i = 1; i < 4; i++) {
+                if (pulses[i] == 0) continue;
+                int p = static_cast<int>((cycleBeat[i] + (double)phase) * pulses[i] / beats[i]);
+                if (p != pulseIndex[i]) {
+                    pulseIndex[i] = p;
+                    triggerTuplet(i);
+                }
+            }
 
         } else {
             resetPhases();
         }
 
+        PROFILE_SCOPE(profiler, OUTPUTS_PHASE);
         for (int i = 0; i < 4; i++) {
             tupletGates[i] = gatePulses[i].process(1.0 / args.sampleRate);
         }
@@ -384,8 +398,8 @@ struct RatioDisplay : Widget {
         else
             color = nvgRGB(255, 255, 255);
 
-        int num1 = (int)module->rhythm1;
-        int den1 = (int)module->dur1;
+        int num1 = (int)std::round(module->rhythm1);
+        int den1 = (int)std::round(module->dur1);
         text1 = std::to_string(num1) + ":" + std::to_string(den1);
         float xPos1 = num1 < 10 ? 7.6 : 0.0;
         nvgTextAlign(args.vg, NVG_ALIGN_LEFT + NVG_ALIGN_TOP);
@@ -395,8 +409,8 @@ struct RatioDisplay : Widget {
         nvgFontSize(args.vg, fontSize);
 		nvgText(args.vg, xPos1, 0, text1.c_str(), NULL);
 
-        int num2 = (int)module->rhythm2;
-        int den2 = (int)module->dur2;
+        int num2 = (int)std::round(module->rhythm2);
+        int den2 = (int)std::round(module->dur2);
         text2 = std::to_string(num2) + ":" + std::to_string(den2);
         float xPos2 = num2 < 10 ? 7.6 : 0.0;
         // nvgTextAlign(args.vg, NVG_ALIGN_CENTER);
@@ -406,8 +420,8 @@ struct RatioDisplay : Widget {
         // nvgText(args.vg, 5, 5, text2.c_str(), NULL);
         nvgText(args.vg, xPos2, 75.4, text2.c_str(), NULL);
 
-        int num3 = (int)module->rhythm3;
-        int den3 = (int)module->dur3;
+        int num3 = (int)std::round(module->rhythm3);
+        int den3 = (int)std::round(module->dur3);
         text3 = std::to_string(num3) + ":" + std::to_string(den3);
         float xPos3 = num3 < 10 ? 7.6 : 0.0;
         // nvgTextAlign(args.vg, NVG_ALIGN_CENTER);
@@ -491,6 +505,9 @@ struct PolyrhythmClockWidget : ModuleWidget {
         extClockModeItem->rightText = RIGHT_ARROW;
         extClockModeItem->module = module;
         menu->addChild(extClockModeItem);
+        menu->addChild(createIndexPtrSubmenuItem("External Clock Smoothing", {"Off", "Light", "Heavy"}, &module->clockFollower.smoothing));
+
+        module->profiler.appendMenu(menu);
     }
 };
 
@@ -0,0 +1,160 @@
+#pragma once
+#include <rack.hpp>
+#include <atomic>
+#include <chrono>
+
+using namespace rack;
+
+// timers around the phases of process(), only compiled in with
+// `make PROFILE=1`. otherwise PROFILE_SCOPE is nothing and
+// the Profiler is empty, so the modules don't need any #ifdefs.
+// the results show up in a "Performance" submenu and in the module's JSON
+
+#ifdef SHABANG_PROFILE
+
+// durations of one phase in power of 2 nanosecond buckets. only the engine
+// thread writes, so it doesn't need atomic read-modify-writes, and the menu
+// can read it any time
+struct PhaseHistogram {
+    static const int NUM_BUCKETS = 24; // the last one is everything over ~8 ms
+    const char *name = "";
+    std::atomic<uint32_t> buckets[NUM_BUCKETS];
+    std::atomic<uint64_t> count{0};
+    std::atomic<uint64_t> totalNs{0};
+    std::atomic<uint32_t> maxNs{0};
+    std::atomic<bool> clearRequested{false};
+
+    PhaseHistogram() {
+        for (int i = 0; i < NUM_BUCKETS; i++) buckets[i].store(0);
+    }
+
+    void record(uint32_t ns) {
+        if (clearRequested.exchange(false, std::memory_order_relaxed)) {
+            for (int i = 0; i < NUM_BUCKETS; i++) buckets[i].store(0, std::memory_order_relaxed);
+            count.store(0, std::memory_order_relaxed);
+            totalNs.store(0, std::memory_order_relaxed);
+            maxNs.store(0, std::memory_order_relaxed);
+        }
+        int b = std::min(ns ? 31 - __builtin_clz(ns) : 0, NUM_BUCKETS - 1);
+        buckets[b].store(buckets[b].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        totalNs.store(totalNs.load(std::memory_order_relaxed) + ns, std::memory_order_relaxed);
+        if (ns > maxNs.load(std::memory_order_relaxed))
+            maxNs.store(ns, std::memory_order_relaxed);
+    }
+
+    float getAverage() {
+        uint64_t n = count.load();
+        return n ? (float)totalNs.load() / n : 0.f;
+    }
+
+    // upper edge of the bucket the percentile falls in
+    uint32_t getPercentile(float p) {
+        uint64_t target = (uint64_t)std::ceil(count.load() * p);
+        uint64_t sum = 0;
+        for (int i = 0; i < NUM_BUCKETS; i++) {
+            sum += buckets[i].load();
+            if (sum >= target && sum > 0) return 2u << i;
+        }
+        return 0;
+    }
+};
+
+struct ScopedTimer {
+    PhaseHistogram &phase;
+    std::chrono::steady_clock::time_point start;
+
+    ScopedTimer(PhaseHistogram &phase) : phase(phase), start(std::chrono::steady_clock::now()) {}
+
+    ~ScopedTimer() {
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        phase.record((uint32_t)std::min<int64_t>(ns, UINT32_MAX));
+    }
+};
+
+inline std::string formatNs(float ns) {
+    if (ns < 1000.f) return string::f("%.0f ns", ns);
+    if (ns < 1e6f) return string::f("%.1f µs", ns * 1e-3f);
+    return string::f("%.2f ms", ns * 1e-6f);
+}
+
+template <int N>
+struct Profiler {
+    PhaseHistogram phases[N];
+
+    Profiler(std::initializer_list<const char *> names) {
+        int i = 0;
+        for (const char *name : names) {
+            if (i < N) phases[i++].name = name;
+        }
+    }
+
+    void clear() {
+        for (int i = 0; i < N; i++) phases[i].clearRequested = true;
+    }
+
+    uint64_t getTotalNs() {
+        uint64_t total = 0;
+        for (int i = 0; i < N; i++) total += phases[i].totalNs.load();
+        return total;
+    }
+
+    void appendMenu(Menu *menu) {
+        menu->addChild(createSubmenuItem("Performance", "", [=](Menu *menu) {
+            uint64_t total = getTotalNs();
+            for (int i = 0; i < N; i++) {
+                PhaseHistogram &phase = phases[i];
+                float share = total ? 100.f * phase.totalNs.load() / total : 0.f;
+                menu->addChild(createMenuLabel(string::f("%s: %s avg, p99 < %s, max %s (%.0f%%)", phase.name,
+                    formatNs(phase.getAverage()).c_str(), formatNs(phase.getPercentile(0.99f)).c_str(),
+                    formatNs(phase.maxNs.load()).c_str(), share)));
+            }
+            menu->addChild(new MenuSeparator);
+            menu->addChild(createMenuItem("Clear", "", [=]() { clear(); }));
+        }));
+    }
+
+    json_t *toJson() {
+        json_t *rootJ = json_object();
+        for (int i = 0; i < N; i++) {
+            PhaseHistogram &phase = phases[i];
+            json_t *phaseJ = json_object();
+            json_object_set_new(phaseJ, "count", json_integer((json_int_t)phase.count.load()));
+            json_object_set_new(phaseJ, "averageNs", json_real(phase.getAverage()));
+            json_object_set_new(phaseJ, "p50Ns", json_integer(phase.getPercentile(0.5f)));
+            json_object_set_new(phaseJ, "p99Ns", json_integer(phase.getPercentile(0.99f)));
+            json_object_set_new(phaseJ, "maxNs", json_integer(phase.maxNs.load()));
+            json_t *bucketsJ = json_array();
+            for (int b = 0; b < PhaseHistogram::NUM_BUCKETS; b++) {
+                json_array_append_new(bucketsJ, json_integer(phase.buckets[b].load()));
+            }
+            json_object_set_new(phaseJ, "buckets", bucketsJ);
+            json_object_set_new(rootJ, phase.name, phaseJ);
+        }
+        return rootJ;
+    }
+};
+
+#define PROFILE_CONCAT2(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT2(a, b)
+#define PROFILE_SCOPE(profiler, phase) ScopedTimer PROFILE_CONCAT(scopedTimer, __LINE__)(profiler.phases[phase])
+
+#else
+
+template <int N>
+struct Profiler {
+    Profiler(std::initializer_list<const char *> names) {}
+    void appendMenu(Menu *menu) {}
+    json_t *toJson() { return NULL; }
+};
+
+#define PROFILE_SCOPE(profiler, phase)
+
+#endif
+
+// adds the profiler's report to the module's JSON, when it's compiled in
+template <int N>
+void setProfilerJson(json_t *rootJ, Profiler<N> &profiler) {
+    json_t *perfJ = profiler.toJson();
+    if (perfJ) json_object_set_new(rootJ, "performance", perfJ);
+}
@@ -1,5 +1,97 @@
 #include "plugin.hpp"
 
+using simd::float_4;
+
+#define MAX_OVERSAMPLE 8
+#define OVERSAMPLE_TAPS 16 // filter taps per polyphase branch
+
+// windowed-sinc lowpass kernels for 1x, 2x, 4x and 8x. they only get worked out
+// once, the first module makes them on the GUI thread, so switching the
+// oversampling on the audio thread is just picking one
+struct OversampleKernels {
+    float kernels[4][MAX_OVERSAMPLE * OVERSAMPLE_TAPS];
+
+    OversampleKernels() {
+        for (int k = 0; k < 4; k++) {
+            int factor = 1 << k;
+            int len = factor * OVERSAMPLE_TAPS;
+            float cutoff = 0.45 / factor;
+            float center = (len - 1) * 0.5;
+            float sum = 0.0;
+            for (int i = 0; i < len; i++) {
+                float x = 2.0 * cutoff * (i - center);
+                float sinc = (x == 0.0) ? 1.0 : std::sin(M_PI * x) / (M_PI * x);
+                float w = 2.0 * M_PI * i / (len - 1);
+                float window = 0.35875 - 0.48829 * std::cos(w) + 0.14128 * std::cos(2 * w) - 0.01168 * std::cos(3 * w);
+                kernels[k][i] = sinc * window;
+                sum += kernels[k][i];
+            }
+            for (int i = 0; i < len; i++) {
+                kernels[k][i] /= sum;
+            }
+        }
+    }
+
+    static const float *get(int factor) {
+        static const OversampleKernels table;
+        int k = 0;
+        while ((1 << k) < factor && k < 3) k++;
+        return table.kernels[k];
+    }
+};
+
+// polyphase windowed-sinc up/downsampler for 4 channels at a time
+struct Oversampler {
+    int factor = 1;
+    const float *kernel = OversampleKernels::get(1);
+    float_4 upBuffer[2 * OVERSAMPLE_TAPS];
+    float_4 downBuffer[2 * MAX_OVERSAMPLE * OVERSAMPLE_TAPS];
+    int upPos = 0;
+    int downPos = 0;
+
+    void setFactor(int f) {
+        factor = f;
+        kernel = OversampleKernels::get(f);
+        reset();
+    }
+
+    void reset() {
+        for (int i = 0; i < 2 * OVERSAMPLE_TAPS; i++)
+            upBuffer[i] = 0.f;
+        for (int i = 0; i < 2 * MAX_OVERSAMPLE * OVERSAMPLE_TAPS; i++)
+            downBuffer[i] = 0.f;
+        upPos = 0;
+        downPos = 0;
+    }
+
+    // only the taps of each polyphase branch that land on real input samples get computed
+    void upsample(float_4 in, float_4 *out) {
+        upPos = (upPos + OVERSAMPLE_TAPS - 1) % OVERSAMPLE_TAPS;
+        upBuffer[upPos] = upBuffer[upPos + OVERSAMPLE_TAPS] = in;
+        for (int i = 0; i < factor; i++) {
+            float_4 y = 0.f;
+            for (int j = 0; j < OVERSAMPLE_TAPS; j++) {
+                y += kernel[i + j * factor] * upBuffer[upPos + j];
+            }
+            out[i] = y * factor;
+        }
+    }
+
+    // filter is only evaluated once per output sample
+    float_4 downsample(const float_4 *in) {
+        int len = factor * OVERSAMPLE_TAPS;
+        for (int i = 0; i < factor; i++) {
+            downBuffer[downPos] = downBuffer[downPos + len] = in[i];
+            downPos = (downPos + 1) % len;
+        }
+        float_4 y = 0.f;
+        for (int i = 0; i < len; i++) {
+            y += kernel[i] * downBuffer[downPos + i];
+        }
+        return y;
+    }
+};
+
 struct QubitCrusher : Module {
     enum ParamIds {
         BITS_PARAM,
@@ -24,11 +116,25 @@ struct QubitCrusher : Module {
 		NUM_LIGHTS
 	};
 
-    dsp::BiquadFilter hip;
-    float out = 0.0;
-    float bitRate = 8.0;
-    float sampHold = 0.0;
-    float sr = 1.0;
+    // per channel state, 4 channels per SIMD lane group
+    float_4 bits[4];
+    float_4 rate[4];
+    float_4 phase[4];
+    float_4 held[4] = {};
+    float pow2Table[17];
+
+    // quality mode: crush at 2x/4x/8x and band-limit the hold steps with minBLEPs
+    int oversampleIndex = 0;
+    int oversampleFactor = 1;
+    Oversampler oversamplers[4];
+    dsp::MinBlepGenerator<16, 16, float_4> minBleps[4];
+
+    enum PerfPhases {
+        CRUSH_PHASE,
+        OVERSAMPLED_PHASE,
+        NUM_PERF_PHASES
+    };
+    Profiler<NUM_PERF_PHASES> profiler{"Crush", "Oversampled crush"};
 
     QubitCrusher() {
         config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
@@ -47,6 +153,105 @@ struct QubitCrusher : Module {
         configOutput(MAIN_OUTPUT, "Audio");
 
         configBypass(MAIN_INPUT, MAIN_OUTPUT);
+
+        setOversampleFactor(1);
+
+        for (int i = 0; i <= 16; i++) {
+            pow2Table[i] = std::pow(2, i);
+        }
+        for (int b = 0; b < 4; b++) {
+            bits[b] = 8.0;
+            rate[b] = 1.0;
+            phase[b] = 1.0; // first sample gets held right away
+        }
+    }
+
+    // number of quantization steps for a (fractional) bit depth between 1 and 16,
+    // in between whole bits it's a straight line from 2^n to 2^(n+1)
+    float_4 getLevels(float_4 numBits) {
+        float_4 whole = simd::floor(numBits);
+        float_4 pow2;
+        for (int i = 0; i < 4; i++) {
+            pow2[i] = pow2Table[(int)whole[i]];
+        }
+        return pow2 * (1.f + numBits - whole) - 1.f;
+    }
+
+    float_4 getNumBits(int c, float bitModParam) {
+        float_4 numBits = bits[c / 4];
+        if (inputs[BITS_MOD_INPUT].isConnected()) {
+            numBits += bitModParam * inputs[BITS_MOD_INPUT].getPolyVoltageSimd<float_4>(c);
+        }
+        return simd::clamp(numBits, 1.f, 16.f);
+    }
+
+    float_4 getRate(int c, float sampModParam) {
+        float_4 sr = rate[c / 4];
+        if (inputs[SAMP_HOLD_MOD_INPUT].isConnected()) {
+            sr = simd::clamp(sr + sampModParam * inputs[SAMP_HOLD_MOD_INPUT].getPolyVoltageSimd<float_4>(c), 0.01f, 1.f);
+        }
+        return sr;
+    }
+
+    float_4 crush(float_4 in, float_4 levels) {
+        in = in * 0.1f + 0.5f;
+        float_4 out = simd::round(in * levels) / levels;
+        return out * 10.f - 5.f; // scale it back up
+    }
+
+    void setOversampleFactor(int factor) {
+        oversampleFactor = factor;
+        for (int b = 0; b < 4; b++) {
+            oversamplers[b].setFactor(factor);
+            // steps left over from the old factor would play at the wrong speed
+            for (float_4 &x : minBleps[b].buf) x = 0.f;
+            minBleps[b].pos = 0;
+        }
+    }
+
+    float_4 processOversampled(int c, float bitModParam, float sampModParam) {
+        int b = c / 4;
+        float_4 levels = getLevels(getNumBits(c, bitModParam));
+        float_4 sr = getRate(c, sampModParam) / oversampleFactor;
+
+        float_4 buffer[MAX_OVERSAMPLE];
+        oversamplers[b].upsample(inputs[MAIN_INPUT].getVoltageSimd<float_4>(c), buffer);
+
+        for (int i = 0; i < oversampleFactor; i++) {
+            phase[b] += sr;
+            float_4 hold = phase[b] >= 1.f;
+            int holdMask = simd::movemask(hold);
+            if (holdMask) {
+                phase[b] = simd::ifelse(hold, phase[b] - 1.f, phase[b]);
+                float_4 out = crush(buffer[i], levels);
+
+                // the step really happened somewhere inside this sample
+                for (int j = 0; j < 4; j++) {
+                    if (!(holdMask & (1 << j))) continue;
+                    float p = -std::min(phase[b][j] / sr[j], 0.999f);
+                    float_4 step = 0.f;
+                    step[j] = out[j] - held[b][j];
+                    minBleps[b].insertDiscontinuity(p, step);
+                }
+                held[b] = simd::ifelse(hold, out, held[b]);
+            }
+            buffer[i] = held[b] + minBleps[b].process();
+        }
+
+        return oversamplers[b].downsample(buffer);
+    }
+
+    json_t *dataToJson() override {
+        json_t *rootJ = json_object();
+        json_object_set_new(rootJ, "oversample", json_integer(oversampleIndex));
+        setProfilerJson(rootJ, profiler);
+
+        return rootJ;
+    }
+
+    void dataFromJson(json_t *rootJ) override {
+        json_t *oversampleJ = json_object_get(rootJ, "oversample");
+        if (oversampleJ) oversampleIndex = clamp((int)json_integer_value(oversampleJ), 0, 3);
     }
 
     void process(const ProcessArgs &args) override {
@@ -55,62 +260,62 @@ struct QubitCrusher : Module {
         }
 
         int channels = std::max(inputs[MAIN_INPUT].getChannels(), 1);
-        if (inputs[RAND_BITS_INPUT].isConnected()) {
-            if (inputs[RAND_BITS_INPUT].getVoltage()) bitRate = randRange(1, 8);
-        } else {
-            bitRate = params[BITS_PARAM].getValue();
-        }
 
-        if (inputs[RAND_SAMP_INPUT].isConnected()) {
-            if (inputs[RAND_SAMP_INPUT].getVoltage()) sr = randRange(0.01, 0.5);
-        } else {
-            sr = params[SAMP_HOLD_PARAM].getValue();
+        int factor = 1 << oversampleIndex;
+        if (factor != oversampleFactor) {
+            setOversampleFactor(factor);
         }
 
         // TODO: which one of these?
         // float bitModParam = dsp::quadraticBipolar(params[BITS_MOD_PARAM].getValue());
         float bitModParam = params[BITS_MOD_PARAM].getValue();
         float sampModParam = params[SAMP_HOLD_MOD_PARAM].getValue();
-        // float sampH = params[SAMP_HOLD_PARAM].getValue();
-
-        if (sampHold >= 1.0) {
-            sampHold = 0.0;
-        }
+        bool randBits = inputs[RAND_BITS_INPUT].isConnected();
+        bool randSamp = inputs[RAND_SAMP_INPUT].isConnected();
 
-        for (int c = 0; c < channels; c++) {
+        for (int c = 0; c < channels; c += 4) {
+            int b = c / 4;
 
-            if (sampHold == 0) {
-                if (inputs[BITS_MOD_INPUT].isConnected()) {
-                    bitRate += bitModParam * inputs[BITS_MOD_INPUT].getVoltage(c);
-                    bitRate = clamp(bitRate, 1.0, 16.0);
-                }
-                if (inputs[SAMP_HOLD_MOD_INPUT].isConnected()) {
-                    sr += sampModParam * inputs[SAMP_HOLD_MOD_INPUT].getVoltage(c);
-                    sr = clamp(sr, 0.01, 1.0);
+            // while a random gate is high that channel keeps getting new values
+            if (randBits) {
+                float_4 gate = inputs[RAND_BITS_INPUT].getPolyVoltageSimd<float_4>(c) != 0.f;
+                if (simd::movemask(gate)) {
+                    float_4 r = float_4(randRange(1.f, 8.f), randRange(1.f, 8.f), randRange(1.f, 8.f), randRange(1.f, 8.f));
+                    bits[b] = simd::ifelse(gate, r, bits[b]);
                 }
-                float in = inputs[MAIN_INPUT].getVoltage(c);
-                float numBits = std::pow(2, bitRate) - 1;
-                in = in * 0.1 + 0.5;
-                out = round(in * numBits) / numBits;
-                out = out * 10 - 5; // scale it back up
+            } else {
+                bits[b] = params[BITS_PARAM].getValue();
             }
 
+            if (randSamp) {
+                float_4 gate = inputs[RAND_SAMP_INPUT].getPolyVoltageSimd<float_4>(c) != 0.f;
+                if (simd::movemask(gate)) {
+                    float_4 r = float_4(randRange(0.01f, 0.5f), randRange(0.01f, 0.5f), randRange(0.01f, 0.5f), randRange(0.01f, 0.5f));
+                    rate[b] = simd::ifelse(gate, r, rate[b]);
+                }
+            } else {
+                rate[b] = params[SAMP_HOLD_PARAM].getValue();
+            }
 
-            // in = rescale(in, -5.0, 5.0, 0.0, 1.0);
-            // float scl = std::pow(2, bitRate); // subtract 1?
-            // in = static_cast<int>(in * scl);
-            // in /= scl;
-            // in = rescale(in, 0.0, 1.0, -5.0, 5.0);
+            if (oversampleFactor > 1) {
+                PROFILE_SCOPE(profiler, OVERSAMPLED_PHASE);
+                outputs[MAIN_OUTPUT].setVoltageSimd(processOversampled(c, bitModParam, sampModParam), c);
+                continue;
+            }
 
-            // add DC offset
-            // hip.setParameters(dsp::BiquadFilter::HIGHPASS_1POLE, 5.0 / args.sampleRate, 0.0, 0.0);
-            // out = hip.process(out);
+            PROFILE_SCOPE(profiler, CRUSH_PHASE);
+            float_4 hold = phase[b] >= 1.f;
+            if (simd::movemask(hold)) {
+                float_4 levels = getLevels(getNumBits(c, bitModParam));
+                float_4 out = crush(inputs[MAIN_INPUT].getVoltageSimd<float_4>(c), levels);
+                held[b] = simd::ifelse(hold, out, held[b]);
+                phase[b] = simd::ifelse(hold, phase[b] - 1.f, phase[b]);
+            }
+            phase[b] += getRate(c, sampModParam);
 
-            outputs[MAIN_OUTPUT].setVoltage(out, c);
+            outputs[MAIN_OUTPUT].setVoltageSimd(held[b], c);
         }
         outputs[MAIN_OUTPUT].setChannels(channels);
-
-        sampHold += sr;
     }
 };
 
@@ -139,6 +344,15 @@ struct QubitCrusherWidget : ModuleWidget {
         // outputs
         addOutput(createOutputCentered<PJ301MPort>(Vec(22.5, 322.1), module, QubitCrusher::MAIN_OUTPUT));
     }
+
+    void appendContextMenu(Menu *menu) override {
+        QubitCrusher *module = dynamic_cast<QubitCrusher*>(this->module);
+        menu->addChild(new MenuEntry);
+
+        menu->addChild(createIndexPtrSubmenuItem("Oversampling", {"Off", "2x", "4x", "8x"}, &module->oversampleIndex));
+
+        module->profiler.appendMenu(menu);
+    }
 };
 
 Model *modelQubitCrusher = createModel<QubitCrusher, QubitCrusherWidget>("QubitCrusher");
\ No newline at end of file
@@ -11,7 +11,8 @@ struct RandGates : Module {
 	enum InputIds {
         TRIGGER_INPUT,
         GATES_INPUT = TRIGGER_INPUT + NUM_OF_INPUTS,
-		NUM_INPUTS = GATES_INPUT + NUM_OF_INPUTS
+        WEIGHTS_INPUT = GATES_INPUT + NUM_OF_INPUTS,
+		NUM_INPUTS
 	};
 	enum OutputIds {
         GATE_OUTPUT,
@@ -28,7 +29,19 @@ struct RandGates : Module {
     dsp::SchmittTrigger polyTrig[16];
     dsp::SchmittTrigger monoTrig;
     int currentGate[16];
-    float weightProb = 0.5;
+    WeightedChoice<NUM_OF_INPUTS> choice;
+    FastRandom rng;
+    uint64_t seed = random::u64();
+    bool fixedSeed = false;
+    bool weightsStale = true; // the weights are only worked out when something gets picked
+
+    // the weights are rebuilt inside routing, so their time is counted in both
+    enum PerfPhases {
+        ROUTING_PHASE,
+        WEIGHTS_PHASE,
+        NUM_PERF_PHASES
+    };
+    Profiler<NUM_PERF_PHASES> profiler{"Routing", "Weights"};
 
     RandGates() {
         config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
@@ -40,44 +53,68 @@ struct RandGates : Module {
         configInput(GATES_INPUT + 1, "Blue");
         configInput(GATES_INPUT + 2, "Aqua");
         configInput(GATES_INPUT + 3, "Red");
+        configInput(WEIGHTS_INPUT, "Input weights (poly, 1 channel per input)");
 
         configOutput(GATE_OUTPUT, "Main");
 
         configLight(PURPLE_LIGHT, "Output indicator");
 
+        rng.seed(seed);
         for (int i = 0; i < 16; i++) {
             setCurrentGate(i);
         }
     }
 
-    void setCurrentGate(int channel) {
-        int weight = (int)params[WEIGHTING_PARAM].getValue();
-        weightProb = params[PERCENTAGE_PARAM].getValue();
-        if (weight < 4) {
-            if (random::uniform() < weightProb) {
-                currentGate[channel] = weight;
-            } else {
-                int r = static_cast<int>(random::uniform() * 4);
-                while (r == weight) {
-                    r = static_cast<int>(random::uniform() * 4);
-                }
-                currentGate[channel] = r;
-            }
+    json_t *dataToJson() override {
+        json_t *rootJ = json_object();
+        if (fixedSeed)
+            json_object_set_new(rootJ, "seed", json_integer((json_int_t)seed));
+        setProfilerJson(rootJ, profiler);
+        return rootJ;
+    }
+
+    void dataFromJson(json_t *rootJ) override {
+        json_t *seedJ = json_object_get(rootJ, "seed");
+        if (seedJ) {
+            fixedSeed = true;
+            seed = (uint64_t)json_integer_value(seedJ);
+            rng.seed(seed);
         } else {
-            currentGate[channel] = static_cast<int>(random::uniform() * NUM_OF_INPUTS);
+            fixedSeed = false;
+            seed = random::u64();
+            rng.seed(seed);
+        }
+    }
+
+    void updateWeights() {
+        PROFILE_SCOPE(profiler, WEIGHTS_PHASE);
+        int weight = (int)params[WEIGHTING_PARAM].getValue();
+        float weightProb = params[PERCENTAGE_PARAM].getValue();
+        float w[NUM_OF_INPUTS];
+        for (int i = 0; i < NUM_OF_INPUTS; i++) {
+            if (weight < 4)
+                w[i] = (i == weight) ? weightProb : (1.0 - weightProb) / (NUM_OF_INPUTS - 1);
+            else
+                w[i] = 1.0;
+
+            // channel i of the weights input scales the chances of input i
+            if (inputs[WEIGHTS_INPUT].isConnected())
+                w[i] *= clamp(inputs[WEIGHTS_INPUT].getPolyVoltage(i) / 10.f, 0.f, 1.f);
         }
+        choice.setWeights(w);
+    }
 
-        /******* OLD *******/
-        // if (params[WEIGHTING_PARAM].getValue() < 4) {
-        //     int weight = (int)params[WEIGHTING_PARAM].getValue();
-        //     int r = static_cast<int>(random::uniform() * (NUM_OF_INPUTS+1));
-        //     currentGate = (r > 3) ? weight : r; // 40% chance of weighted choice
-        // } else {
-        //     currentGate = static_cast<int>(random::uniform() * NUM_OF_INPUTS);
-        // }
+    void setCurrentGate(int channel) {
+        if (weightsStale) {
+            updateWeights();
+            weightsStale = false;
+        }
+        currentGate[channel] = choice.choose(rng.uniform());
     }
 
     void process(const ProcessArgs &args) override {
+        PROFILE_SCOPE(profiler, ROUTING_PHASE);
+        weightsStale = true;
 
         // get number of channels first
         int channels = 1;
@@ -125,6 +162,7 @@ struct RandGatesWidget : ModuleWidget {
         addInput(createInputCentered<PJ301MPort>(Vec(22.5, 79.4), module, RandGates::TRIGGER_INPUT));
         addParam(createParamCentered<BlueInvertKnob>(Vec(22.5, 281.6), module, RandGates::WEIGHTING_PARAM));
         addParam(createParamCentered<NanoBlueKnob>(Vec(34, 265.2), module, RandGates::PERCENTAGE_PARAM));
+        addInput(createInputCentered<TinyPJ301M>(Vec(11, 265.2), module, RandGates::WEIGHTS_INPUT));
 
         for (int i = 0; i < NUM_OF_INPUTS; i++) {
             addInput(createInputCentered<PJ301MPort>(Vec(22.5, 119.8 + (i * 40.5)), module, RandGates::GATES_INPUT+i));
@@ -138,6 +176,15 @@ struct RandGatesWidget : ModuleWidget {
         addChild(createLight<SmallLight<JeremyAquaLight>>(Vec(22.5 - 3.21, 340.9 - 3.21), module, RandGates::AQUA_LIGHT));
         addChild(createLight<SmallLight<JeremyRedLight>>(Vec(22.5 - 3.21, 340.9 - 3.21), module, RandGates::RED_LIGHT));
     }
+
+    void appendContextMenu(Menu *menu) override {
+        RandGates *module = dynamic_cast<RandGates*>(this->module);
+        menu->addChild(new MenuEntry);
+
+        menu->addChild(createBoolPtrMenuItem("Fixed random seed", "", &module->fixedSeed));
+
+        module->profiler.appendMenu(menu);
+    }
 };
 
 Model *modelRandGates = createModel<RandGates, RandGatesWidget>("RandGates");
@@ -11,6 +11,7 @@ struct RandRoute : Module {
 	enum InputIds {
         TRIGGER_INPUT,
         GATE_INPUT,
+        WEIGHTS_INPUT,
 		NUM_INPUTS
 	};
 	enum OutputIds {
@@ -28,10 +29,22 @@ struct RandRoute : Module {
     dsp::SchmittTrigger mainTrig;
     dsp::BooleanTrigger gateTriggers[16];
     int currentGate[16];
-    float weightProb = 0.5;
+    WeightedChoice<NUM_OF_OUTPUTS> choice;
+    FastRandom rng;
+    uint64_t seed = random::u64();
+    bool fixedSeed = false;
+    bool weightsStale = true; // the weights are only worked out when something gets picked
     bool outcomes[NUM_OF_OUTPUTS][16] = {};
     bool toggle = false;
 
+    // the weights are rebuilt inside routing, so their time is counted in both
+    enum PerfPhases {
+        ROUTING_PHASE,
+        WEIGHTS_PHASE,
+        NUM_PERF_PHASES
+    };
+    Profiler<NUM_PERF_PHASES> profiler{"Routing", "Weights"};
+
     RandRoute() {
         config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
         configSwitch(WEIGHTING_PARAM, 0.0, 4.0, 4.0, "Weight", {"Purple", "Blue", "Aqua", "Red", "Uniform"});
@@ -39,6 +52,7 @@ struct RandRoute : Module {
 
         configInput(TRIGGER_INPUT, "Trigger");
         configInput(GATE_INPUT, "Main");
+        configInput(WEIGHTS_INPUT, "Output weights (poly, 1 channel per output)");
 
         configOutput(GATES_OUTPUT, "Purple");
         configOutput(GATES_OUTPUT + 1, "Blue");
@@ -47,30 +61,42 @@ struct RandRoute : Module {
 
         configLight(PURPLE_LIGHT, "Output indicator");
 
+        rng.seed(seed);
         for (int i = 0; i < 16; i++) {
             setCurrentGate(i);
         }
     }
 
-    void setCurrentGate(int channel) {
+    void updateWeights() {
+        PROFILE_SCOPE(profiler, WEIGHTS_PHASE);
         int weight = (int)params[WEIGHTING_PARAM].getValue();
-        weightProb = params[PERCENTAGE_PARAM].getValue();
-        if (weight < 4) {
-            if (random::uniform() < weightProb) {
-                currentGate[channel] = weight;
-            } else {
-                int r = static_cast<int>(floor(random::uniform() * 4));
-                while (r == weight) {
-                    r = static_cast<int>(floor(random::uniform() * 4));
-                }
-                currentGate[channel] = r;
-            }
-        } else {
-            currentGate[channel] = static_cast<int>(floor(random::uniform() * NUM_OF_OUTPUTS));
+        float weightProb = params[PERCENTAGE_PARAM].getValue();
+        float w[NUM_OF_OUTPUTS];
+        for (int i = 0; i < NUM_OF_OUTPUTS; i++) {
+            if (weight < 4)
+                w[i] = (i == weight) ? weightProb : (1.0 - weightProb) / (NUM_OF_OUTPUTS - 1);
+            else
+                w[i] = 1.0;
+
+            // channel i of the weights input scales the chances of output i
+            if (inputs[WEIGHTS_INPUT].isConnected())
+                w[i] *= clamp(inputs[WEIGHTS_INPUT].getPolyVoltage(i) / 10.f, 0.f, 1.f);
+        }
+        choice.setWeights(w);
+    }
+
+    void setCurrentGate(int channel) {
+        if (weightsStale) {
+            updateWeights();
+            weightsStale = false;
         }
+        currentGate[channel] = choice.choose(rng.uniform());
     }
 
     void process(const ProcessArgs &args) override {
+        PROFILE_SCOPE(profiler, ROUTING_PHASE);
+        weightsStale = true;
+
         int channels = std::max(inputs[GATE_INPUT].getChannels(), 1);
         if (inputs[TRIGGER_INPUT].isConnected()) {
             if (mainTrig.process(inputs[TRIGGER_INPUT].getVoltage())) {
@@ -119,12 +145,26 @@ struct RandRoute : Module {
     json_t* dataToJson() override {
 		json_t* rootJ = json_object();
         json_object_set_new(rootJ, "mode", json_boolean(toggle));
+        if (fixedSeed)
+            json_object_set_new(rootJ, "seed", json_integer((json_int_t)seed));
+        setProfilerJson(rootJ, profiler);
 		return rootJ;
 	}
 
 	void dataFromJson(json_t* rootJ) override {
         json_t *modeJ = json_object_get(rootJ, "mode");
         if (modeJ) toggle = json_boolean_value(modeJ);
+
+        json_t *seedJ = json_object_get(rootJ, "seed");
+        if (seedJ) {
+            fixedSeed = true;
+            seed = (uint64_t)json_integer_value(seedJ);
+            rng.seed(seed);
+        } else {
+            fixedSeed = false;
+            seed = random::u64();
+            rng.seed(seed);
+        }
 	}
 };
 
@@ -140,6 +180,7 @@ struct RandRouteWidget : ModuleWidget {
         addInput(createInputCentered<PJ301MPort>(Vec(22.5, 79.4), module, RandRoute::TRIGGER_INPUT));
         addParam(createParamCentered<BlueInvertKnob>(Vec(22.5, 156.1), module, RandRoute::WEIGHTING_PARAM));
         addParam(createParamCentered<NanoBlueKnob>(Vec(34, 139.7), module, RandRoute::PERCENTAGE_PARAM));
+        addInput(createInputCentered<TinyPJ301M>(Vec(11, 139.7), module, RandRoute::WEIGHTS_INPUT));
 
         for (int i = 0; i < NUM_OF_OUTPUTS; i++) {
             addOutput(createOutputCentered<PJ301MPort>(Vec(22.5, 200.7 + (i * 40.5)), module, RandRoute::GATES_OUTPUT+i));
@@ -161,6 +202,10 @@ struct RandRouteWidget : ModuleWidget {
 		menu->addChild(createIndexPtrSubmenuItem("Mode", 
             {"Latch", "Toggle"}, 
             &module->toggle));
+
+		menu->addChild(createBoolPtrMenuItem("Fixed random seed", "", &module->fixedSeed));
+
+		module->profiler.appendMenu(menu);
 	}
 };
 
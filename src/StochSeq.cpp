@@ -1,17 +1,20 @@
 #include "plugin.hpp"
 
+using simd::float_4;
+
 #define SLIDER_WIDTH 15
 #define SLIDER_TOP 4
 #define NUM_OF_SLIDERS 32
 #define NUM_OF_LIGHTS 32
 #define NUM_OF_MEM_BANK 12
+#define MORPH_HYSTERESIS 0.001 // in banks
 
 // TODO: docs!!!!
 
 struct MemoryBank {
 	bool isOn;
 	int length;
-	float *gateProbabilities = new float[NUM_OF_SLIDERS];
+	float gateProbabilities[NUM_OF_SLIDERS];
 
 	MemoryBank() {
 		isOn = false;
@@ -22,10 +25,6 @@ struct MemoryBank {
 		}
 	}
 
-	~MemoryBank() {
-		delete[] gateProbabilities;
-	}
-
 	void setGates(float *probs) {
 		for (int i = 0; i < length; i++) {
 			probs[i] = gateProbabilities[i];
@@ -35,8 +34,6 @@ struct MemoryBank {
 	void setProbabilities(const float *probs, int size) {
 		isOn = true;
 		length = size;
-		DEBUG("size: %d", size);
-		DEBUG("length: %d", length);
 
 		for (int i = 0; i < length; i++) {
 			gateProbabilities[i] = probs[i];
@@ -51,7 +48,37 @@ struct MemoryBank {
 	}
 };
 
+// what the displays draw, published by process() at UI rate
+struct StochSeqView {
+	float gateProbabilities[NUM_OF_SLIDERS];
+	bool upcoming[NUM_OF_SLIDERS]; // steps that will play in the next cycle
+	MemoryBank memBanks[NUM_OF_MEM_BANK];
+	int length = NUM_OF_SLIDERS;
+	int gateIndex = -1;
+	int currentMemBank = 0;
+	bool resetMode = false;
+};
+
+// edits from the GUI, applied at the start of process()
+struct StochSeqCommand {
+	int type;
+	int index;
+	float value;
+};
+
 struct StochSeq : Module, Quantize {
+	enum CommandIds {
+		SET_PROBABILITY,
+		TOGGLE_PROBABILITY,
+		RECALL_BANK,
+		REVERSE_PATTERN,
+		AUGMENT_PATTERN,
+		ROTATE_PATTERN,
+		SHIFT_PATTERN,
+		SCALE_PATTERN,
+		THRESHOLD_PATTERN,
+		NUM_COMMANDS
+	};
 	enum ModeIds {
 		GATE_MODE,
 		TRIG_MODE,
@@ -101,6 +128,11 @@ struct StochSeq : Module, Quantize {
 	dsp::SchmittTrigger invertTrig;
 	dsp::PulseGenerator gatePulse;
 	dsp::PulseGenerator notGatePulse;
+	LightDivider lightDivider;
+	Lookahead lookahead;
+	FastRandom patternRandom; // the RND button & random pattern
+	uint64_t seed = random::u64();
+	bool fixedSeed = false; // saved with the patch so it plays the same every time
 	int gateMode = GATE_MODE;
 	int voltMode = VOLT_INDEPENDENT_MODE;
 	int voltRange = 1;
@@ -113,14 +145,30 @@ struct StochSeq : Module, Quantize {
 	bool resetMode = false;
 	bool lightBlink = false;
 	bool showPercentages = true;
+	bool showUpcoming = false;
 	int randLight;
 	float pitchVoltage = 0.0;
 	float invPitchVoltage = 0.0;
-	float *gateProbabilities = new float[NUM_OF_SLIDERS];
+	float gateProbabilities[NUM_OF_SLIDERS];
 	MemoryBank memBanks[NUM_OF_MEM_BANK];
 	int currentMemBank = 0;
+	bool morphBanks = false;
+	float morphPos = -1.0;
 	bool enableKBShortcuts = true;
 	bool isCtrlClick = false;
+	TripleBuffer<StochSeqView> view;
+	CommandQueue<StochSeqCommand, 64> commands;
+
+	enum PerfPhases {
+		COMMANDS_PHASE,
+		MORPH_PHASE,
+		PATTERNS_PHASE,
+		CLOCK_PHASE,
+		OUTPUTS_PHASE,
+		VIEW_PHASE,
+		NUM_PERF_PHASES
+	};
+	Profiler<NUM_PERF_PHASES> profiler{"GUI commands", "Bank morphing", "Pattern generation", "Clock step", "Outputs", "Display snapshot"};
 
 	StochSeq() {
 		config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
@@ -154,10 +202,13 @@ struct StochSeq : Module, Quantize {
 		memBanks[currentMemBank].setProbabilities(gateProbabilities, seqLength);
 
 		randLight = static_cast<int>(random::uniform() * NUM_OF_LIGHTS);
+		reseed();
 	}
 
-	~StochSeq() {
-		delete[] gateProbabilities;
+	// everything that can change the outputs comes from the one seed
+	void reseed() {
+		lookahead.seed(seed);
+		patternRandom.seed(seed + 1);
 	}
 
 	json_t *dataToJson() override {
@@ -173,38 +224,38 @@ struct StochSeq : Module, Quantize {
 			json_array_append_new(lengthsJ, lengthJ);
 			json_t *isOnJ = json_boolean(memBanks[i].isOn);
 			json_array_append_new(onJ, isOnJ);
-
-            json_t *probsJ = json_array();
-            for (int j = 0; j < NUM_OF_SLIDERS; j++) {
-                json_t *probJ = json_real(memBanks[i].gateProbabilities[j]);
-                json_array_append_new(probsJ, probJ);
-            }
-            json_array_append_new(memBankProbsJ, probsJ);
+			json_array_append_new(memBankProbsJ, packProbabilities(memBanks[i].gateProbabilities, NUM_OF_SLIDERS));
         }
 
-		json_t *probsJ = json_array();
-		for (int i = 0; i < NUM_OF_SLIDERS; i++) {
-			json_t *probJ = json_real(gateProbabilities[i]);
-			json_array_append_new(probsJ, probJ);
-		}
-		json_object_set_new(rootJ, "probs", probsJ);
+		setDataVersion(rootJ);
+		json_object_set_new(rootJ, "probs", packProbabilities(gateProbabilities, NUM_OF_SLIDERS));
 		json_object_set_new(rootJ, "memBankProbs", memBankProbsJ);
 		json_object_set_new(rootJ, "isOn", onJ);
 		json_object_set_new(rootJ, "lengths", lengthsJ);
 		json_object_set_new(rootJ, "currentMemBank", json_integer(currentMemBank));
+		json_object_set_new(rootJ, "morphBanks", json_boolean(morphBanks));
+		if (fixedSeed)
+			json_object_set_new(rootJ, "seed", json_integer((json_int_t)seed));
 		json_object_set_new(rootJ, "percentages", json_boolean(showPercentages));
+		json_object_set_new(rootJ, "upcoming", json_boolean(showUpcoming));
 		json_object_set_new(rootJ, "kbshortcuts", json_boolean(enableKBShortcuts));
 		json_object_set_new(rootJ, "gateMode", json_integer(gateMode));
 		json_object_set_new(rootJ, "voltMode", json_integer(voltMode));
 		json_object_set_new(rootJ, "voltRange", json_integer(voltRange));
+		setProfilerJson(rootJ, profiler);
 
 		return rootJ;
 	}
 
 	void dataFromJson(json_t *rootJ) override {
+		int version = getDataVersion(rootJ);
+
         json_t *percentagesJ = json_object_get(rootJ, "percentages");
         if (percentagesJ) showPercentages = json_boolean_value(percentagesJ);
 
+		json_t *upcomingJ = json_object_get(rootJ, "upcoming");
+		if (upcomingJ) showUpcoming = json_boolean_value(upcomingJ);
+
 		json_t *kbshortcutsJ = json_object_get(rootJ, "kbshortcuts");
 		if (kbshortcutsJ) enableKBShortcuts = json_boolean_value(kbshortcutsJ);
 
@@ -223,8 +274,24 @@ struct StochSeq : Module, Quantize {
 		json_t *currentBankJ = json_object_get(rootJ, "currentMemBank");
 		if (currentBankJ) currentMemBank = json_integer_value(currentBankJ);
 
+		json_t *morphBanksJ = json_object_get(rootJ, "morphBanks");
+		if (morphBanksJ) morphBanks = json_boolean_value(morphBanksJ);
+
+		json_t *seedJ = json_object_get(rootJ, "seed");
+		if (seedJ) {
+			fixedSeed = true;
+			seed = (uint64_t)json_integer_value(seedJ);
+			reseed();
+		} else {
+			fixedSeed = false;
+			seed = random::u64();
+			reseed();
+		}
+
 		json_t *probsJ = json_object_get(rootJ, "probs");
-		if (probsJ) {
+		if (version >= 2) {
+			unpackProbabilities(probsJ, gateProbabilities, NUM_OF_SLIDERS);
+		} else if (probsJ) {
 			for (int i = 0; i < NUM_OF_SLIDERS; i++) {
 				json_t *probJ = json_array_get(probsJ, i);
 				if (probJ)
@@ -246,7 +313,9 @@ struct StochSeq : Module, Quantize {
 					memBanks[i].length = json_integer_value(lengthJ);
 
 				json_t *probsJ = json_array_get(memBankProbsJ, i);
-				if (probsJ) {
+				if (version >= 2) {
+					unpackProbabilities(probsJ, memBanks[i].gateProbabilities, NUM_OF_SLIDERS);
+				} else if (probsJ) {
                     for (int j = 0; j < NUM_OF_SLIDERS; j++) {
                         json_t *probJ = json_array_get(probsJ, j);
                         if (probJ) {
@@ -259,6 +328,20 @@ struct StochSeq : Module, Quantize {
 	}
 
 	void process(const ProcessArgs& args) override {
+		{
+			PROFILE_SCOPE(profiler, COMMANDS_PHASE);
+			StochSeqCommand command;
+			while (commands.pop(command)) {
+				applyCommand(command);
+			}
+		}
+		// the current bank follows the length knob
+		int length = (int)params[LENGTH_PARAM].getValue();
+		if (memBanks[currentMemBank].length != length) {
+			startEdit();
+			finishEdit(length);
+		}
+
 		if (resetTrig.process(params[RESET_PARAM].getValue() + inputs[RESET_INPUT].getVoltage())) {
 			resetMode = true;
 		}
@@ -266,12 +349,19 @@ struct StochSeq : Module, Quantize {
 			float cv = inputs[MEM_BANK_INPUT].getVoltage();
 			float whole = floor(cv);
 			float cvDecimal = cv - whole;
-			int bankId = (int)rescale(cvDecimal, 0.0, 1.0, 0.0, 12.0);
-			if (bankId != currentMemBank) {
-				params[LENGTH_PARAM].setValue(memBanks[bankId].length);
-				memBanks[bankId].setGates(gateProbabilities);
-				currentMemBank = bankId;
+			if (morphBanks) {
+				morph(rescale(cvDecimal, 0.0, 1.0, 0.0, 12.0));
+			} else {
+				int bankId = (int)rescale(cvDecimal, 0.0, 1.0, 0.0, 12.0);
+				if (bankId != currentMemBank) {
+					params[LENGTH_PARAM].setValue(memBanks[bankId].length);
+					memBanks[bankId].setGates(gateProbabilities);
+					currentMemBank = bankId;
+				}
+				morphPos = -1.0;
 			}
+		} else {
+			morphPos = -1.0;
 		}
 
 		if ((int)params[PATTERN_PARAM].getValue() != currentPattern) {
@@ -283,12 +373,14 @@ struct StochSeq : Module, Quantize {
 			genPatterns(100);
 		}
 		if (invertTrig.process(params[INVERT_PARAM].getValue() + inputs[INVERT_INPUT].getVoltage())) {
+			startEdit();
 			invert();
-			memBanks[currentMemBank].setProbabilities(gateProbabilities, seqLength);
+			finishEdit(seqLength);
 		}
 		if (dimTrig.process(params[DIMINUTION_PARAM].getValue() + inputs[DIMINUTION_INPUT].getVoltage())) {
+			startEdit();
 			diminish();
-			memBanks[currentMemBank].setProbabilities(gateProbabilities, seqLength);
+			finishEdit(seqLength);
 		}
 		if (clockTrig.process(inputs[CLOCK_INPUT].getVoltage())) {
 			if (resetMode) {
@@ -298,44 +390,177 @@ struct StochSeq : Module, Quantize {
 			clockStep();
 		}
 
-		bool gateVolt;
-		bool notGateVolt;
-		if (gateMode == GATE_MODE) {
-			gateVolt = gateOn;
-			notGateVolt = notGateOn;
-		} else {
-			gateVolt = gatePulse.process(1.0 / args.sampleRate);
-			notGateVolt = notGatePulse.process(1.0 / args.sampleRate);
-		}
-		// float blink = lightBlink ? 1.0 : 0.0;
-		outputs[GATES_OUTPUT + currentGateOut].setVoltage(gateVolt ? 10.0 : 0.0);
-		outputs[GATE_MAIN_OUTPUT].setVoltage(gateVolt ? 10.0 : 0.0);
-		outputs[NOT_GATE_MAIN_OUTPUT].setVoltage(notGateVolt ? 10.0 : 0.0);
-		if (voltMode == VOLT_SAMPHOLD_MODE && gateVolt) {
-			outputs[INV_VOLT_OUTPUT].setVoltage(invPitchVoltage);
-			outputs[VOLT_OUTPUT].setVoltage(pitchVoltage);
-		} else if (voltMode == VOLT_INDEPENDENT_MODE) {
-			outputs[INV_VOLT_OUTPUT].setVoltage(invPitchVoltage);
-			outputs[VOLT_OUTPUT].setVoltage(pitchVoltage);
-		}
-		// int randLight = int(random::uniform() * NUM_OF_LIGHTS);
-		for (int i = 0; i < NUM_OF_LIGHTS; i++) {
-			if (currentGateOut == i)
-				lights[LIGHTS + i].setSmoothBrightness((lightBlink ? 1.0 : 0.0), args.sampleTime * 30);
-			else
-				lights[LIGHTS + i].setBrightness(0.0);			
+		{
+			PROFILE_SCOPE(profiler, OUTPUTS_PHASE);
+			bool gateVolt;
+			bool notGateVolt;
+			if (gateMode == GATE_MODE) {
+				gateVolt = gateOn;
+				notGateVolt = notGateOn;
+			} else {
+				gateVolt = gatePulse.process(1.0 / args.sampleRate);
+				notGateVolt = notGatePulse.process(1.0 / args.sampleRate);
+			}
+			// float blink = lightBlink ? 1.0 : 0.0;
+			outputs[GATES_OUTPUT + currentGateOut].setVoltage(gateVolt ? 10.0 : 0.0);
+			outputs[GATE_MAIN_OUTPUT].setVoltage(gateVolt ? 10.0 : 0.0);
+			outputs[NOT_GATE_MAIN_OUTPUT].setVoltage(notGateVolt ? 10.0 : 0.0);
+			if (voltMode == VOLT_SAMPHOLD_MODE && gateVolt) {
+				outputs[INV_VOLT_OUTPUT].setVoltage(invPitchVoltage);
+				outputs[VOLT_OUTPUT].setVoltage(pitchVoltage);
+			} else if (voltMode == VOLT_INDEPENDENT_MODE) {
+				outputs[INV_VOLT_OUTPUT].setVoltage(invPitchVoltage);
+				outputs[VOLT_OUTPUT].setVoltage(pitchVoltage);
+			}
 		}
+		if (lightDivider.process(args.sampleRate)) {
+			float deltaTime = lightDivider.smoothTime(args.sampleTime * 30);
+			// int randLight = int(random::uniform() * NUM_OF_LIGHTS);
+			for (int i = 0; i < NUM_OF_LIGHTS; i++) {
+				if (currentGateOut == i)
+					lights[LIGHTS + i].setSmoothBrightness((lightBlink ? 1.0 : 0.0), deltaTime);
+				else
+					lights[LIGHTS + i].setBrightness(0.0);
+			}
 
-		int bangGate = currentGateOut % 4;
-		for (int i = 0; i < 4; i++) {
-			if (bangGate == i)
-				lights[BANG_LIGHTS + i].setSmoothBrightness((lightBlink ? 1.0 : 0.0), args.sampleTime * 30);
-			else
-				lights[BANG_LIGHTS + i].setBrightness(0.0);
+			int bangGate = currentGateOut % 4;
+			for (int i = 0; i < 4; i++) {
+				if (bangGate == i)
+					lights[BANG_LIGHTS + i].setSmoothBrightness((lightBlink ? 1.0 : 0.0), deltaTime);
+				else
+					lights[BANG_LIGHTS + i].setBrightness(0.0);
+			}
+
+			publishView();
+		}
+	}
+
+	void publishView() {
+		PROFILE_SCOPE(profiler, VIEW_PHASE);
+		StochSeqView &v = view.write();
+		int length = (int)params[LENGTH_PARAM].getValue();
+		int next = resetMode ? 0 : gateIndex + 1;
+		for (int i = 0; i < NUM_OF_SLIDERS; i++) {
+			v.gateProbabilities[i] = gateProbabilities[i];
+			v.upcoming[i] = false;
+		}
+		for (int k = 0; k < length; k++) {
+			int step = (next + k) % length;
+			v.upcoming[step] = lookahead.peek(k) < gateProbabilities[step];
+		}
+		for (int i = 0; i < NUM_OF_MEM_BANK; i++) {
+			v.memBanks[i] = memBanks[i];
+		}
+		v.length = length;
+		v.gateIndex = gateIndex;
+		v.currentMemBank = currentMemBank;
+		v.resetMode = resetMode;
+		view.publish();
+	}
+
+	// GUI thread only
+	void sendCommand(int type, int index = 0, float value = 0.0) {
+		commands.push({type, index, value});
+	}
+
+	void applyCommand(const StochSeqCommand &command) {
+		int length = (int)params[LENGTH_PARAM].getValue();
+		switch (command.type) {
+			case SET_PROBABILITY:
+				if (command.index < 0 || command.index >= NUM_OF_SLIDERS) break;
+				startEdit();
+				gateProbabilities[command.index] = command.value;
+				finishEdit(length);
+				break;
+			case TOGGLE_PROBABILITY:
+				if (command.index < 0 || command.index >= NUM_OF_SLIDERS) break;
+				startEdit();
+				gateProbabilities[command.index] = gateProbabilities[command.index] < 0.5 ? 1.0 : 0.0;
+				finishEdit(length);
+				break;
+			case RECALL_BANK:
+				if (command.index < 0 || command.index >= NUM_OF_MEM_BANK) break;
+				params[LENGTH_PARAM].setValue(memBanks[command.index].length);
+				memBanks[command.index].setGates(gateProbabilities);
+				currentMemBank = command.index;
+				break;
+			case REVERSE_PATTERN: reverse(); break;
+			case AUGMENT_PATTERN: augment(); break;
+			case ROTATE_PATTERN:
+				if (command.index < 0) shiftPatternLeft();
+				else shiftPatternRight();
+				break;
+			case SHIFT_PATTERN:
+				if (command.value < 0) shiftPatternDown();
+				else shiftPatternUp();
+				break;
+			case SCALE_PATTERN: scalePattern(command.value); break;
+			case THRESHOLD_PATTERN: thresholdPattern(); break;
+		}
+	}
+
+	// changes whenever the sliders have to be redrawn, GUI thread only
+	uint32_t getDisplayRevision() {
+		const StochSeqView &v = view.read();
+		uint32_t hash = hashState(v.gateProbabilities, sizeof(v.gateProbabilities));
+		hash = hashState(&v.length, sizeof(v.length), hash);
+		return hashState(&settings::preferDarkPanels, sizeof(bool), hash);
+	}
+
+	uint32_t getBankRevision(int bankId) {
+		const StochSeqView &v = view.read();
+		const MemoryBank &bank = v.memBanks[bankId];
+		bool flags[2] = {bank.isOn, bankId == v.currentMemBank};
+		uint32_t hash = hashState(bank.gateProbabilities, sizeof(bank.gateProbabilities));
+		hash = hashState(&bank.length, sizeof(bank.length), hash);
+		return hashState(flags, sizeof(flags), hash);
+	}
+
+	// while morphing the pattern is a blend of two banks, so an edit starts from
+	// the current bank's own pattern and gets blended again when it's done.
+	// that way the blend never gets saved over the bank
+	void startEdit() {
+		if (morphPos < 0.0) return;
+		const float *bank = memBanks[currentMemBank].gateProbabilities;
+		std::copy(bank, bank + NUM_OF_SLIDERS, gateProbabilities);
+	}
+
+	void finishEdit(int length) {
+		memBanks[currentMemBank].setProbabilities(gateProbabilities, length);
+		if (morphPos < 0.0) return;
+		float pos = morphPos;
+		morphPos = -1.0;
+		morph(pos);
+	}
+
+	// crossfades between a bank and the next one, only when the cv moved enough
+	void morph(float pos) {
+		PROFILE_SCOPE(profiler, MORPH_PHASE);
+		if (std::fabs(pos - morphPos) < MORPH_HYSTERESIS) return;
+		morphPos = pos;
+
+		int bankA = std::min((int)pos, NUM_OF_MEM_BANK - 1);
+		int bankB = (bankA + 1) % NUM_OF_MEM_BANK;
+		// empty banks are skipped so it doesn't fade into nothing
+		float t = memBanks[bankB].isOn ? pos - bankA : 0.0;
+
+		if (bankA != currentMemBank) {
+			params[LENGTH_PARAM].setValue(memBanks[bankA].length);
+			currentMemBank = bankA;
+		}
+
+		const float *a = memBanks[bankA].gateProbabilities;
+		const float *b = memBanks[bankB].gateProbabilities;
+		for (int i = 0; i < NUM_OF_SLIDERS; i += 4) {
+			float_4 pa = float_4::load(&a[i]);
+			float_4 pb = float_4::load(&b[i]);
+			float_4 p = pa + (pb - pa) * t;
+			p.store(&gateProbabilities[i]);
 		}
 	}
 
 	void clockStep() {
+		PROFILE_SCOPE(profiler, CLOCK_PHASE);
 		int rootNote = params[ROOT_NOTE_PARAM].getValue();
 		int scale = params[SCALE_PARAM].getValue();
 
@@ -344,7 +569,7 @@ struct StochSeq : Module, Quantize {
 		lightBlink = false;
 
 		float prob = gateProbabilities[gateIndex];
-		if (random::uniform() < prob) {
+		if (lookahead.next() < prob) {
 			gatePulse.trigger(1e-3);
 			gateOn = true;
 			notGateOn = false;
@@ -374,70 +599,65 @@ struct StochSeq : Module, Quantize {
 	}
 
 	void invert() {
-		for (int i = 0; i < NUM_OF_SLIDERS; i++) {
-			float currentProb = gateProbabilities[i];
-			gateProbabilities[i] = 1.0 - currentProb;
-		}
+		transforms::invert(gateProbabilities, NUM_OF_SLIDERS);
 	}
 
 	void diminish() {
-		float *tempArray = new float[16];
-		int index = 0;
-		for (int i = 0; i < NUM_OF_SLIDERS; i += 2) {
-			tempArray[index] = gateProbabilities[i];
-			index++;
-		}
-		for (int i = 0; i < NUM_OF_SLIDERS; i++) {
-			gateProbabilities[i] = tempArray[i % 16];
-		}
-		delete[] tempArray;
+		transforms::diminish(gateProbabilities, NUM_OF_SLIDERS);
 	}
 
-	void shiftPatternLeft() {
-		float temp = gateProbabilities[0]; // this goes at the end
-		for (int i = 0; i < NUM_OF_SLIDERS; i++) {
-			if (i == NUM_OF_SLIDERS-1) {
-				gateProbabilities[i] = temp;
-			} else {
-				gateProbabilities[i] = gateProbabilities[i+1];
-			}
-		}
+	// transforms from the context menu & keyboard, these also update the memory bank
+	void augment() {
+		startEdit();
+		transforms::augment(gateProbabilities, NUM_OF_SLIDERS);
+		finishEdit(seqLength);
+	}
 
-		memBanks[currentMemBank].setProbabilities(gateProbabilities, seqLength);
+	void reverse() {
+		startEdit();
+		// only the steps that are playing
+		transforms::reverse(gateProbabilities, seqLength);
+		finishEdit(seqLength);
 	}
 
-	void shiftPatternRight() {
-		float temp = gateProbabilities[NUM_OF_SLIDERS-1]; // this goes at the beginning
-		for (int i = NUM_OF_SLIDERS-1; i >= 0; i--) {
-			if (i == 0) {
-				gateProbabilities[i] = temp;
-			} else {
-				gateProbabilities[i] = gateProbabilities[i-1];
-			}
-		}
+	void scalePattern(float amount) {
+		startEdit();
+		transforms::scale(gateProbabilities, NUM_OF_SLIDERS, amount);
+		finishEdit(seqLength);
+	}
 
-		memBanks[currentMemBank].setProbabilities(gateProbabilities, seqLength);
+	void thresholdPattern() {
+		startEdit();
+		transforms::threshold(gateProbabilities, NUM_OF_SLIDERS);
+		finishEdit(seqLength);
 	}
 
-	void shiftPatternUp() {
-		for (int i = 0; i < NUM_OF_SLIDERS; i++) {
-			gateProbabilities[i] += 0.05;
-			gateProbabilities[i] = clamp(gateProbabilities[i], 0.0, 1.0);
-		}
+	void shiftPatternLeft() {
+		startEdit();
+		transforms::rotate(gateProbabilities, NUM_OF_SLIDERS, -1);
+		finishEdit(seqLength);
+	}
 
-		memBanks[currentMemBank].setProbabilities(gateProbabilities, seqLength);
+	void shiftPatternRight() {
+		startEdit();
+		transforms::rotate(gateProbabilities, NUM_OF_SLIDERS, 1);
+		finishEdit(seqLength);
 	}
 
-	void shiftPatternDown() {
-		for (int i = 0; i < NUM_OF_SLIDERS; i++) {
-			gateProbabilities[i] -= 0.05;
-			gateProbabilities[i] = clamp(gateProbabilities[i], 0.0, 1.0);
-		}
+	void shiftPatternUp() {
+		startEdit();
+		transforms::shift(gateProbabilities, NUM_OF_SLIDERS, 0.05);
+		finishEdit(seqLength);
+	}
 
-		memBanks[currentMemBank].setProbabilities(gateProbabilities, seqLength);
+	void shiftPatternDown() {
+		startEdit();
+		transforms::shift(gateProbabilities, NUM_OF_SLIDERS, -0.05);
+		finishEdit(seqLength);
 	}
 
 	void genPatterns(int c) {
+		PROFILE_SCOPE(profiler, PATTERNS_PHASE);
 		switch (c) {
 			case 0:
 				for (int i = 0; i < NUM_OF_SLIDERS; i++) {
@@ -486,79 +706,21 @@ struct StochSeq : Module, Quantize {
 				break;
 			default:
 				for (int i = 0; i < NUM_OF_SLIDERS; i++) {
-					gateProbabilities[i] = random::uniform();
+					gateProbabilities[i] = patternRandom.uniform();
 				}
 		}
 
-		memBanks[currentMemBank].setProbabilities(gateProbabilities, seqLength);
+		finishEdit(seqLength);
 	}
 };
 
-struct StochSeqDisplay : Widget {
+// background, grid & sliders. only redrawn when the pattern changes
+struct StochSeqSliders : Widget {
 	StochSeq *module;
-	float initX = 0;
-	float initY = 0;
-	float dragX = 0;
-	float dragY = 0;
-	float sliderWidth = SLIDER_WIDTH;
-	StochSeqDisplay() {}
-
-	void onButton(const event::Button &e) override {
-        if (e.action == GLFW_PRESS && e.button == GLFW_MOUSE_BUTTON_LEFT) {
-            if ((e.mods & RACK_MOD_MASK) == RACK_MOD_CTRL) {
-                module->isCtrlClick = true;
-                e.consume(this);
-                initX = e.pos.x;
-                initY = e.pos.y;
-                toggleProbabilities(initX);
-            }
-            else {
-                module->isCtrlClick = false;
-                e.consume(this);
-                initX = e.pos.x;
-                initY = e.pos.y;
-                setProbabilities(initX, initY);
-            }
-        }
-	}
-
-	void onDragStart(const event::DragStart &e) override {
-		dragX = APP->scene->rack->getMousePos().x;
-		dragY = APP->scene->rack->getMousePos().y;
-	}
-
-	void onDragMove(const event::DragMove &e) override {
-		if (!module->isCtrlClick) {
-			float newDragX = APP->scene->rack->getMousePos().x;
-			float newDragY = APP->scene->rack->getMousePos().y;
-			setProbabilities(initX + (newDragX - dragX), initY + (newDragY - dragY));
-		}
-	}
-
-	void setProbabilities(float currentX, float dragY) {
-		int index = (int)(currentX / sliderWidth);
-		if (index >= NUM_OF_SLIDERS) index = NUM_OF_SLIDERS - 1;
-		if (dragY < 0) dragY = 0;
-		else if (dragY > box.size.y) dragY = box.size.y - SLIDER_TOP;
-		float prob = 1.0 - dragY / (box.size.y - SLIDER_TOP);
-		module->gateProbabilities[index] = clamp(prob, 0.0, 1.0);
-		int visibleSliders = (int)module->params[StochSeq::LENGTH_PARAM].getValue();
-		module->memBanks[module->currentMemBank].setProbabilities(module->gateProbabilities, visibleSliders);
-	}
 
-	void toggleProbabilities(float currentX) {
-        if (currentX < 0) currentX = 0;
-        int index = (int)(currentX / sliderWidth);
-        if (index >= NUM_OF_SLIDERS) index = NUM_OF_SLIDERS - 1;
-        float p = module->gateProbabilities[index];
-        module->gateProbabilities[index] = p < 0.5 ? 1.0 : 0.0;
-		int visibleSliders = (int)module->params[StochSeq::LENGTH_PARAM].getValue();
-		module->memBanks[module->currentMemBank].setProbabilities(module->gateProbabilities, visibleSliders);
-	}
-
-	float getSliderHeight(int index) {
+	float getSliderHeight(const StochSeqView &v, int index) {
 		float y = box.size.y - SLIDER_TOP;
-		return y - (y * module->gateProbabilities[index]);
+		return y - (y * v.gateProbabilities[index]);
 	}
 
 	void draw(const DrawArgs& args) override {
@@ -604,22 +766,16 @@ struct StochSeqDisplay : Widget {
 
 		// sliders
 		nvgStrokeColor(args.vg, nvgRGB(60, 70, 73));
-		int visibleSliders = (int)module->params[StochSeq::LENGTH_PARAM].getValue();
-		int mLength = module->memBanks[module->currentMemBank].length;
-		if (mLength != visibleSliders)
-			module->memBanks[module->currentMemBank].setProbabilities(module->gateProbabilities, visibleSliders);
-
-		module->memBanks[module->currentMemBank].length = visibleSliders;
-		sliderWidth = box.size.x / (float)visibleSliders;
+		const StochSeqView &v = module->view.read();
+		int visibleSliders = v.length;
+		float sliderWidth = box.size.x / (float)visibleSliders;
 		for (int i = 0; i < visibleSliders; i++) {
 			nvgStrokeWidth(args.vg, (i % 4 == 0 ? 2 : 0.5));
 			nvgBeginPath(args.vg);
 			nvgMoveTo(args.vg, i * sliderWidth, 0);
 			nvgLineTo(args.vg, i * sliderWidth, box.size.y);
 			nvgStroke(args.vg);
-			float sHeight = getSliderHeight(i);
-
-			// float sHeight = sliderHeights[i];
+			float sHeight = getSliderHeight(v, i);
 
 			nvgFillColor(args.vg, nvgRGBA(255, 255, 255, 191)); // bottoms
 			nvgBeginPath(args.vg);
@@ -630,23 +786,99 @@ struct StochSeqDisplay : Widget {
 			nvgBeginPath(args.vg);
 			nvgRect(args.vg, i * sliderWidth, sHeight, sliderWidth, SLIDER_TOP);
 			nvgFill(args.vg);
+		}
+	}
+};
 
-			// percentage texts for each slider
-			if (module->showPercentages) {
-				nvgTextAlign(args.vg, NVG_ALIGN_CENTER);
-				nvgFillColor(args.vg, nvgRGB(255, 255, 255));
-				nvgFontSize(args.vg, 9 + (sliderWidth / SLIDER_WIDTH));
-				float w = i * sliderWidth;
-				float yText = sHeight;
-				if (sHeight < SLIDER_TOP + 3) {
-					yText = (SLIDER_TOP * 2) + sHeight + 3;
-					nvgFillColor(args.vg, nvgRGB(0, 0, 0));
-				}
-				std::string probText = std::to_string(static_cast<int>(module->gateProbabilities[i] * 100));
-				nvgText(args.vg, w + sliderWidth/2.0, yText, probText.c_str(), NULL);
-			}
+struct StochSeqDisplay : Widget {
+	StochSeq *module;
+	float initX = 0;
+	float initY = 0;
+	float dragX = 0;
+	float dragY = 0;
+	float sliderWidth = SLIDER_WIDTH;
+	StochSeqDisplay() {}
+
+	void onButton(const event::Button &e) override {
+        if (e.action == GLFW_PRESS && e.button == GLFW_MOUSE_BUTTON_LEFT) {
+            if ((e.mods & RACK_MOD_MASK) == RACK_MOD_CTRL) {
+                module->isCtrlClick = true;
+                e.consume(this);
+                initX = e.pos.x;
+                initY = e.pos.y;
+                toggleProbabilities(initX);
+            }
+            else {
+                module->isCtrlClick = false;
+                e.consume(this);
+                initX = e.pos.x;
+                initY = e.pos.y;
+                setProbabilities(initX, initY);
+            }
+        }
+	}
+
+	void onDragStart(const event::DragStart &e) override {
+		dragX = APP->scene->rack->getMousePos().x;
+		dragY = APP->scene->rack->getMousePos().y;
+	}
+
+	void onDragMove(const event::DragMove &e) override {
+		if (!module->isCtrlClick) {
+			float newDragX = APP->scene->rack->getMousePos().x;
+			float newDragY = APP->scene->rack->getMousePos().y;
+			setProbabilities(initX + (newDragX - dragX), initY + (newDragY - dragY));
 		}
+	}
+
+	void setProbabilities(float currentX, float dragY) {
+		if (currentX < 0) currentX = 0;
+		int index = (int)(currentX / sliderWidth);
+		if (index >= NUM_OF_SLIDERS) index = NUM_OF_SLIDERS - 1;
+		if (dragY < 0) dragY = 0;
+		else if (dragY > box.size.y) dragY = box.size.y - SLIDER_TOP;
+		float prob = 1.0 - dragY / (box.size.y - SLIDER_TOP);
+		module->sendCommand(StochSeq::SET_PROBABILITY, index, clamp(prob, 0.0, 1.0));
+	}
+
+	void toggleProbabilities(float currentX) {
+        if (currentX < 0) currentX = 0;
+        int index = (int)(currentX / sliderWidth);
+        if (index >= NUM_OF_SLIDERS) index = NUM_OF_SLIDERS - 1;
+		module->sendCommand(StochSeq::TOGGLE_PROBABILITY, index);
+	}
+
+	float getSliderHeight(const StochSeqView &v, int index) {
+		float y = box.size.y - SLIDER_TOP;
+		return y - (y * v.gateProbabilities[index]);
+	}
 
+	void step() override {
+		if (module)
+			sliderWidth = box.size.x / (float)module->view.read().length;
+		Widget::step();
+	}
+
+	// percentage texts for each slider, the sliders themselves are cached in StochSeqSliders
+	void draw(const DrawArgs& args) override {
+		if (module == NULL || !module->showPercentages) return;
+
+		const StochSeqView &v = module->view.read();
+		nvgTextAlign(args.vg, NVG_ALIGN_CENTER);
+		nvgFontSize(args.vg, 9 + (sliderWidth / SLIDER_WIDTH));
+		for (int i = 0; i < v.length; i++) {
+			float sHeight = getSliderHeight(v, i);
+			float w = i * sliderWidth;
+			float yText = sHeight;
+			nvgFillColor(args.vg, nvgRGB(255, 255, 255));
+			if (sHeight < SLIDER_TOP + 3) {
+				yText = (SLIDER_TOP * 2) + sHeight + 3;
+				nvgFillColor(args.vg, nvgRGB(0, 0, 0));
+			}
+			char probText[8];
+			snprintf(probText, sizeof(probText), "%d", static_cast<int>(v.gateProbabilities[i] * 100));
+			nvgText(args.vg, w + sliderWidth/2.0, yText, probText, NULL);
+		}
 	}
 
 	void drawLayer(const DrawArgs& args, int layer) override {
@@ -654,50 +886,47 @@ struct StochSeqDisplay : Widget {
 		if (module == NULL) return;
 
 		if (layer == 1) {
+			const StochSeqView &v = module->view.read();
 
 			// seq position
-			if (module->gateIndex >= -1) {
+			if (v.gateIndex >= -1) {
 				nvgStrokeWidth(args.vg, 2.0);
 				// nvgStrokeColor(args.vg, nvgRGB(128, 0, 219));
 				nvgStrokeColor(args.vg, nvgRGB(0, 238, 255));
 				nvgBeginPath(args.vg);
-				int pos = module->resetMode ? 0 : clamp(module->gateIndex, 0, NUM_OF_SLIDERS);
+				int pos = v.resetMode ? 0 : clamp(v.gateIndex, 0, NUM_OF_SLIDERS);
 				float x = clamp(pos * sliderWidth, 0.0, box.size.x - sliderWidth);
 				nvgRect(args.vg, x, 1, sliderWidth, box.size.y - 1);
 				nvgStroke(args.vg);
 			}
 
+			// steps that are going to play in the next cycle
+			if (module->showUpcoming) {
+				nvgFillColor(args.vg, nvgRGB(0, 238, 255));
+				for (int step = 0; step < v.length; step++) {
+					if (v.upcoming[step]) {
+						nvgBeginPath(args.vg);
+						nvgCircle(args.vg, (step + 0.5) * sliderWidth, box.size.y - 4, 2);
+						nvgFill(args.vg);
+					}
+				}
+			}
+
 		}
 		Widget::drawLayer(args, layer);
 
 	}
 };
 
-struct MemoryBankDisplay : Widget {
+// only redrawn when the bank changes
+struct MemoryBankSliders : Widget {
 	StochSeq *module;
 	int bankId;
 	float sliderWidth = 1.25;
 
-	MemoryBankDisplay() {}
-
-	void onButton(const event::Button &e) override {
-        if (e.action == GLFW_PRESS && e.button == GLFW_MOUSE_BUTTON_LEFT) {
-			e.consume(this);
-			module->params[StochSeq::LENGTH_PARAM].setValue(module->memBanks[bankId].length);
-			module->memBanks[bankId].setGates(module->gateProbabilities);
-			module->currentMemBank = bankId;
-
-			// int visibleSliders = (int)module->params[StochSeq::LENGTH_PARAM].getValue();
-			// module->memBanks[bankId].setProbabilities(module->gateProbabilities, visibleSliders);
-
-			// select from bank
-			// highlight too
-        }
-	}
-
-	float getSliderHeight(int index) {
+	float getSliderHeight(const MemoryBank &bank, int index) {
 		float y = box.size.y;
-		return y - (y * module->memBanks[bankId].gateProbabilities[index]);
+		return y - (y * bank.gateProbabilities[index]);
 	}
 
 	void draw(const DrawArgs& args) override {
@@ -731,19 +960,21 @@ struct MemoryBankDisplay : Widget {
 			return;
 		}
 
-		if (module->memBanks[bankId].isOn) {
+		const StochSeqView &v = module->view.read();
+		const MemoryBank &bank = v.memBanks[bankId];
+		if (bank.isOn) {
 			// sliders
 			nvgStrokeColor(args.vg, nvgRGB(60, 70, 73));
-			sliderWidth = box.size.x / (float)module->memBanks[bankId].length;
+			sliderWidth = box.size.x / (float)bank.length;
 
-			if (module->currentMemBank == bankId)
+			if (v.currentMemBank == bankId)
 				nvgFillColor(args.vg, nvgRGB(255, 255, 255)); // bars
 			else
 				nvgFillColor(args.vg, nvgRGBA(255, 255, 255, 220)); // bars
 			
-			for (int i = 0; i < module->memBanks[bankId].length; i++) {
-				if (module->memBanks[bankId].gateProbabilities[i] > 0.0) {
-					float sHeight = getSliderHeight(i);
+			for (int i = 0; i < bank.length; i++) {
+				if (bank.gateProbabilities[i] > 0.0) {
+					float sHeight = getSliderHeight(bank, i);
 					nvgBeginPath(args.vg);
 					nvgRect(args.vg, i * sliderWidth, sHeight, sliderWidth, box.size.y - sHeight);
 					nvgFill(args.vg);
@@ -761,13 +992,33 @@ struct MemoryBankDisplay : Widget {
 			nvgStroke(args.vg);
 		}
 	}
+};
+
+struct MemoryBankDisplay : Widget {
+	StochSeq *module;
+	int bankId;
+
+	MemoryBankDisplay() {}
+
+	void onButton(const event::Button &e) override {
+        if (e.action == GLFW_PRESS && e.button == GLFW_MOUSE_BUTTON_LEFT) {
+			e.consume(this);
+			module->sendCommand(StochSeq::RECALL_BANK, bankId);
+
+			// int visibleSliders = (int)module->params[StochSeq::LENGTH_PARAM].getValue();
+			// module->memBanks[bankId].setProbabilities(module->gateProbabilities, visibleSliders);
+
+			// select from bank
+			// highlight too
+        }
+	}
 
 	void drawLayer(const DrawArgs& args, int layer) override {
 
 		if (module == NULL) return;
 
 		if (layer == 1) {
-			if (bankId != module->currentMemBank) {
+			if (bankId != module->view.read().currentMemBank) {
 
 				// TODO: do I like this?
 				if (!rack::settings::preferDarkPanels)
@@ -792,6 +1043,14 @@ struct StochSeqWidget : ModuleWidget {
 		setModule(module);
         setPanel(createPanel(asset::plugin(pluginInstance, "res/StochSeq.svg"), asset::plugin(pluginInstance, "res/StochSeq-dark.svg")));
 
+		StochSeqSliders *sliders = new StochSeqSliders();
+		sliders->module = module;
+		sliders->box.pos = Vec(7.4, 47.7);
+		sliders->box.size = Vec(480, 102.9);
+		CachedLayer *slidersLayer = createCachedLayer(sliders);
+		if (module) slidersLayer->getRevision = [=]() { return module->getDisplayRevision(); };
+		addChild(slidersLayer);
+
 		StochSeqDisplay *display = new StochSeqDisplay();
 		display->module = module;
 		display->box.pos = Vec(7.4, 47.7);
@@ -799,6 +1058,15 @@ struct StochSeqWidget : ModuleWidget {
 		addChild(display);
 
 		for (int i = 0; i < NUM_OF_MEM_BANK; i++) {
+			MemoryBankSliders *memSliders = new MemoryBankSliders();
+			memSliders->module = module;
+			memSliders->bankId = i;
+			memSliders->box.pos = Vec(7.6 + (i * 40), 160.8);
+			memSliders->box.size = Vec(40, 28.9);
+			CachedLayer *memLayer = createCachedLayer(memSliders);
+			if (module) memLayer->getRevision = [=]() { return module->getBankRevision(i); };
+			addChild(memLayer);
+
 			MemoryBankDisplay *memDisplay = new MemoryBankDisplay();
 			memDisplay->module = module;
 			memDisplay->bankId = i;
@@ -911,11 +1179,28 @@ struct StochSeqWidget : ModuleWidget {
 		menu->addChild(createIndexPtrSubmenuItem("Gate mode", {"Gates", "Triggers"}, &module->gateMode));
 		menu->addChild(createIndexPtrSubmenuItem("V/OCT mode", {"Independent", "Sample and Hold"}, &module->voltMode));
 		menu->addChild(createIndexPtrSubmenuItem("Volt Offset", {"±5V", "+10V"}, &module->voltRange));
+		menu->addChild(createBoolPtrMenuItem("Morph memory banks", "", &module->morphBanks));
+		menu->addChild(createBoolPtrMenuItem("Fixed random seed", "", &module->fixedSeed));
 
 		menu->addChild(new MenuEntry);
 
 		menu->addChild(createBoolPtrMenuItem("Slider Percentages", "", &module->showPercentages));
+		menu->addChild(createBoolPtrMenuItem("Upcoming Steps", "", &module->showUpcoming));
 		menu->addChild(createBoolPtrMenuItem("Keyboard Shortcuts", "", &module->enableKBShortcuts));
+
+		menu->addChild(new MenuEntry);
+
+		menu->addChild(createSubmenuItem("Transform pattern", "", [=](Menu *menu) {
+			menu->addChild(createMenuItem("Reverse", "", [=]() { module->sendCommand(StochSeq::REVERSE_PATTERN); }));
+			menu->addChild(createMenuItem("Augment", "", [=]() { module->sendCommand(StochSeq::AUGMENT_PATTERN); }));
+			menu->addChild(createMenuItem("Rotate left", RACK_MOD_CTRL_NAME "+←", [=]() { module->sendCommand(StochSeq::ROTATE_PATTERN, -1); }));
+			menu->addChild(createMenuItem("Rotate right", RACK_MOD_CTRL_NAME "+→", [=]() { module->sendCommand(StochSeq::ROTATE_PATTERN, 1); }));
+			menu->addChild(createMenuItem("More contrast", "", [=]() { module->sendCommand(StochSeq::SCALE_PATTERN, 0, 1.25); }));
+			menu->addChild(createMenuItem("Less contrast", "", [=]() { module->sendCommand(StochSeq::SCALE_PATTERN, 0, 0.8); }));
+			menu->addChild(createMenuItem("Threshold", "", [=]() { module->sendCommand(StochSeq::THRESHOLD_PATTERN); }));
+		}));
+
+		module->profiler.appendMenu(menu);
 	}
 
 	void onSelectKey(const event::SelectKey &e) override {
@@ -928,22 +1213,22 @@ struct StochSeqWidget : ModuleWidget {
 		if (e.key == GLFW_KEY_LEFT && (e.mods & RACK_MOD_MASK) == RACK_MOD_CTRL) {
 			e.consume(this);
 			if (e.action == GLFW_PRESS || e.action == GLFW_REPEAT) {
-				module->shiftPatternLeft();
+				module->sendCommand(StochSeq::ROTATE_PATTERN, -1);
 			}
 		} else if (e.key == GLFW_KEY_RIGHT && (e.mods & RACK_MOD_MASK) == RACK_MOD_CTRL) {
 			e.consume(this);
 			if (e.action == GLFW_PRESS || e.action == GLFW_REPEAT) {
-				module->shiftPatternRight();
+				module->sendCommand(StochSeq::ROTATE_PATTERN, 1);
 			}
 		} else if (e.key == GLFW_KEY_UP && (e.mods & RACK_MOD_MASK) == RACK_MOD_CTRL) {
 			e.consume(this);
 			if (e.action == GLFW_PRESS || e.action == GLFW_REPEAT) {
-				module->shiftPatternUp();
+				module->sendCommand(StochSeq::SHIFT_PATTERN, 0, 0.05);
 			}
 		} else if (e.key == GLFW_KEY_DOWN && (e.mods & RACK_MOD_MASK) == RACK_MOD_CTRL) {
 			e.consume(this);
 			if (e.action == GLFW_PRESS || e.action == GLFW_REPEAT) {
-				module->shiftPatternDown();
+				module->sendCommand(StochSeq::SHIFT_PATTERN, 0, -0.05);
 			}
 		} else {
 			// ModuleWidget::onSelectKey(e);
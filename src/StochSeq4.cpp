@@ -1,4 +1,5 @@
 #include "plugin.hpp"
+#include <osdialog.h>
 
 #define SLIDER_WIDTH 15
 #define SLIDER_TOP 4
@@ -18,7 +19,13 @@ struct Sequencer {
     int currentPattern = 0;
     float volts = 0.0;
     float invVolts = 0.0;
+    // quantized volts, only recomputed on a clock step or a root/scale change
+    float pitch = 0.0;
+    float invPitch = 0.0;
+    bool pitchChanged = true;
+    int gateState = -1; // last gate/not gate written to the outputs
     float gateProbabilities[NUM_OF_SLIDERS];
+    Lookahead lookahead;
 
     Sequencer() {
         gateIndex = -1;
@@ -35,7 +42,7 @@ struct Sequencer {
 
         // gate
         float prob = gateProbabilities[gateIndex];
-        if (random::uniform() < prob) {
+        if (lookahead.next() < prob) {
             gatePulse.trigger(1e-3);
             gateOn = true;
             notGateOn = false;
@@ -53,7 +60,28 @@ struct Sequencer {
     }
 };
 
+// pattern transforms from the GUI, applied at the start of process()
+struct StochSeq4Command {
+    int type;
+    int seq;
+    float value;
+    int index;
+};
+
 struct StochSeq4 : Module, Quantize {
+    enum CommandIds {
+        REVERSE_PATTERN,
+        AUGMENT_PATTERN,
+        ROTATE_PATTERN,
+        SHIFT_PATTERN,
+        SCALE_PATTERN,
+        THRESHOLD_PATTERN,
+        SET_PROBABILITY,
+        TOGGLE_PROBABILITY,
+        COPY_PATTERN,
+        PASTE_PATTERN,
+        NUM_COMMANDS
+    };
     enum ModeIds {
 		GATE_MODE,
 		TRIG_MODE,
@@ -87,7 +115,8 @@ struct StochSeq4 : Module, Quantize {
         RANDOM_INPUT = RESET_INPUT + NUM_SEQS,
         INVERT_INPUT = RANDOM_INPUT + NUM_SEQS,
         DIMINUTION_INPUT = INVERT_INPUT + NUM_SEQS,
-		NUM_INPUTS = DIMINUTION_INPUT + NUM_SEQS
+        BANK_INPUT = DIMINUTION_INPUT + NUM_SEQS,
+		NUM_INPUTS
 	};
 	enum OutputIds {
         OR_OUTPUT,
@@ -113,11 +142,47 @@ struct StochSeq4 : Module, Quantize {
     int voltRange = 1;
     bool resetMode = false;
     bool showPercentages = true;
+    bool showUpcoming = false;
     bool enableKBShortcuts = true;
     bool isCtrlClick = false;
     int focusedSeq = PURPLE_SEQ;
+    int rootNote = -1;
+    int scale = -1;
+    int lastVoltMode = -1;
+    int logicState = -1;
+    StochSeq4Message expanderState;
+    bool expanderSynced = false;
     Sequencer clipBoard;
     Sequencer seqs[NUM_SEQS];
+    FastRandom patternRandom; // the RND buttons & random patterns
+    CommandQueue<StochSeq4Command, 64> commands;
+    uint64_t seed = random::u64();
+    bool fixedSeed = false; // saved with the patch so it plays the same every time
+
+    // the GUI & dataFromJson() map pattern bank files & hand them to process(),
+    // which sends the one it replaces back so it gets unmapped off the audio
+    // thread. they won't send more than the queues hold until they get some back
+    static const int BANK_QUEUE_SIZE = 16;
+    PatternBank *bank = NULL;
+    int bankIndex = -1;
+    CommandQueue<PatternBank *, BANK_QUEUE_SIZE> newBanks;
+    CommandQueue<PatternBank *, BANK_QUEUE_SIZE> oldBanks;
+    std::string bankPath; // not the audio thread's
+    int bankCount = 0;
+    int banksInFlight = 0;
+    std::string bankError; // shown in the menu
+    // goes up whenever a pattern changes, so the sliders know to redraw
+    std::atomic<uint32_t> revision{0};
+
+    enum PerfPhases {
+        COMMANDS_PHASE,
+        BANK_PHASE,
+        PATTERNS_PHASE,
+        CLOCK_PHASE,
+        OUTPUTS_PHASE,
+        NUM_PERF_PHASES
+    };
+    Profiler<NUM_PERF_PHASES> profiler{"GUI commands", "Bank pattern copy", "Pattern generation", "Clock steps", "Outputs & expander"};
 
     StochSeq4() {
         config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
@@ -169,6 +234,7 @@ struct StochSeq4 : Module, Quantize {
         configInput(DIMINUTION_INPUT + BLUE_SEQ, "Diminish blue pattern");
         configInput(DIMINUTION_INPUT + AQUA_SEQ, "Diminish aqua pattern");
         configInput(DIMINUTION_INPUT + RED_SEQ, "Diminish red pattern");
+        configInput(BANK_INPUT, "Pattern bank select");
 
         configOutput(OR_OUTPUT, "Or");
         configOutput(XOR_OUTPUT, "Xor");
@@ -191,6 +257,47 @@ struct StochSeq4 : Module, Quantize {
         configOutput(INV_VOLTS_OUTPUT + BLUE_SEQ, "Blue Inverted Pitch (V/OCT)");
         configOutput(INV_VOLTS_OUTPUT + AQUA_SEQ, "Aqua Inverted Pitch (V/OCT)");
         configOutput(INV_VOLTS_OUTPUT + RED_SEQ, "Red Inverted Pitch (V/OCT)");
+
+        reseed();
+    }
+
+    ~StochSeq4() {
+        PatternBank *b;
+        while (newBanks.pop(b)) delete b;
+        deleteOldBanks();
+        delete bank;
+    }
+
+    // the outputs are only written when they change, so after a bypass or
+    // reset process() has to write all of them again
+    void invalidateOutputs() {
+        for (int i = 0; i < NUM_SEQS; i++) {
+            seqs[i].gateState = -1;
+            seqs[i].pitchChanged = true;
+        }
+        logicState = -1;
+        // and the expander gets a fresh message
+        expanderSynced = false;
+    }
+
+    void onReset() override {
+        invalidateOutputs();
+    }
+
+    void onBypass(const BypassEvent &e) override {
+        invalidateOutputs();
+    }
+
+    void onUnBypass(const UnBypassEvent &e) override {
+        invalidateOutputs();
+    }
+
+    // every sequence gets its own stream from the one seed
+    void reseed() {
+        for (int i = 0; i < NUM_SEQS; i++) {
+            seqs[i].lookahead.seed(seed + i);
+        }
+        patternRandom.seed(seed + NUM_SEQS);
     }
 
     json_t *dataToJson() override {
@@ -201,33 +308,51 @@ struct StochSeq4 : Module, Quantize {
             json_t *currentPatternJ = json_integer(seqs[i].currentPattern);
             json_array_append_new(currentPatternsJ, currentPatternJ);
 
-            json_t *probsJ = json_array();
-            for (int j = 0; j < NUM_OF_SLIDERS; j++) {
-                json_t *probJ = json_real(seqs[i].gateProbabilities[j]);
-                json_array_append_new(probsJ, probJ);
-            }
-            json_array_append_new(seqsProbsJ, probsJ);
+            json_array_append_new(seqsProbsJ, packProbabilities(seqs[i].gateProbabilities, NUM_OF_SLIDERS));
         }
+        setDataVersion(rootJ);
         json_object_set_new(rootJ, "currentPatterns", currentPatternsJ);
         json_object_set_new(rootJ, "seqsProbs", seqsProbsJ);
         json_object_set_new(rootJ, "mclkOverride", json_boolean(mclkOverride));
         json_object_set_new(rootJ, "percentages", json_boolean(showPercentages));
+        json_object_set_new(rootJ, "upcoming", json_boolean(showUpcoming));
         json_object_set_new(rootJ, "kbshortcuts", json_boolean(enableKBShortcuts));
         json_object_set_new(rootJ, "focusId", json_integer(focusedSeq));
         json_object_set_new(rootJ, "gateMode", json_integer(gateMode));
         json_object_set_new(rootJ, "voltMode", json_integer(voltMode));
         json_object_set_new(rootJ, "voltRange", json_integer(voltRange));
+        if (fixedSeed)
+            json_object_set_new(rootJ, "seed", json_integer((json_int_t)seed));
+        if (!bankPath.empty())
+            json_object_set_new(rootJ, "bankPath", json_string(bankPath.c_str()));
+        setProfilerJson(rootJ, profiler);
 
         return rootJ;
     }
 
     void dataFromJson(json_t *rootJ) override {
+        int version = getDataVersion(rootJ);
+
         json_t *mclkOverrideJ = json_object_get(rootJ, "mclkOverride");
         if (mclkOverrideJ) mclkOverride = json_boolean_value(mclkOverrideJ);
 
         json_t *percentagesJ = json_object_get(rootJ, "percentages");
         if (percentagesJ) showPercentages = json_boolean_value(percentagesJ);
 
+        json_t *upcomingJ = json_object_get(rootJ, "upcoming");
+        if (upcomingJ) showUpcoming = json_boolean_value(upcomingJ);
+
+        json_t *seedJ = json_object_get(rootJ, "seed");
+        if (seedJ) {
+            fixedSeed = true;
+            seed = (uint64_t)json_integer_value(seedJ);
+            reseed();
+        } else {
+            fixedSeed = false;
+            seed = random::u64();
+            reseed();
+        }
+
 		json_t *kbshortcutsJ = json_object_get(rootJ, "kbshortcuts");
 		if (kbshortcutsJ) enableKBShortcuts = json_boolean_value(kbshortcutsJ);
 
@@ -243,6 +368,10 @@ struct StochSeq4 : Module, Quantize {
         json_t *voltRangeJ = json_object_get(rootJ, "voltRange");
 		if (voltRangeJ) voltRange = json_integer_value(voltRangeJ);
 
+        // a patch without one, or with one that's gone, doesn't keep the last patch's
+        json_t *bankPathJ = json_object_get(rootJ, "bankPath");
+        if (!bankPathJ || !loadBank(json_string_value(bankPathJ))) unloadBank();
+
         json_t *currentPatternsJ = json_object_get(rootJ, "currentPatterns");
         json_t *seqsProbsJ = json_object_get(rootJ, "seqsProbs");
         if (currentPatternsJ) {
@@ -253,7 +382,9 @@ struct StochSeq4 : Module, Quantize {
                 }
 
                 json_t *probsJ = json_array_get(seqsProbsJ, i);
-                if (probsJ) {
+                if (version >= 2) {
+                    unpackProbabilities(probsJ, seqs[i].gateProbabilities, NUM_OF_SLIDERS);
+                } else if (probsJ) {
                     for (int j = 0; j < NUM_OF_SLIDERS; j++) {
                         json_t *probJ = json_array_get(probsJ, j);
                         if (probJ) {
@@ -263,13 +394,48 @@ struct StochSeq4 : Module, Quantize {
                 }
             }
         }
+        patternChanged();
     }
 
     void process(const ProcessArgs& args) override {
+        {
+            PROFILE_SCOPE(profiler, COMMANDS_PHASE);
+            StochSeq4Command command;
+            while (commands.pop(command)) {
+                applyCommand(command);
+            }
+        }
+
+        int root = params[ROOT_NOTE_PARAM].getValue();
+        int scl = params[SCALE_PARAM].getValue();
+        if (root != rootNote || scl != scale) {
+            rootNote = root;
+            scale = scl;
+            for (int i = 0; i < NUM_SEQS; i++) {
+                quantize(i);
+            }
+        }
+
         if (resetTrig.process(params[RESET_PARAM].getValue() + inputs[RESET_INPUT].getVoltage())) {
             resetMode = true;
         }
 
+        PatternBank *b;
+        while (newBanks.pop(b)) {
+            // the GUI never has more out than oldBanks holds, so there's always room
+            oldBanks.push(bank);
+            bank = b;
+            bankIndex = -1;
+        }
+        // 0 to 10V across the whole bank, only copies when it's a different pattern
+        if (bank && inputs[BANK_INPUT].isConnected()) {
+            int index = clamp((int)(inputs[BANK_INPUT].getVoltage() * 0.1f * bank->count), 0, bank->count - 1);
+            if (index != bankIndex) {
+                bankIndex = index;
+                setPatternRecord(bank->get(index));
+            }
+        }
+
         for (int i = 0; i < NUM_SEQS; i++) {
             if ((int)params[PATTERN_PARAM+i].getValue() != seqs[i].currentPattern) {
                 int patt = (int)params[PATTERN_PARAM+i].getValue();
@@ -281,9 +447,11 @@ struct StochSeq4 : Module, Quantize {
             }
             if (seqs[i].invertTrig.process(params[INVERT_PARAM+i].getValue() + inputs[INVERT_INPUT+i].getVoltage())) {
                 invert(i);
+                patternChanged();
             }
             if (seqs[i].dimTrig.process(params[DIMINUTION_PARAM+i].getValue() + inputs[DIMINUTION_INPUT+i].getVoltage())) {
                 diminish(i);
+                patternChanged();
             }
         }
         if (clockTrig.process(inputs[MASTER_CLOCK_INPUT].getVoltage())) {
@@ -311,14 +479,18 @@ struct StochSeq4 : Module, Quantize {
             }
         }
 
-        int rootNote = params[ROOT_NOTE_PARAM].getValue();
-        int scale = params[SCALE_PARAM].getValue();
+        if (voltMode != lastVoltMode) {
+            lastVoltMode = voltMode;
+            for (int i = 0; i < NUM_SEQS; i++) {
+                seqs[i].pitchChanged = true;
+            }
+        }
+
+        // between clock steps only the pulses move, outputs are written when they change
+        PROFILE_SCOPE(profiler, OUTPUTS_PHASE);
         bool orGate = false;
         int xorGate = 0;
         for (int i = 0; i < NUM_SEQS; i++) {
-            float pitchVoltage = Quantize::quantizeRawVoltage(seqs[i].volts, rootNote, scale);
-            float invPitchVoltage = Quantize::quantizeRawVoltage(seqs[i].invVolts, rootNote, scale);
-
             bool pulse, notPulse;
             if (gateMode == GATE_MODE) {
                 pulse = seqs[i].gateOn;
@@ -331,49 +503,151 @@ struct StochSeq4 : Module, Quantize {
                 orGate = true;
                 xorGate++;
             }
-            
-            outputs[GATES_OUTPUT + i].setVoltage(pulse ? 10.0 : 0.0);
-            outputs[NOT_GATES_OUTPUT + i].setVoltage(notPulse ? 10.0 : 0.0);
-            if (voltMode == VOLT_SAMPHOLD_MODE && pulse) {
-                outputs[VOLTS_OUTPUT + i].setVoltage(pitchVoltage);
-                outputs[INV_VOLTS_OUTPUT + i].setVoltage(invPitchVoltage);
-            } else if (voltMode == VOLT_INDEPENDENT_MODE) {
-                outputs[VOLTS_OUTPUT + i].setVoltage(pitchVoltage);
-                outputs[INV_VOLTS_OUTPUT + i].setVoltage(invPitchVoltage);
+
+            int gateState = pulse | (notPulse << 1);
+            if (gateState != seqs[i].gateState) {
+                seqs[i].gateState = gateState;
+                outputs[GATES_OUTPUT + i].setVoltage(pulse ? 10.0 : 0.0);
+                outputs[NOT_GATES_OUTPUT + i].setVoltage(notPulse ? 10.0 : 0.0);
+            }
+
+            // sample & hold mode keeps the new pitch pending until a gate lets it through
+            if (seqs[i].pitchChanged && (voltMode == VOLT_INDEPENDENT_MODE || pulse)) {
+                seqs[i].pitchChanged = false;
+                outputs[VOLTS_OUTPUT + i].setVoltage(seqs[i].pitch);
+                outputs[INV_VOLTS_OUTPUT + i].setVoltage(seqs[i].invPitch);
             }
         }
 
-        outputs[OR_OUTPUT].setVoltage(orGate ? 10.0 : 0.0);
-        outputs[XOR_OUTPUT].setVoltage((xorGate == 1) ? 10.0 : 0.0);
+        int logicState = orGate | ((xorGate == 1) << 1);
+        if (logicState != this->logicState) {
+            this->logicState = logicState;
+            outputs[OR_OUTPUT].setVoltage(orGate ? 10.0 : 0.0);
+            outputs[XOR_OUTPUT].setVoltage((xorGate == 1) ? 10.0 : 0.0);
+        }
 
-        // to Expander
+        // to Expander, only when a step or a gate changed
         if (rightExpander.module && (rightExpander.module->model == modelStochSeq4X)) {
-            float *messageToExpander = (float *)(rightExpander.module->leftExpander.producerMessage);
+            bool changed = !expanderSynced;
+            uint8_t gates = 0;
+            for (int i = 0; i < NUM_SEQS; i++) {
+                gates |= (seqs[i].gateState & 1) << i;
+                if (expanderState.gateIndex[i] != seqs[i].gateIndex) {
+                    expanderState.gateIndex[i] = seqs[i].gateIndex;
+                    changed = true;
+                }
+            }
+            if (gates != expanderState.gates) {
+                expanderState.gates = gates;
+                changed = true;
+            }
 
-            for (int i = 0; i < NUM_OF_SLIDERS * NUM_SEQS; i++) {
-                int indexSeq = floor(i / 32);
-                int index = i % NUM_OF_SLIDERS;
-                messageToExpander[i] = (seqs[indexSeq].gateIndex == index) ? outputs[GATES_OUTPUT + indexSeq].getVoltage() : 0.0;
+            if (changed) {
+                expanderState.sequence++;
+                StochSeq4Message *messageToExpander = (StochSeq4Message *)(rightExpander.module->leftExpander.producerMessage);
+                *messageToExpander = expanderState;
+                rightExpander.module->leftExpander.messageFlipRequested = true;
+                expanderSynced = true;
             }
+        } else {
+            expanderSynced = false;
+        }
+    }
+
+    // from the GUI thread, or dataFromJson(), which Rack also calls from there
+    bool loadBank(const std::string &path) {
+        PatternBank *b = new PatternBank;
+        if (!b->open(path)) {
+            WARN("Could not load pattern bank %s", path.c_str());
+            bankError = "Couldn't load " + system::getFilename(path);
+            delete b;
+            return false;
+        }
+        if (!sendBank(b)) {
+            delete b;
+            return false;
+        }
+        bankPath = path;
+        bankCount = b->count;
+        bankError = "";
+        return true;
+    }
+
+    void unloadBank() {
+        if (bankPath.empty()) return;
+        if (sendBank(NULL)) {
+            bankPath = "";
+            bankCount = 0;
+        }
+    }
+
+    // process() sends one back for every one it gets, NULL included, so
+    // counting them keeps oldBanks from filling up. the ones it's done with
+    // are deleted here too, without a widget nothing else would
+    bool sendBank(PatternBank *b) {
+        deleteOldBanks();
+        if (banksInFlight >= BANK_QUEUE_SIZE || !newBanks.push(b)) {
+            WARN("Pattern bank queue is full, is the engine running?");
+            bankError = "Still switching banks, try again";
+            return false;
+        }
+        banksInFlight++;
+        return true;
+    }
 
-            rightExpander.module->leftExpander.messageFlipRequested = true;
+    // not from the audio thread, the ones process() is done with
+    void deleteOldBanks() {
+        PatternBank *b;
+        while (oldBanks.pop(b)) {
+            delete b;
+            banksInFlight--;
+        }
+    }
+
+    // the patterns & lengths as they are now, to add to a bank
+    PatternRecord getPatternRecord() {
+        PatternRecord record;
+        for (int i = 0; i < NUM_SEQS; i++) {
+            std::memcpy(record.probabilities[i], seqs[i].gateProbabilities, sizeof(record.probabilities[i]));
+            record.lengths[i] = (int32_t)params[LENGTH_PARAM + i].getValue();
+        }
+        return record;
+    }
+
+    void setPatternRecord(const PatternRecord *record) {
+        PROFILE_SCOPE(profiler, BANK_PHASE);
+        for (int i = 0; i < NUM_SEQS; i++) {
+            std::memcpy(seqs[i].gateProbabilities, record->probabilities[i], sizeof(seqs[i].gateProbabilities));
+            if (record->lengths[i] > 0)
+                params[LENGTH_PARAM + i].setValue(clamp((int)record->lengths[i], 1, NUM_OF_SLIDERS));
         }
+        patternChanged();
     }
 
     void clockStep() {
         // MASTER clock step (all)
+        PROFILE_SCOPE(profiler, CLOCK_PHASE);
         for (int i = 0; i < NUM_SEQS; i++) {
             int l = (int)params[LENGTH_PARAM+i].getValue();
             float spread = params[SPREAD_PARAM+i].getValue();
             seqs[i].clockStep(l, spread, voltRange);    
+            quantize(i);
         }
     }
 
     void clockStep(int i) {
         // individual clock steps
+        PROFILE_SCOPE(profiler, CLOCK_PHASE);
         int l = (int)params[LENGTH_PARAM + i].getValue();
         float spread = params[SPREAD_PARAM + i].getValue();
         seqs[i].clockStep(l, spread, voltRange);
+        quantize(i);
+    }
+
+    void quantize(int i) {
+        seqs[i].pitch = Quantize::quantizeRawVoltage(seqs[i].volts, rootNote, scale);
+        seqs[i].invPitch = Quantize::quantizeRawVoltage(seqs[i].invVolts, rootNote, scale);
+        seqs[i].pitchChanged = true;
     }
 
     void resetSeq() {
@@ -384,81 +658,114 @@ struct StochSeq4 : Module, Quantize {
     }
 
     void invert(int id) {
-        for (int i = 0; i < NUM_OF_SLIDERS; i++) {
-            float currentProb = seqs[id].gateProbabilities[i];
-            seqs[id].gateProbabilities[i] = 1.0 - currentProb;
-        }
+        transforms::invert(seqs[id].gateProbabilities, NUM_OF_SLIDERS);
     }
 
     void diminish(int id) {
-        float *tempArray = new float[16];
-        int index = 0;
-        for (int i = 0; i < NUM_OF_SLIDERS; i += 2) {
-            tempArray[index] = seqs[id].gateProbabilities[i];
-            index++;
-        }
-        for (int i = 0; i < NUM_OF_SLIDERS; i++) {
-            seqs[id].gateProbabilities[i] = tempArray[i % 16];
+        transforms::diminish(seqs[id].gateProbabilities, NUM_OF_SLIDERS);
+    }
+
+    void augment(int id) {
+        transforms::augment(seqs[id].gateProbabilities, NUM_OF_SLIDERS);
+    }
+
+    void reverse(int id) {
+        // only the steps that are playing
+        int l = (int)params[LENGTH_PARAM + id].getValue();
+        transforms::reverse(seqs[id].gateProbabilities, l);
+    }
+
+    void scalePattern(int id, float amount) {
+        transforms::scale(seqs[id].gateProbabilities, NUM_OF_SLIDERS, amount);
+    }
+
+    void thresholdPattern(int id) {
+        transforms::threshold(seqs[id].gateProbabilities, NUM_OF_SLIDERS);
+    }
+
+    // GUI thread only
+    void sendCommand(int type, int seq, float value = 0.0, int index = 0) {
+        commands.push({type, seq, value, index});
+    }
+
+    void applyCommand(const StochSeq4Command &command) {
+        if (command.seq < 0 || command.seq >= NUM_SEQS) return;
+        switch (command.type) {
+            case REVERSE_PATTERN: reverse(command.seq); break;
+            case AUGMENT_PATTERN: augment(command.seq); break;
+            case ROTATE_PATTERN:
+                if (command.value < 0) shiftPatternLeft(command.seq);
+                else shiftPatternRight(command.seq);
+                break;
+            case SHIFT_PATTERN:
+                if (command.value < 0) shiftPatternDown(command.seq);
+                else shiftPatternUp(command.seq);
+                break;
+            case SCALE_PATTERN: scalePattern(command.seq, command.value); break;
+            case THRESHOLD_PATTERN: thresholdPattern(command.seq); break;
+            case SET_PROBABILITY:
+                if (command.index < 0 || command.index >= NUM_OF_SLIDERS) break;
+                seqs[command.seq].gateProbabilities[command.index] = clamp(command.value, 0.f, 1.f);
+                break;
+            case TOGGLE_PROBABILITY:
+                if (command.index < 0 || command.index >= NUM_OF_SLIDERS) break;
+                seqs[command.seq].gateProbabilities[command.index] = seqs[command.seq].gateProbabilities[command.index] < 0.5 ? 1.0 : 0.0;
+                break;
+            case COPY_PATTERN: copyPatternToClipBoard(command.seq); break;
+            case PASTE_PATTERN: pastePattern(command.seq); break;
         }
-        delete[] tempArray;
+        patternChanged();
     }
 
-    void copyPatternToClipBoard() {
+    // the clipboard is only used from process(), copy & paste are commands
+    void copyPatternToClipBoard(int id) {
         for (int i = 0; i < NUM_OF_SLIDERS; i++) {
-            clipBoard.gateProbabilities[i] = seqs[focusedSeq].gateProbabilities[i];
+            clipBoard.gateProbabilities[i] = seqs[id].gateProbabilities[i];
             
         }
-        clipBoard.seqLength = params[LENGTH_PARAM + focusedSeq].getValue();
+        clipBoard.seqLength = params[LENGTH_PARAM + id].getValue();
     }
 
-    void pastePattern() {
+    void pastePattern(int id) {
         for (int i = 0; i < NUM_OF_SLIDERS; i++) {
-            seqs[focusedSeq].gateProbabilities[i] = clipBoard.gateProbabilities[i];
+            seqs[id].gateProbabilities[i] = clipBoard.gateProbabilities[i];
         }
-        params[LENGTH_PARAM + focusedSeq].setValue(clipBoard.seqLength);
+        params[LENGTH_PARAM + id].setValue(clipBoard.seqLength);
     }
 
     void shiftFocus() {
         focusedSeq = (focusedSeq + 1) % NUM_SEQS;
     }
 
+    void patternChanged() {
+        revision.fetch_add(1, std::memory_order_release);
+    }
+
+    // changes whenever the sliders of a sequence have to be redrawn. the
+    // length knob isn't a pattern change, so it's checked on its own
+    uint32_t getDisplayRevision(int id) {
+        int length = (int)params[LENGTH_PARAM + id].getValue();
+        return hashState(&length, sizeof(length), revision.load(std::memory_order_acquire));
+    }
+
     void shiftPatternLeft(int id) {
-		float temp = seqs[id].gateProbabilities[0]; // this goes at the end
-		for (int i = 0; i < NUM_OF_SLIDERS; i++) {
-			if (i == NUM_OF_SLIDERS-1) {
-				seqs[id].gateProbabilities[i] = temp;
-			} else {
-				seqs[id].gateProbabilities[i] = seqs[id].gateProbabilities[i+1];
-			}
-		}
-	}
+        transforms::rotate(seqs[id].gateProbabilities, NUM_OF_SLIDERS, -1);
+    }
 
-	void shiftPatternRight(int id) {
-		float temp = seqs[id].gateProbabilities[NUM_OF_SLIDERS-1]; // this goes at the beginning
-		for (int i = NUM_OF_SLIDERS-1; i >= 0; i--) {
-			if (i == 0) {
-				seqs[id].gateProbabilities[i] = temp;
-			} else {
-                seqs[id].gateProbabilities[i] = seqs[id].gateProbabilities[i - 1];
-            }
-		}
-	}
+    void shiftPatternRight(int id) {
+        transforms::rotate(seqs[id].gateProbabilities, NUM_OF_SLIDERS, 1);
+    }
 
-	void shiftPatternUp(int id) {
-		for (int i = 0; i < NUM_OF_SLIDERS; i++) {
-			seqs[id].gateProbabilities[i] += 0.05;
-            seqs[id].gateProbabilities[i] = clamp(seqs[id].gateProbabilities[i], 0.0, 1.0);
-        }
-	}
+    void shiftPatternUp(int id) {
+        transforms::shift(seqs[id].gateProbabilities, NUM_OF_SLIDERS, 0.05);
+    }
 
-	void shiftPatternDown(int id) {
-		for (int i = 0; i < NUM_OF_SLIDERS; i++) {
-			seqs[id].gateProbabilities[i] -= 0.05;
-            seqs[id].gateProbabilities[i] = clamp(seqs[id].gateProbabilities[i], 0.0, 1.0);
-        }
-	}
+    void shiftPatternDown(int id) {
+        transforms::shift(seqs[id].gateProbabilities, NUM_OF_SLIDERS, -0.05);
+    }
 
     void genPatterns(int c, int id) {
+        PROFILE_SCOPE(profiler, PATTERNS_PHASE);
 		switch (c) {
 			case 0:
 				for (int i = 0; i < NUM_OF_SLIDERS; i++) {
@@ -507,71 +814,17 @@ struct StochSeq4 : Module, Quantize {
                 break;
 			default:
 				for (int i = 0; i < NUM_OF_SLIDERS; i++) {
-                    seqs[id].gateProbabilities[i] = random::uniform();
+                    seqs[id].gateProbabilities[i] = patternRandom.uniform();
                 }
 		}
+        patternChanged();
 	}
 };
 
-struct StochSeq4Display : Widget {
+// grid & sliders of one sequence. only redrawn when its pattern changes
+struct StochSeq4Sliders : Widget {
     StochSeq4 *module;
-    float initX = 0;
-    float initY = 0;
-    float dragX = 0;
-    float dragY = 0;
-    float sliderWidth = SLIDER_WIDTH;
     int seqId;
-    StochSeq4Display() {}
-
-    void onButton(const event::Button &e) override {
-        if (e.action == GLFW_PRESS && e.button == GLFW_MOUSE_BUTTON_LEFT) {
-            if ((e.mods & RACK_MOD_MASK) == RACK_MOD_CTRL) {
-                module->isCtrlClick = true;
-                e.consume(this);
-                initX = e.pos.x;
-                initY = e.pos.y;
-                toggleProbabilities(initX);
-            } else {
-                module->isCtrlClick = false;
-                e.consume(this);
-                initX = e.pos.x;
-                initY = e.pos.y;
-                setProbabilities(initX, initY);
-            }
-        }
-    }
-
-    void onDragStart(const event::DragStart &e) override {
-        dragX = APP->scene->rack->getMousePos().x;
-        dragY = APP->scene->rack->getMousePos().y;
-    }
-
-    void onDragMove(const event::DragMove &e) override {
-        if (!module->isCtrlClick) {
-            float newDragX = APP->scene->rack->getMousePos().x;
-            float newDragY = APP->scene->rack->getMousePos().y;
-            setProbabilities(initX + (newDragX - dragX), initY + (newDragY - dragY));
-        }
-    }
-
-    void setProbabilities(float currentX, float dragY) {
-        if (currentX < 0) currentX = 0;
-        int index = (int)(currentX / sliderWidth);
-        if (index >= NUM_OF_SLIDERS) index = NUM_OF_SLIDERS - 1;
-        if (dragY < 0) dragY = 0;
-        else if (dragY > box.size.y) dragY = box.size.y - SLIDER_TOP;
-        // module->seqs[seqId].gateProbabilities[index] = 1.0 - dragY / (box.size.y - SLIDER_TOP);
-        float prob = 1.0 - dragY / (box.size.y - SLIDER_TOP);
-        module->seqs[seqId].gateProbabilities[index] = clamp(prob, 0.0, 1.0);
-    }
-
-    void toggleProbabilities(float currentX) {
-        if (currentX < 0) currentX = 0;
-        int index = (int)(currentX / sliderWidth);
-        if (index >= NUM_OF_SLIDERS) index = NUM_OF_SLIDERS - 1;
-        float p = module->seqs[seqId].gateProbabilities[index];
-        module->seqs[seqId].gateProbabilities[index] = p < 0.5 ? 1.0 : 0.0;
-    }
 
     float getSliderHeight(int index) {
         float y = box.size.y - SLIDER_TOP;
@@ -618,7 +871,7 @@ struct StochSeq4Display : Widget {
         // sliders
         nvgStrokeColor(args.vg, nvgRGB(60, 70, 73));
         int visibleSliders = (int)module->params[StochSeq4::LENGTH_PARAM+seqId].getValue();
-        sliderWidth = box.size.x / (float)visibleSliders;
+        float sliderWidth = box.size.x / (float)visibleSliders;
         for (int i = 0; i < visibleSliders; i++) {
             nvgStrokeWidth(args.vg, (i % 4 == 0 ? 2 : 0.5));
             nvgBeginPath(args.vg);
@@ -637,24 +890,100 @@ struct StochSeq4Display : Widget {
             nvgBeginPath(args.vg);
             nvgRect(args.vg, i * sliderWidth, sHeight, sliderWidth, SLIDER_TOP);
             nvgFill(args.vg);
+        }
+    }
+};
 
-            // text
-            if (module->showPercentages) {
-                nvgTextAlign(args.vg, NVG_ALIGN_CENTER);
-                nvgFillColor(args.vg, nvgRGB(255, 255, 255));
-                nvgFontSize(args.vg, 9 + (sliderWidth / SLIDER_WIDTH));
-                float w = i * sliderWidth;
-                float yText = sHeight;
-                if (sHeight < SLIDER_TOP + 3) {
-                    yText = (SLIDER_TOP * 2) + sHeight + 3;
-                    nvgFillColor(args.vg, nvgRGB(0, 0, 0));
-                }
-                std::string probText = std::to_string(static_cast<int>(module->seqs[seqId].gateProbabilities[i] * 100));
-                nvgText(args.vg, w + sliderWidth/2.0, yText, probText.c_str(), NULL);
+struct StochSeq4Display : Widget {
+    StochSeq4 *module;
+    float initX = 0;
+    float initY = 0;
+    float dragX = 0;
+    float dragY = 0;
+    float sliderWidth = SLIDER_WIDTH;
+    int seqId;
+    StochSeq4Display() {}
+
+    void onButton(const event::Button &e) override {
+        if (e.action == GLFW_PRESS && e.button == GLFW_MOUSE_BUTTON_LEFT) {
+            if ((e.mods & RACK_MOD_MASK) == RACK_MOD_CTRL) {
+                module->isCtrlClick = true;
+                e.consume(this);
+                initX = e.pos.x;
+                initY = e.pos.y;
+                toggleProbabilities(initX);
+            } else {
+                module->isCtrlClick = false;
+                e.consume(this);
+                initX = e.pos.x;
+                initY = e.pos.y;
+                setProbabilities(initX, initY);
             }
+        }
+    }
 
+    void onDragStart(const event::DragStart &e) override {
+        dragX = APP->scene->rack->getMousePos().x;
+        dragY = APP->scene->rack->getMousePos().y;
+    }
+
+    void onDragMove(const event::DragMove &e) override {
+        if (!module->isCtrlClick) {
+            float newDragX = APP->scene->rack->getMousePos().x;
+            float newDragY = APP->scene->rack->getMousePos().y;
+            setProbabilities(initX + (newDragX - dragX), initY + (newDragY - dragY));
         }
+    }
 
+    void setProbabilities(float currentX, float dragY) {
+        if (currentX < 0) currentX = 0;
+        int index = (int)(currentX / sliderWidth);
+        if (index >= NUM_OF_SLIDERS) index = NUM_OF_SLIDERS - 1;
+        if (dragY < 0) dragY = 0;
+        else if (dragY > box.size.y) dragY = box.size.y - SLIDER_TOP;
+        // module->seqs[seqId].gateProbabilities[index] = 1.0 - dragY / (box.size.y - SLIDER_TOP);
+        float prob = 1.0 - dragY / (box.size.y - SLIDER_TOP);
+        module->sendCommand(StochSeq4::SET_PROBABILITY, seqId, prob, index);
+    }
+
+    void toggleProbabilities(float currentX) {
+        if (currentX < 0) currentX = 0;
+        int index = (int)(currentX / sliderWidth);
+        if (index >= NUM_OF_SLIDERS) index = NUM_OF_SLIDERS - 1;
+        module->sendCommand(StochSeq4::TOGGLE_PROBABILITY, seqId, 0.0, index);
+    }
+
+    float getSliderHeight(int index) {
+        float y = box.size.y - SLIDER_TOP;
+        return y - (y * module->seqs[seqId].gateProbabilities[index]);
+    }
+
+    void step() override {
+        if (module)
+            sliderWidth = box.size.x / (float)module->params[StochSeq4::LENGTH_PARAM+seqId].getValue();
+        Widget::step();
+    }
+
+    // percentage texts for each slider, the sliders themselves are cached in StochSeq4Sliders
+    void draw(const DrawArgs& args) override {
+        if (module == NULL || !module->showPercentages) return;
+
+        int visibleSliders = (int)module->params[StochSeq4::LENGTH_PARAM+seqId].getValue();
+        nvgTextAlign(args.vg, NVG_ALIGN_CENTER);
+        nvgFontSize(args.vg, 9 + (sliderWidth / SLIDER_WIDTH));
+        for (int i = 0; i < visibleSliders; i++) {
+            float sHeight = getSliderHeight(i);
+            float w = i * sliderWidth;
+            float yText = sHeight;
+            nvgFillColor(args.vg, nvgRGB(255, 255, 255));
+            if (sHeight < SLIDER_TOP + 3) {
+                yText = (SLIDER_TOP * 2) + sHeight + 3;
+                nvgFillColor(args.vg, nvgRGB(0, 0, 0));
+            }
+            char probText[8];
+            snprintf(probText, sizeof(probText), "%d", static_cast<int>(module->seqs[seqId].gateProbabilities[i] * 100));
+            nvgText(args.vg, w + sliderWidth/2.0, yText, probText, NULL);
+        }
     }
 
     void drawLayer(const DrawArgs& args, int layer) override {
@@ -688,6 +1017,29 @@ struct StochSeq4Display : Widget {
                 nvgStroke(args.vg);
             }
 
+            // steps that are going to play in the next cycle
+            if (module->showUpcoming) {
+                Sequencer *seq = &module->seqs[seqId];
+                int visibleSliders = (int)module->params[StochSeq4::LENGTH_PARAM + seqId].getValue();
+                int next = module->resetMode ? 0 : seq->gateIndex + 1;
+                int *c;
+                switch (seqId) {
+                    case 0: c = getPurpleAsArray(); break;
+                    case 1: c = getBlueAsArray(); break;
+                    case 2: c = getAquaAsArray(); break;
+                    default: c = getRedAsArray();
+                }
+                nvgFillColor(args.vg, nvgRGB(c[0], c[1], c[2]));
+                for (int k = 0; k < visibleSliders; k++) {
+                    int step = (next + k) % visibleSliders;
+                    if (seq->lookahead.peek(k) < seq->gateProbabilities[step]) {
+                        nvgBeginPath(args.vg);
+                        nvgCircle(args.vg, (step + 0.5) * sliderWidth, box.size.y - 4, 2);
+                        nvgFill(args.vg);
+                    }
+                }
+            }
+
             // focus rect
             if (module->enableKBShortcuts) {
                 if (module->focusedSeq == seqId) {
@@ -722,6 +1074,15 @@ struct StochSeq4Widget : ModuleWidget {
         setModule(module);
         setPanel(createPanel(asset::plugin(pluginInstance, "res/StochSeq4.svg"), asset::plugin(pluginInstance, "res/StochSeq4-dark.svg")));
 
+        StochSeq4Sliders *slidersPurple = new StochSeq4Sliders();
+        slidersPurple->module = module;
+        slidersPurple->seqId = StochSeq4::PURPLE_SEQ;
+        slidersPurple->box.pos = Vec(277.6, 18.2);
+        slidersPurple->box.size = Vec(480, 80.7);
+        CachedLayer *layerPurple = createCachedLayer(slidersPurple);
+        if (module) layerPurple->getRevision = [=]() { return module->getDisplayRevision(StochSeq4::PURPLE_SEQ); };
+        addChild(layerPurple);
+
         StochSeq4Display *displayPurple = new StochSeq4Display();
         displayPurple->module = module;
         displayPurple->seqId = StochSeq4::PURPLE_SEQ;
@@ -729,6 +1090,15 @@ struct StochSeq4Widget : ModuleWidget {
         displayPurple->box.size = Vec(480, 80.7);
         addChild(displayPurple);
 
+        StochSeq4Sliders *slidersBlue = new StochSeq4Sliders();
+        slidersBlue->module = module;
+        slidersBlue->seqId = StochSeq4::BLUE_SEQ;
+        slidersBlue->box.pos = Vec(277.6, 105.7);
+        slidersBlue->box.size = Vec(480, 80.7);
+        CachedLayer *layerBlue = createCachedLayer(slidersBlue);
+        if (module) layerBlue->getRevision = [=]() { return module->getDisplayRevision(StochSeq4::BLUE_SEQ); };
+        addChild(layerBlue);
+
         StochSeq4Display *displayBlue = new StochSeq4Display();
         displayBlue->module = module;
         displayBlue->seqId = StochSeq4::BLUE_SEQ;
@@ -736,6 +1106,15 @@ struct StochSeq4Widget : ModuleWidget {
         displayBlue->box.size = Vec(480, 80.7);
         addChild(displayBlue);
 
+        StochSeq4Sliders *slidersAqua = new StochSeq4Sliders();
+        slidersAqua->module = module;
+        slidersAqua->seqId = StochSeq4::AQUA_SEQ;
+        slidersAqua->box.pos = Vec(277.6, 193.2);
+        slidersAqua->box.size = Vec(480, 80.7);
+        CachedLayer *layerAqua = createCachedLayer(slidersAqua);
+        if (module) layerAqua->getRevision = [=]() { return module->getDisplayRevision(StochSeq4::AQUA_SEQ); };
+        addChild(layerAqua);
+
         StochSeq4Display *displayAqua = new StochSeq4Display();
         displayAqua->module = module;
         displayAqua->seqId = StochSeq4::AQUA_SEQ;
@@ -743,6 +1122,15 @@ struct StochSeq4Widget : ModuleWidget {
         displayAqua->box.size = Vec(480, 80.7);
         addChild(displayAqua);
 
+        StochSeq4Sliders *slidersRed = new StochSeq4Sliders();
+        slidersRed->module = module;
+        slidersRed->seqId = StochSeq4::RED_SEQ;
+        slidersRed->box.pos = Vec(277.6, 280.6);
+        slidersRed->box.size = Vec(480, 80.7);
+        CachedLayer *layerRed = createCachedLayer(slidersRed);
+        if (module) layerRed->getRevision = [=]() { return module->getDisplayRevision(StochSeq4::RED_SEQ); };
+        addChild(layerRed);
+
         StochSeq4Display *displayRed = new StochSeq4Display();
         displayRed->module = module;
         displayRed->seqId = StochSeq4::RED_SEQ;
@@ -813,6 +1201,7 @@ struct StochSeq4Widget : ModuleWidget {
 
         addInput(createInputCentered<PJ301MPort>(Vec(119.4, 63.8), module, StochSeq4::MASTER_CLOCK_INPUT));
         addInput(createInputCentered<PJ301MPort>(Vec(151.7, 63.8), module, StochSeq4::RESET_INPUT));
+        addInput(createInputCentered<TinyPJ301M>(Vec(151.7, 321), module, StochSeq4::BANK_INPUT));
         for (int i = 0; i < 4; i++) {
             addInput(createInputCentered<TinyPJ301M>(Vec(119.4, 124.8 + (i * 57.3)), module, StochSeq4::RANDOM_INPUT + i));
             addInput(createInputCentered<TinyPJ301M>(Vec(151.7, 124.8 + (i * 57.3)), module, StochSeq4::INVERT_INPUT + i));
@@ -853,11 +1242,78 @@ struct StochSeq4Widget : ModuleWidget {
         menu->addChild(createIndexPtrSubmenuItem("Gate mode", {"Gates", "Triggers"}, &module->gateMode));
         menu->addChild(createIndexPtrSubmenuItem("V/OCT mode", {"Independent", "Sample and Hold"}, &module->voltMode));
         menu->addChild(createIndexPtrSubmenuItem("Volt Offset", {"±5V", "+10V"}, &module->voltRange));
+        menu->addChild(createBoolPtrMenuItem("Fixed random seed", "", &module->fixedSeed));
 
         menu->addChild(new MenuEntry);
 
         menu->addChild(createBoolPtrMenuItem("Slider Percentages", "", &module->showPercentages));
+        menu->addChild(createBoolPtrMenuItem("Upcoming Steps", "", &module->showUpcoming));
         menu->addChild(createBoolPtrMenuItem("Keyboard Shortcuts", "", &module->enableKBShortcuts));
+
+        menu->addChild(new MenuEntry);
+
+        // transforms the focused pattern
+        menu->addChild(createSubmenuItem("Transform pattern", "", [=](Menu *menu) {
+            menu->addChild(createMenuItem("Reverse", "", [=]() { module->sendCommand(StochSeq4::REVERSE_PATTERN, module->focusedSeq); }));
+            menu->addChild(createMenuItem("Augment", "", [=]() { module->sendCommand(StochSeq4::AUGMENT_PATTERN, module->focusedSeq); }));
+            menu->addChild(createMenuItem("Rotate left", RACK_MOD_CTRL_NAME "+←", [=]() { module->sendCommand(StochSeq4::ROTATE_PATTERN, module->focusedSeq, -1); }));
+            menu->addChild(createMenuItem("Rotate right", RACK_MOD_CTRL_NAME "+→", [=]() { module->sendCommand(StochSeq4::ROTATE_PATTERN, module->focusedSeq, 1); }));
+            menu->addChild(createMenuItem("More contrast", "", [=]() { module->sendCommand(StochSeq4::SCALE_PATTERN, module->focusedSeq, 1.25); }));
+            menu->addChild(createMenuItem("Less contrast", "", [=]() { module->sendCommand(StochSeq4::SCALE_PATTERN, module->focusedSeq, 0.8); }));
+            menu->addChild(createMenuItem("Threshold", "", [=]() { module->sendCommand(StochSeq4::THRESHOLD_PATTERN, module->focusedSeq); }));
+        }));
+
+        menu->addChild(createSubmenuItem("Pattern bank", "", [=](Menu *menu) {
+            if (module->bankPath.empty()) {
+                menu->addChild(createMenuLabel("No bank loaded"));
+            } else {
+                menu->addChild(createMenuLabel(string::f("%s (%d patterns)", system::getFilename(module->bankPath).c_str(), module->bankCount)));
+            }
+            if (!module->bankError.empty()) menu->addChild(createMenuLabel(module->bankError));
+            menu->addChild(createMenuItem("Load bank...", "", [=]() {
+                std::string path = choosePatternBankFile(OSDIALOG_OPEN, module->bankPath);
+                if (!path.empty()) module->loadBank(path);
+            }));
+            menu->addChild(createMenuItem("New bank with current patterns...", "", [=]() {
+                std::string path = choosePatternBankFile(OSDIALOG_SAVE, module->bankPath);
+                if (path.empty()) return;
+                if (system::exists(path)) {
+                    WARN("Pattern bank %s already exists", path.c_str());
+                    module->bankError = system::getFilename(path) + " already exists";
+                    return;
+                }
+                if (appendPatternRecord(path, module->getPatternRecord())) module->loadBank(path);
+                else module->bankError = "Couldn't write " + system::getFilename(path);
+            }));
+            menu->addChild(createMenuItem("Add current patterns", "", [=]() {
+                if (appendPatternRecord(module->bankPath, module->getPatternRecord())) module->loadBank(module->bankPath);
+                else module->bankError = "Couldn't write " + system::getFilename(module->bankPath);
+            }, module->bankPath.empty()));
+            menu->addChild(createMenuItem("Unload", "", [=]() {
+                module->unloadBank();
+                module->bankError = "";
+            }, module->bankPath.empty()));
+        }));
+
+        module->profiler.appendMenu(menu);
+    }
+
+    static std::string choosePatternBankFile(osdialog_file_action action, const std::string &current) {
+        std::string dir = current.empty() ? asset::user("") : system::getDirectory(current);
+        osdialog_filters *filters = osdialog_filters_parse("Pattern bank (.sbpb):sbpb");
+        char *pathC = osdialog_file(action, dir.c_str(), action == OSDIALOG_SAVE ? "patterns.sbpb" : NULL, filters);
+        osdialog_filters_free(filters);
+        if (!pathC) return "";
+        std::string path = pathC;
+        std::free(pathC);
+        if (action == OSDIALOG_SAVE && system::getExtension(path) != ".sbpb") path += ".sbpb";
+        return path;
+    }
+
+    void step() override {
+        StochSeq4 *module = dynamic_cast<StochSeq4 *>(this->module);
+        if (module) module->deleteOldBanks();
+        ModuleWidget::step();
     }
 
     void onHoverKey(const event::HoverKey &e) override {
@@ -875,12 +1331,12 @@ struct StochSeq4Widget : ModuleWidget {
 		} else if (e.key == GLFW_KEY_C && (e.mods & RACK_MOD_MASK) == RACK_MOD_CTRL) {
             e.consume(this);
             if (e.action == GLFW_PRESS) {
-                module->copyPatternToClipBoard();
+                module->sendCommand(StochSeq4::COPY_PATTERN, module->focusedSeq);
             }
         } else if (e.key == GLFW_KEY_V && (e.mods & RACK_MOD_MASK) == RACK_MOD_CTRL) {
             e.consume(this);
             if (e.action == GLFW_PRESS) {
-                module->pastePattern();
+                module->sendCommand(StochSeq4::PASTE_PATTERN, module->focusedSeq);
             }
         } else {
 			ModuleWidget::onHoverKey(e);
@@ -898,22 +1354,22 @@ struct StochSeq4Widget : ModuleWidget {
         if (e.key == GLFW_KEY_LEFT && (e.mods & RACK_MOD_MASK) == RACK_MOD_CTRL) {
 			e.consume(this);
 			if (e.action == GLFW_PRESS || e.action == GLFW_REPEAT) {
-				module->shiftPatternLeft(module->focusedSeq);
+				module->sendCommand(StochSeq4::ROTATE_PATTERN, module->focusedSeq, -1);
 			}
 		} else if (e.key == GLFW_KEY_RIGHT && (e.mods & RACK_MOD_MASK) == RACK_MOD_CTRL) {
 			e.consume(this);
 			if (e.action == GLFW_PRESS || e.action == GLFW_REPEAT) {
-                module->shiftPatternRight(module->focusedSeq);
+                module->sendCommand(StochSeq4::ROTATE_PATTERN, module->focusedSeq, 1);
             }
 		} else if (e.key == GLFW_KEY_UP && (e.mods & RACK_MOD_MASK) == RACK_MOD_CTRL) {
 			e.consume(this);
 			if (e.action == GLFW_PRESS || e.action == GLFW_REPEAT) {
-                module->shiftPatternUp(module->focusedSeq);
+                module->sendCommand(StochSeq4::SHIFT_PATTERN, module->focusedSeq, 1);
             }
 		} else if (e.key == GLFW_KEY_DOWN && (e.mods & RACK_MOD_MASK) == RACK_MOD_CTRL) {
 			e.consume(this);
 			if (e.action == GLFW_PRESS || e.action == GLFW_REPEAT) {
-                module->shiftPatternDown(module->focusedSeq);
+                module->sendCommand(StochSeq4::SHIFT_PATTERN, module->focusedSeq, -1);
             }
         }
 	}
@@ -32,9 +32,11 @@ struct StochSeq4X : Module {
     SequencerIds currentSeq = PURPLE_SEQ;
     bool isGate[NUM_SEQS] = {true, true, true, true};
     bool allStrips = false;
-    float outputValues[NUM_SEQS * NUM_OF_CHANNELS];
     // Expander
-    float leftMessages[2][NUM_SEQS * NUM_OF_CHANNELS] = {}; // messages from StochSeq4: 2 Gate values
+    StochSeq4Message leftMessages[2]; // messages from StochSeq4: step & gate of each seq
+    uint32_t lastSequence = 0;
+    int lastSwitches = -1;
+    bool wasParent = false;
 
     StochSeq4X() {
         config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
@@ -50,12 +52,21 @@ struct StochSeq4X : Module {
 			configOutput(GATES_OUTPUT + i, "Gate " + std::to_string(i+1));
 		}
 
-        leftExpander.producerMessage = leftMessages[0];
-        leftExpander.consumerMessage = leftMessages[1];
+        leftExpander.producerMessage = &leftMessages[0];
+        leftExpander.consumerMessage = &leftMessages[1];
+    }
+
+    // outputs are only written on a change, so after a bypass process() writes all of them again
+    void onReset() override {
+        lastSwitches = -1;
+    }
+
+    void onBypass(const BypassEvent &e) override {
+        lastSwitches = -1;
+    }
 
-        // for (int i = 0; i < 1 + NUM_OF_CHANNELS; i++) {
-        //     outputValues[i] = 0.0;
-        // }
+    void onUnBypass(const UnBypassEvent &e) override {
+        lastSwitches = -1;
     }
 
     void process(const ProcessArgs &args) override {
@@ -64,48 +75,58 @@ struct StochSeq4X : Module {
         currentSeq = (SequencerIds)params[TOGGLE_ALL_PARAMS].getValue();
         allStrips = currentSeq > RED_SEQ;
 
+        int switches = currentSeq;
         for (int i = 0; i < NUM_SEQS; i++) {
             isGate[i] = (params[TOGGLE_NOTGATE_PARAMS + i].getValue() == 0);
+            switches |= !isGate[i] << (3 + i);
         }
 
         bool isParent = (leftExpander.module && leftExpander.module->model == modelStochSeq4);
+        StochSeq4Message *message = isParent ? (StochSeq4Message *)(leftExpander.consumerMessage) : NULL;
 
-        if (isParent) {
-            float *outputFromParent = (float *)(leftExpander.consumerMessage);
-            memcpy(outputValues, outputFromParent, 4 * NUM_SEQS * NUM_OF_CHANNELS);
-        } else {
-            for (int i = 0; i < NUM_OF_CHANNELS * 4; i++) {
-                outputValues[i] = 0.0;
-            }
+        // outputs only get rewritten when the message or the switches change
+        bool changed = (isParent != wasParent) || (switches != lastSwitches);
+        if (isParent && message->sequence != lastSequence) {
+            changed = true;
         }
+        if (!changed) return;
+
+        wasParent = isParent;
+        lastSwitches = switches;
+        if (isParent) lastSequence = message->sequence;
 
         if (allStrips) {
             for (int i = 0, index = 0; i < NUM_SEQS; i++) {
                 for (int j = 0; j < 8; j++, index++) {
-                    int outputIndex = j + (i * NUM_OF_CHANNELS);
+                    float value = getGateValue(message, i, j);
                     if (isGate[i])
-                        outputs[GATES_OUTPUT + index].setVoltage(outputValues[outputIndex]);
+                        outputs[GATES_OUTPUT + index].setVoltage(value);
                     else if (isParent)
-                        outputs[GATES_OUTPUT + index].setVoltage(outputValues[outputIndex] > 0.0 ? 0.0 : 10.0);
+                        outputs[GATES_OUTPUT + index].setVoltage(value > 0.0 ? 0.0 : 10.0);
                     else
                         outputs[GATES_OUTPUT + index].setVoltage(0.0);
                 }
             }
         } else {
-            int start = currentSeq * NUM_OF_CHANNELS;
-            int end = start + NUM_OF_CHANNELS;
-            for (int i = start, j = 0; i < end; i++, j++) {
-                int isGateIndex = floor(j / 8);
+            for (int j = 0; j < NUM_OF_CHANNELS; j++) {
+                float value = getGateValue(message, currentSeq, j);
+                int isGateIndex = j / 8;
                 if (isGate[isGateIndex])
-                    outputs[GATES_OUTPUT + j].setVoltage(outputValues[i]);
+                    outputs[GATES_OUTPUT + j].setVoltage(value);
                 else if (isParent)
-                    outputs[GATES_OUTPUT + j].setVoltage(outputValues[i] > 0.0 ? 0.0 : 10.0);
+                    outputs[GATES_OUTPUT + j].setVoltage(value > 0.0 ? 0.0 : 10.0);
                 else
                     outputs[GATES_OUTPUT + j].setVoltage(0.0);
             }
         }
 
     }
+
+    float getGateValue(StochSeq4Message *message, int seq, int index) {
+        if (message == NULL) return 0.0;
+        bool gate = (message->gates >> seq) & 1;
+        return (gate && message->gateIndex[seq] == index) ? 10.0 : 0.0;
+    }
 };
 
 struct StochSeq4XDisplay : Widget {
@@ -1,10 +1,14 @@
 #include "plugin.hpp"
 
 #define SLIDER_TOP 4
-#define NUM_OF_CELLS 16
+#define GRID_SIZE 4 // cells per side of the knobs, the panel is laid out for 4
+#define NUM_OF_CELLS (GRID_SIZE * GRID_SIZE)
+#define MAX_GRID_SIZE 8 // the grid can be split into 8×8, 2×2 cells per knob
+#define MAX_CELLS (MAX_GRID_SIZE * MAX_GRID_SIZE)
 #define CELL_SIZE 67.5
 #define MARGIN 1
-#define MAX_SUBDIVISIONS 16
+#define MAX_SUBDIVISIONS 32 // one bit each in a cell's rhythm
+#define SUBDIVISION_RADIUS 22.0
 
 enum CellSequencerIds {
     PURPLE_SEQ,
@@ -27,10 +31,10 @@ struct SeqCell {
     int currentIndex = -1;
     int length = 16;
     NVGcolor color;
-    float phase = 0.0;
-    float subPhase = 0.0;
+    float phase = 0.0; // where it was in the cell, for saving & loading
     float rhythm = 1.0;
     float duration = 1.0;
+    float rhythmFraction = 1.0; // rhythm / duration
     float volts = 0.0;
     int cellRhythmIndex = 0;
     bool isOn = true;
@@ -38,100 +42,154 @@ struct SeqCell {
     bool clockGate = false;
     bool gateOn = false;
     CellSequencerIds id;
-    bool beatPulse[NUM_OF_CELLS][MAX_SUBDIVISIONS] = {};
+    int beatPulse = -1; // cell * MAX_SUBDIVISIONS + subdivision that's lit, so the GUI reads one int
     PathIds currentPath = DEFAULT_PATH;
-    int pathArray[NUM_OF_CELLS] = {};
+    int gridSize = GRID_SIZE;
+    int pathArray[MAX_CELLS] = {};
+
+    // the cell being played is worked out in samples when the sequence enters
+    // it and rescaled when the tempo changes. events are the starts & middles
+    // of its subdivisions, so process() only has to count up to the next one
+    enum Events {
+        NO_EVENT,
+        NEW_CELL,
+        STEP,
+        HALF_STEP
+    };
+    int cellIndex = 0;
+    int subdivision = 1;
+    const uint32_t *hits = NULL; // the cell's rhythm, one bit per subdivision
+    int eventIndex = 1; // odd ones are the middles of steps
+    float cellRate = 0.0; // cells per sample the schedule was made for
+    double cellSamples = 0.0; // 0 until there's a schedule
+    double halfStepSamples = 0.0;
+    double samplePos = 0.0; // since the start of the cell
+    double nextEvent = 0.0;
 
     dsp::PulseGenerator gatePulse;
+    Lookahead gateRolls;
+    Lookahead rhythmRolls;
+    FastRandom pathRandom;
 
-    SeqCell() {
-        for (int i = 0; i < NUM_OF_CELLS; i++)
-            for (int j = 0; j < MAX_SUBDIVISIONS; j++)
-                beatPulse[i][j] = false;
-    }
+    SeqCell() {}
 
     SeqCell(CellSequencerIds _id) {
         id = _id;
-
-        // set their arrays here because switch() won't let me do it there
-        if (id == PURPLE_SEQ) {
-            int tempArray[] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15};
-            std::copy(tempArray, tempArray + NUM_OF_CELLS, pathArray);
-        } else if (id == BLUE_SEQ) {
-            int tempArray[] = {3, 7, 11, 15, 2, 6, 10, 14, 1, 5, 9, 13, 0, 4, 8, 12};
-            std::copy(tempArray, tempArray + NUM_OF_CELLS, pathArray);
-        } else if (id == AQUA_SEQ) {
-            int tempArray[] = {12, 8, 4, 0, 13, 9, 5, 1, 14, 10, 6, 2, 15, 11, 7, 3};
-            std::copy(tempArray, tempArray + NUM_OF_CELLS, pathArray);
-        } else if (id == RED_SEQ) {
-            int tempArray[] = {15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0};
-            std::copy(tempArray, tempArray + NUM_OF_CELLS, pathArray);
-        }
+        layout(GRID_SIZE);
+        currentCellX = resetPos.x;
+        currentCellY = resetPos.y;
 
         switch (id) {
             case PURPLE_SEQ:
-                currentCellX = -1;
-                currentCellY = 0;
-                startPos = Vec(0, 0);
-                resetPos = Vec(-1, 0);
                 color = getPurple();
                 break;
             case BLUE_SEQ:
-                currentCellX = 3;
-                currentCellY = -1;
-                startPos = Vec(3, 0);
-                resetPos = Vec(3, -1);
                 color = getBlue();
                 break;
             case AQUA_SEQ:
-                currentCellX = 0;
-                currentCellY = 4;
-                startPos = Vec(0, 3);
-                resetPos = Vec(0, 4);
                 color = getAqua();
                 break;
             case RED_SEQ:
-                currentCellX = 4;
-                currentCellY = 3;
-                startPos = Vec(3, 3);
-                resetPos = Vec(4, 3);
                 color = getRed();
                 break;
             default:
                 break;
         }
+        cellIndex = getCurrentCellIndex();
+    }
+
+    // the order it walks a size × size grid in & where it starts
+    void layout(int size) {
+        gridSize = size;
+        const int last = size - 1;
+        const int numCells = size * size;
+
+        for (int i = 0; i < numCells; i++) {
+            int major = i / size;
+            int minor = i % size;
+            switch (id) {
+                case PURPLE_SEQ: // rows from the top left
+                    pathArray[i] = minor + major * size;
+                    break;
+                case BLUE_SEQ: // columns from the top right
+                    pathArray[i] = (last - major) + minor * size;
+                    break;
+                case AQUA_SEQ: // columns from the bottom left
+                    pathArray[i] = major + (last - minor) * size;
+                    break;
+                case RED_SEQ: // rows from the bottom right
+                    pathArray[i] = numCells - 1 - i;
+                    break;
+                default:
+                    break;
+            }
+        }
+
+        switch (id) {
+            case PURPLE_SEQ:
+                startPos = Vec(0, 0);
+                resetPos = Vec(-1, 0);
+                break;
+            case BLUE_SEQ:
+                startPos = Vec(last, 0);
+                resetPos = Vec(last, -1);
+                break;
+            case AQUA_SEQ:
+                startPos = Vec(0, last);
+                resetPos = Vec(0, size);
+                break;
+            case RED_SEQ:
+                startPos = Vec(last, last);
+                resetPos = Vec(size, last);
+                break;
+            default:
+                break;
+        }
+    }
+
+    // stays on the same part of the grid when it's split or merged
+    void setGridSize(int size) {
+        auto rescaleCell = [=](int c) {
+            if (c < 0) return -1;
+            if (c >= gridSize) return size;
+            return c * size / gridSize;
+        };
+        currentCellX = rescaleCell(currentCellX);
+        currentCellY = rescaleCell(currentCellY);
+        layout(size);
+        cellIndex = getCurrentCellIndex();
     }
 
     void doDefaultPath() {
         switch(id) {
             case PURPLE_SEQ:
                 currentCellX++;
-                if (currentCellX >= 4) {
+                if (currentCellX >= gridSize) {
                     currentCellX = 0;
-                    currentCellY = (currentCellY + 1) % 4;
+                    currentCellY = (currentCellY + 1) % gridSize;
                 }
                 break;
             case BLUE_SEQ:
                 currentCellY++;
-                if (currentCellY >= 4) {
+                if (currentCellY >= gridSize) {
                     currentCellY = 0;
                     currentCellX--;
-                    if (currentCellX < 0) currentCellX = 3;
+                    if (currentCellX < 0) currentCellX = gridSize - 1;
                 }
                 break;
             case AQUA_SEQ:
                 currentCellY--;
                 if (currentCellY < 0) {
-                    currentCellY = 3;
-                    currentCellX = (currentCellX + 1) % 4;
+                    currentCellY = gridSize - 1;
+                    currentCellX = (currentCellX + 1) % gridSize;
                 }
                 break;
             case RED_SEQ:
                 currentCellX--;
                 if (currentCellX < 0) {
-                    currentCellX = 3;
+                    currentCellX = gridSize - 1;
                     currentCellY--;
-                    if (currentCellY < 0) currentCellY = 3;
+                    if (currentCellY < 0) currentCellY = gridSize - 1;
                 }
                 break;
             default:
@@ -147,7 +205,8 @@ struct SeqCell {
     }
 
     void doRandomPath() {
-        int rIndex = pathArray[randRange(length)];
+        // a length past the number of cells picks from all of them
+        int rIndex = pathArray[static_cast<int>(pathRandom.uniform() * std::min(length, gridSize * gridSize))];
         Vec pos = getXYfromIndex(rIndex);
         currentCellX = pos.x;
         currentCellY = pos.y;
@@ -156,7 +215,7 @@ struct SeqCell {
     }
 
     void doRandomWalkPath() {
-        int dir = randRange(5);
+        int dir = static_cast<int>(pathRandom.uniform() * 5);
         switch (dir) {
             case 1:
                 currentCellY -= 1;
@@ -176,9 +235,9 @@ struct SeqCell {
 
         // bounce of edges
         if (currentCellX < 0) currentCellX = 1;
-        else if (currentCellX > 3) currentCellX = 2;
+        else if (currentCellX >= gridSize) currentCellX = gridSize - 2;
         if (currentCellY < 0) currentCellY = 1;
-        else if (currentCellY > 3) currentCellY = 2;
+        else if (currentCellY >= gridSize) currentCellY = gridSize - 2;
 
         cellRhythmIndex = 0;
         currentIndex = (currentIndex + 1) % length;
@@ -194,8 +253,84 @@ struct SeqCell {
         }
     }
 
+    // call after moving to a new cell
+    void schedule(int _subdivision, const uint32_t *_hits) {
+        cellIndex = getCurrentCellIndex();
+        subdivision = _subdivision;
+        hits = _hits;
+        eventIndex = 1;
+        halfStepSamples = cellSamples / (2 * subdivision);
+        nextEvent = halfStepSamples;
+    }
+
+    // a merge can change the rhythm of the cell it's in the middle of, the
+    // rest of the cell is scheduled for the new one from where it is now
+    void setSubdivision(int _subdivision) {
+        if (_subdivision == subdivision) return;
+        subdivision = _subdivision;
+        if (cellSamples <= 0.0) return;
+        eventIndex = (int)(samplePos / cellSamples * 2 * subdivision) + 1;
+        cellRhythmIndex = (eventIndex - 1) / 2;
+        halfStepSamples = cellSamples / (2 * subdivision);
+        nextEvent = eventIndex * halfStepSamples;
+    }
+
+    void setRate(float rate) {
+        double newCellSamples = 1.0 / rate;
+        if (cellSamples > 0.0) {
+            samplePos *= newCellSamples / cellSamples;
+        } else {
+            // first schedule, like after loading a patch
+            samplePos = phase * newCellSamples;
+            eventIndex = (int)(phase * 2 * subdivision) + 1;
+            cellRhythmIndex = (eventIndex - 1) / 2;
+        }
+        cellRate = rate;
+        cellSamples = newCellSamples;
+        halfStepSamples = cellSamples / (2 * subdivision);
+        nextEvent = eventIndex * halfStepSamples;
+    }
+
+    Events tick() {
+        samplePos += 1.0;
+        if (samplePos < nextEvent) return NO_EVENT;
+
+        if (eventIndex >= 2 * subdivision) {
+            samplePos -= cellSamples;
+            return NEW_CELL; // the caller moves on and calls schedule()
+        }
+        Events event;
+        if (eventIndex & 1) {
+            // steps without a hit don't change the gate so they're skipped
+            event = HALF_STEP;
+            eventIndex = 2 * getNextHit(eventIndex / 2 + 1);
+        } else {
+            event = STEP;
+            cellRhythmIndex = eventIndex / 2;
+            eventIndex++;
+        }
+        nextEvent = eventIndex * halfStepSamples;
+        return event;
+    }
+
+    // the first subdivision from i on that plays, or the end of the cell
+    int getNextHit(int i) {
+        if (!playCellRhythms || hits == NULL || i >= subdivision) return subdivision;
+        uint32_t mask = subdivision < 32 ? (1u << subdivision) - 1 : ~0u;
+        uint32_t rest = *hits & mask & (~0u << i);
+        return rest ? __builtin_ctz(rest) : subdivision;
+    }
+
+    float getPhase() {
+        return cellSamples > 0.0 ? samplePos / cellSamples : phase;
+    }
+
     void setBeatPulse() {
-        beatPulse[getCurrentCellIndex()][cellRhythmIndex] = gateOn && clockGate;
+        beatPulse = (gateOn && clockGate) ? cellIndex * MAX_SUBDIVISIONS + cellRhythmIndex : -1;
+    }
+
+    bool isPulsing(int cell, int i) {
+        return beatPulse == cell * MAX_SUBDIVISIONS + i;
     }
 
     void reset() {
@@ -204,7 +339,7 @@ struct SeqCell {
         currentIndex = 0;
         cellRhythmIndex = 0;
         phase = 0.0;
-        subPhase = 0.0;
+        samplePos = 0.0;
     }
 
     Vec getStartPos() {
@@ -212,11 +347,11 @@ struct SeqCell {
     }
 
     int getCurrentCellIndex() {
-        return clamp(currentCellX, 0, 3) + clamp(currentCellY, 0, 3) * 4;
+        return clamp(currentCellX, 0, gridSize - 1) + clamp(currentCellY, 0, gridSize - 1) * gridSize;
     }
 
     Vec getXYfromIndex(int _index) {
-        return Vec(_index % 4, (int)(_index / 4));
+        return Vec(_index % gridSize, (int)(_index / gridSize));
     }
 };
 
@@ -271,15 +406,20 @@ struct StochSeqGrid : Module {
     };
 
     dsp::SchmittTrigger toggleTrig;
+    LightDivider lightDivider;
     dsp::SchmittTrigger resetTrig;
-    dsp::SchmittTrigger bpmInputTrig;
+    ClockFollower clockFollower;
     dsp::PulseGenerator gatePulse;
 
+    enum PerfPhases {
+        CONTROLS_PHASE,
+        SEQUENCERS_PHASE,
+        NUM_PERF_PHASES
+    };
+    Profiler<NUM_PERF_PHASES> profiler{"Controls & patterns", "Sequencers & outputs"};
+
     int bpmInputMode = BPM_CV;
-    int ppqn = 0;
-    float period = 0.0;
     float timeOut = 1.0; // seconds
-    int extPulseIndex = 0;
     int gateMode = GATE_MODE;
     int currentCellX = -1;
     int currentCellY = -1;
@@ -295,9 +435,60 @@ struct StochSeqGrid : Module {
     int hoverCell = 0;
 
     SeqCell *seqs = new SeqCell[NUM_SEQ];
-    int *subdivisions = new int[NUM_OF_CELLS];
-    bool beats[NUM_OF_CELLS][MAX_SUBDIVISIONS] = {};
-    bool beatPulse[NUM_OF_CELLS][MAX_SUBDIVISIONS] = {};
+    enum ControlIds {
+        CLOCK_TOGGLE_CONTROL,
+        PATTERN_CONTROL,
+        BPM_CONTROL,
+        ON_CONTROLS,
+        RHYTHM_CONTROLS = ON_CONTROLS + NUM_SEQ,
+        DUR_CONTROLS = RHYTHM_CONTROLS + NUM_SEQ,
+        PATHS_CONTROLS = DUR_CONTROLS + NUM_SEQ,
+        LENGTH_CONTROLS = PATHS_CONTROLS + NUM_SEQ,
+        NUM_CONTROLS = LENGTH_CONTROLS + NUM_SEQ
+    };
+    ControlRate<NUM_CONTROLS> controls;
+
+    // shows the length in cells, which is 4 per knob step on the 8×8 grid
+    struct LengthQuantity : ParamQuantity {
+        int getScale() {
+            return module ? static_cast<StochSeqGrid *>(module)->getLengthScale() : 1;
+        }
+
+        float getDisplayValue() override {
+            return ParamQuantity::getDisplayValue() * getScale();
+        }
+
+        void setDisplayValue(float value) override {
+            ParamQuantity::setDisplayValue(std::round(value / getScale()));
+        }
+    };
+
+    float bpmFreq = 2.0; // Hz, from the BPM knob
+    FastRandom patternRandom; // the RND input & random patterns
+    uint64_t seed = random::u64();
+    bool fixedSeed = false; // saved with the patch so it plays the same every time
+    int gridSize = GRID_SIZE; // cells per side
+
+    // edits from the cells & the menu, applied at the start of process()
+    enum CommandIds {
+        ADD_SUBDIVISIONS,
+        DOUBLE_SUBDIVISIONS,
+        SET_BEAT,
+        SET_GRID_SIZE,
+        NUM_COMMANDS
+    };
+    struct Command {
+        int type;
+        int cell;
+        int index;
+        int value;
+    };
+    CommandQueue<Command, 64> commands;
+    int *subdivisions = new int[MAX_CELLS];
+    uint32_t beats[MAX_CELLS] = {}; // bit i is whether subdivision i plays
+    // goes up whenever the subdivisions, beats or grid size change, so the
+    // cells know to redraw
+    std::atomic<uint32_t> revision{0};
     bool isCtrlClick = false;
     bool resetMode = false;
     bool isFirstTime = false;
@@ -315,10 +506,10 @@ struct StochSeqGrid : Module {
             "left→right", "top→bottom", "corner→out", "out→corner",
             "random duple", "random triple", "gradual random", "uniform random",
         });
-        configParam(LENGTH_PARAMS + PURPLE_SEQ, 1, 16, 4, "Purple seq length");
-        configParam(LENGTH_PARAMS + BLUE_SEQ, 1, 16, 4, "Blue seq length");
-        configParam(LENGTH_PARAMS + AQUA_SEQ, 1, 16, 4, "Aqua seq length");
-        configParam(LENGTH_PARAMS + RED_SEQ, 1, 16, 4, "Red seq length");
+        configParam<LengthQuantity>(LENGTH_PARAMS + PURPLE_SEQ, 1, NUM_OF_CELLS, 4, "Purple seq length");
+        configParam<LengthQuantity>(LENGTH_PARAMS + BLUE_SEQ, 1, NUM_OF_CELLS, 4, "Blue seq length");
+        configParam<LengthQuantity>(LENGTH_PARAMS + AQUA_SEQ, 1, NUM_OF_CELLS, 4, "Aqua seq length");
+        configParam<LengthQuantity>(LENGTH_PARAMS + RED_SEQ, 1, NUM_OF_CELLS, 4, "Red seq length");
         configSwitch(PATHS_PARAM + PURPLE_SEQ, 0, 2, 0, "Purple path", {"default", "random", "random walk"});
         configSwitch(PATHS_PARAM + BLUE_SEQ, 0, 2, 0, "Blue path", {"default", "random", "random walk"});
         configSwitch(PATHS_PARAM + AQUA_SEQ, 0, 2, 0, "Aqua path", {"default", "random", "random walk"});
@@ -361,14 +552,36 @@ struct StochSeqGrid : Module {
             configParam(CELL_PROB_PARAM + i, 0.0, 1.0, 1.0, "Cell Probability", "%", 0, 100);
             configParam(CV_PARAM + i, -10.0, 10.0, 0.0, "Cell CV", " V");
             configParam(SUBDIVISION_PARAM + i, 0.0, 1.0, 1.0, "Rhythm Probability", "%", 0, 100);
+        }
+        for (int i = 0; i < MAX_CELLS; i++) {
             subdivisions[i] = 1;
-            for (int j = 0; j < MAX_SUBDIVISIONS; j++) {
-                beats[i][j] = true;
-                beatPulse[i][j] = false;
-            }
+            beats[i] = ~0u;
+        }
+
+        reseed();
+
+        controls.configParam(CLOCK_TOGGLE_CONTROL, CLOCK_TOGGLE_PARAM);
+        controls.configParam(PATTERN_CONTROL, PATTERN_PARAM);
+        controls.configParam(BPM_CONTROL, BPM_PARAM);
+        for (int i = 0; i < NUM_SEQ; i++) {
+            controls.configParam(ON_CONTROLS + i, ON_PARAMS + i);
+            controls.configParam(RHYTHM_CONTROLS + i, RHYTHM_PARAMS + i);
+            controls.configParam(DUR_CONTROLS + i, DUR_PARAMS + i);
+            controls.configParam(PATHS_CONTROLS + i, PATHS_PARAM + i);
+            controls.configParam(LENGTH_CONTROLS + i, LENGTH_PARAMS + i);
         }
     }
 
+    // every sequence gets its own streams from the one seed
+    void reseed() {
+        for (int i = 0; i < NUM_SEQ; i++) {
+            seqs[i].gateRolls.seed(seed + i * 3);
+            seqs[i].rhythmRolls.seed(seed + i * 3 + 1);
+            seqs[i].pathRandom.seed(seed + i * 3 + 2);
+        }
+        patternRandom.seed(seed + NUM_SEQ * 3);
+    }
+
     ~StochSeqGrid() {
         delete[] subdivisions;
         delete[] seqs;
@@ -378,85 +591,86 @@ struct StochSeqGrid : Module {
         json_t *rootJ = json_object();
 
         json_t *subdivisionsJ = json_array();
-        json_t *cellBeatsJ = json_array();
 
-        for (int i = 0; i < NUM_OF_CELLS; i++) {
+        for (int i = 0; i < getNumCells(); i++) {
             json_t *subJ = json_integer(subdivisions[i]);
             json_array_append_new(subdivisionsJ, subJ);
-
-            json_t *beatsJ = json_array();
-            for (int j = 0; j < MAX_SUBDIVISIONS; j++) {
-                json_t *beatJ = json_boolean(beats[i][j]);
-                json_array_append_new(beatsJ, beatJ);
-            }
-            json_array_append_new(cellBeatsJ, beatsJ);
         }
 
         json_t *seqPhasesJ = json_array();
-        json_t *seqSubPhasesJ = json_array();
         json_t *seqCurrentXJ = json_array();
         json_t *seqCurrentYJ = json_array();
         json_t *seqCurrentIndexJ = json_array();
 
         for (int i = 0; i < NUM_SEQ; i++) {
-            json_t *seqPhaseJ = json_real(seqs[i].phase);
-            json_t *seqSubPhaseJ = json_real(seqs[i].subPhase);
+            json_t *seqPhaseJ = json_real(seqs[i].getPhase());
             json_t *currentXJ = json_integer(seqs[i].currentCellX);
             json_t *currentYJ = json_integer(seqs[i].currentCellY);
             json_t *currentIndexJ = json_integer(seqs[i].currentIndex);
 
             json_array_append_new(seqPhasesJ, seqPhaseJ);
-            json_array_append_new(seqSubPhasesJ, seqSubPhaseJ);
             json_array_append_new(seqCurrentXJ, currentXJ);
             json_array_append_new(seqCurrentYJ, currentYJ);
             json_array_append_new(seqCurrentIndexJ, currentIndexJ);
         }
 
         json_object_set_new(rootJ, "phases", seqPhasesJ);
-        json_object_set_new(rootJ, "subPhases", seqSubPhasesJ);
         json_object_set_new(rootJ, "seqCurrentX", seqCurrentXJ);
         json_object_set_new(rootJ, "seqCurrentY", seqCurrentYJ);
         json_object_set_new(rootJ, "seqCurrentIndex", seqCurrentIndexJ);
 
-        json_object_set_new(rootJ, "beats", cellBeatsJ);
+        setDataVersion(rootJ);
+        json_object_set_new(rootJ, "gridSize", json_integer(gridSize));
+        json_object_set_new(rootJ, "beats", packMasks(beats, getNumCells()));
         json_object_set_new(rootJ, "subdivisions", subdivisionsJ);
         json_object_set_new(rootJ, "gateMode", json_integer(gateMode));
         json_object_set_new(rootJ, "voltMode", json_integer(voltMode));
         json_object_set_new(rootJ, "currentPattern", json_integer(currentPattern));
         json_object_set_new(rootJ, "bpmInputMode", json_integer(bpmInputMode));
+        json_object_set_new(rootJ, "clockSmoothing", json_integer(clockFollower.smoothing));
         json_object_set_new(rootJ, "run", json_boolean(clockOn));
         json_object_set_new(rootJ, "mouseDrag", json_boolean(useMouseDeltaY));
         json_object_set_new(rootJ, "displayCircles", json_boolean(displayCircles));
+        if (fixedSeed)
+            json_object_set_new(rootJ, "seed", json_integer((json_int_t)seed));
         json_object_set_new(rootJ, "overrideExtClk", json_boolean(overrideExtClk));
+        setProfilerJson(rootJ, profiler);
 
         return rootJ;
     }
 
     void dataFromJson(json_t *rootJ) override {
+        int version = getDataVersion(rootJ);
+
+        // patches from before the 8×8 grid don't have it
+        json_t *gridSizeJ = json_object_get(rootJ, "gridSize");
+        setGridSize((gridSizeJ && json_integer_value(gridSizeJ) == MAX_GRID_SIZE) ? MAX_GRID_SIZE : GRID_SIZE);
+
         json_t *subdivisionsJ = json_object_get(rootJ, "subdivisions");
 		if (subdivisionsJ) {
-			for (int i = 0; i < NUM_OF_CELLS; i++) {
+			for (int i = 0; i < getNumCells(); i++) {
 				json_t *subJ = json_array_get(subdivisionsJ, i);
 				if (subJ)
-					subdivisions[i] = json_integer_value(subJ);
+					subdivisions[i] = clamp((int)json_integer_value(subJ), 1, MAX_SUBDIVISIONS);
 			}
 		}
 
         json_t *cellBeatsJ = json_object_get(rootJ, "beats");
-        if (cellBeatsJ) {
+        if (version >= 2) {
+            unpackMasks(cellBeatsJ, beats, getNumCells());
+        } else if (cellBeatsJ) {
             for (int i = 0; i < NUM_OF_CELLS; i++) {
                 json_t *beatsJ = json_array_get(cellBeatsJ, i);
 
                 for (int j = 0; j < MAX_SUBDIVISIONS; j++) {
                     json_t *beatJ = json_array_get(beatsJ, j);
                     if (beatJ) 
-                        beats[i][j] = json_boolean_value(beatJ);
+                        setBeat(i, j, json_boolean_value(beatJ));
                 }
             }
         }
 
         json_t *seqPhasesJ = json_object_get(rootJ, "phases");
-        json_t *seqSubPhasesJ = json_object_get(rootJ, "subPhases");
         json_t *seqCurrentXJ = json_object_get(rootJ, "seqCurrentX");
         json_t *seqCurrentYJ = json_object_get(rootJ, "seqCurrentY");
         json_t *seqCurrentIndexJ = json_object_get(rootJ, "seqCurrentIndex");
@@ -466,10 +680,6 @@ struct StochSeqGrid : Module {
                 if (seqPhaseJ)
                     seqs[i].phase = json_real_value(seqPhaseJ);
 
-                json_t *seqSubPhaseJ = json_array_get(seqSubPhasesJ, i);
-                if (seqSubPhaseJ)
-                    seqs[i].subPhase = json_real_value(seqSubPhaseJ);
-
                 json_t *currentXJ = json_array_get(seqCurrentXJ, i);
                 if (currentXJ)
                     seqs[i].currentCellX = json_integer_value(currentXJ);
@@ -484,6 +694,14 @@ struct StochSeqGrid : Module {
             }
         }
 
+        // the schedules get rebuilt from the loaded phases
+        for (int i = 0; i < NUM_SEQ; i++) {
+            seqs[i].cellIndex = seqs[i].getCurrentCellIndex();
+            seqs[i].subdivision = subdivisions[seqs[i].cellIndex];
+            seqs[i].cellSamples = 0.0;
+            seqs[i].cellRate = 0.0;
+        }
+
         json_t *gateModeJ = json_object_get(rootJ, "gateMode");
         if (gateModeJ)
             gateMode = json_integer_value(gateModeJ);
@@ -500,6 +718,9 @@ struct StochSeqGrid : Module {
         if (bpmInputModeJ)
             bpmInputMode = json_integer_value(bpmInputModeJ);
 
+        json_t *clockSmoothingJ = json_object_get(rootJ, "clockSmoothing");
+        if (clockSmoothingJ) clockFollower.smoothing = json_integer_value(clockSmoothingJ);
+
         json_t *runJ = json_object_get(rootJ, "run");
         if (runJ) 
             clockOn = json_boolean_value(runJ);
@@ -512,9 +733,21 @@ struct StochSeqGrid : Module {
         if (displayCirclesJ)
             displayCircles = json_boolean_value(displayCirclesJ);
 
+        json_t *seedJ = json_object_get(rootJ, "seed");
+        if (seedJ) {
+            fixedSeed = true;
+            seed = (uint64_t)json_integer_value(seedJ);
+            reseed();
+        } else {
+            fixedSeed = false;
+            seed = random::u64();
+            reseed();
+        }
+
         json_t *overrideExtClkJ = json_object_get(rootJ, "overrideExtClk");
         if (overrideExtClkJ)
             overrideExtClk = json_boolean_value(overrideExtClkJ);
+        cellsChanged();
     }
 
     void onReset() override {
@@ -522,11 +755,110 @@ struct StochSeqGrid : Module {
     }
 
     Vec getXYfromIndex(int _index) {
-        int x = _index % 4;
-        int y = _index / 4;
+        int x = _index % gridSize;
+        int y = _index / gridSize;
         return Vec(x, y);
     }
 
+    int getNumCells() {
+        return gridSize * gridSize;
+    }
+
+    // the length knobs count knobs' worth of cells, so they cover the whole
+    // grid at either size
+    int getLengthScale() {
+        return (gridSize / GRID_SIZE) * (gridSize / GRID_SIZE);
+    }
+
+    // the knobs are always 4×4, in an 8×8 grid each one is for a 2×2 block
+    int getKnobIndex(int cell) {
+        int scale = gridSize / GRID_SIZE;
+        return (cell % gridSize) / scale + (cell / gridSize) / scale * GRID_SIZE;
+    }
+
+    // splits every cell into a 2×2 block with the same rhythm, or merges
+    // them keeping the top left one's
+    void setGridSize(int size) {
+        if (size == gridSize) return;
+        int oldSubdivisions[MAX_CELLS];
+        uint32_t oldBeats[MAX_CELLS];
+        std::memcpy(oldSubdivisions, subdivisions, sizeof(oldSubdivisions));
+        std::memcpy(oldBeats, beats, sizeof(oldBeats));
+        for (int y = 0; y < size; y++) {
+            for (int x = 0; x < size; x++) {
+                int old = x * gridSize / size + (y * gridSize / size) * gridSize;
+                subdivisions[x + y * size] = oldSubdivisions[old];
+                beats[x + y * size] = oldBeats[old];
+            }
+        }
+
+        for (int i = 0; i < NUM_SEQ; i++) {
+            seqs[i].setGridSize(size);
+            // the cell it's in the middle of plays the rhythm it has now
+            if (seqs[i].hits) seqs[i].hits = &beats[seqs[i].cellIndex];
+            seqs[i].setSubdivision(subdivisions[seqs[i].cellIndex]);
+        }
+        gridSize = size;
+        hoverCell = std::min(hoverCell, getNumCells() - 1);
+        cellsChanged();
+    }
+
+    // GUI thread only
+    void sendCommand(int type, int cell, int index = 0, int value = 0) {
+        commands.push({type, cell, index, value});
+    }
+
+    void applyCommand(const Command &command) {
+        if (command.type == SET_GRID_SIZE) {
+            setGridSize(command.value == MAX_GRID_SIZE ? MAX_GRID_SIZE : GRID_SIZE);
+            return;
+        }
+        // the grid size could have changed since the click
+        if (command.cell < 0 || command.cell >= getNumCells()) return;
+        int &sub = subdivisions[command.cell];
+        switch (command.type) {
+            case ADD_SUBDIVISIONS:
+                sub = clamp(sub + command.value, 1, MAX_SUBDIVISIONS);
+                break;
+            case DOUBLE_SUBDIVISIONS:
+                if (sub * 2 <= MAX_SUBDIVISIONS) sub *= 2;
+                break;
+            case SET_BEAT:
+                if (command.index >= 0 && command.index < MAX_SUBDIVISIONS) setBeat(command.cell, command.index, command.value);
+                break;
+        }
+        cellsChanged();
+    }
+
+    bool getBeat(int cell, int i) {
+        return (beats[cell] >> i) & 1;
+    }
+
+    void setBeat(int cell, int i, bool on) {
+        if (on) beats[cell] |= 1u << i;
+        else beats[cell] &= ~(1u << i);
+    }
+
+    void cellsChanged() {
+        revision.fetch_add(1, std::memory_order_release);
+    }
+
+    // changes whenever a cell's circles have to be redrawn. the knob & the
+    // display setting aren't set by process(), so they're checked on their own
+    uint32_t getCellRevision(int index) {
+        float subdivisionParam = params[SUBDIVISION_PARAM + getKnobIndex(index)].getValue();
+        uint32_t hash = hashState(&subdivisionParam, sizeof(subdivisionParam), revision.load(std::memory_order_acquire));
+        return hashState(&displayCircles, sizeof(displayCircles), hash);
+    }
+
+    uint32_t getOverlayRevision() {
+        float probs[NUM_OF_CELLS];
+        for (int i = 0; i < NUM_OF_CELLS; i++) {
+            probs[i] = params[CELL_PROB_PARAM + i].getValue();
+        }
+        return hashState(&gridSize, sizeof(gridSize), hashState(probs, sizeof(probs)));
+    }
+
     void genPatterns(int patt) {
         // if (patt <= 16) {
         //     float prob = fmod(patt, 1);
@@ -543,92 +875,69 @@ struct StochSeqGrid : Module {
         // }
 
 
+        int numCells = getNumCells();
         switch (patt) {
             case 1: 
             case 2:
             case 3:
-                for (int i = 0; i < NUM_OF_CELLS; i++) {
+                for (int i = 0; i < numCells; i++) {
                     subdivisions[i] = currentPattern;
                 }
                 break;
             case 4:
-                for (int i = 0; i < NUM_OF_CELLS; i++) {
+                for (int i = 0; i < numCells; i++) {
                     subdivisions[i] = 5;
                 }
                 break;
             case 5:
-                for (int i = 0; i < NUM_OF_CELLS; i++) {
-                    if (i == 5 || i == 6 || i == 9 || i == 10) 
-                        subdivisions[i] = 3;
-                    else
-                        subdivisions[i] = 1;
+                for (int i = 0; i < numCells; i++) {
+                    subdivisions[i] = isInsideCell(i) ? 3 : 1;
                 }
                 break;
             case 6:
-                for (int i = 0; i < NUM_OF_CELLS; i++) {
-                    if (i == 5 || i == 6 || i == 9 || i == 10) 
-                        subdivisions[i] = 1;
-                    else
-                        subdivisions[i] = 3;
+                for (int i = 0; i < numCells; i++) {
+                    subdivisions[i] = isInsideCell(i) ? 1 : 3;
                 }
                 break;
             case 7:
-                for (int i = 0; i < NUM_OF_CELLS; i++) {
-                    if (i == 5 || i == 6 || i == 9 || i == 10) 
-                        subdivisions[i] = 4;
-                    else
-                        subdivisions[i] = 1;
+                for (int i = 0; i < numCells; i++) {
+                    subdivisions[i] = isInsideCell(i) ? 4 : 1;
                 }
                 break;
             case 8:
-                for (int i = 0; i < NUM_OF_CELLS; i++) {
-                    if (i == 5 || i == 6 || i == 9 || i == 10) 
-                        subdivisions[i] = 1;
-                    else
-                        subdivisions[i] = 4;
+                for (int i = 0; i < numCells; i++) {
+                    subdivisions[i] = isInsideCell(i) ? 1 : 4;
                 }
                 break;
             case 9:
-                for (int i = 0; i < NUM_OF_CELLS; i++) {
+                for (int i = 0; i < numCells; i++) {
                     // subdivisions[i] = (i % 4) + 1;
-                    int s = i % 4;
+                    int s = (i % gridSize) * GRID_SIZE / gridSize;
                     subdivisions[i] = s < 3 ? s + 1 : s + 2;
                 }
                 break;
             case 10:
-                for (int i = 0; i < NUM_OF_CELLS; i++) {
+                for (int i = 0; i < numCells; i++) {
                     // subdivisions[i] = static_cast<int>(i / 4) + 1;
-                    int s = static_cast<int>(i / 4);
+                    int s = (i / gridSize) * GRID_SIZE / gridSize;
                     subdivisions[i] = s < 3 ? s + 1 : s + 2;
                 }
                 break;
             case 11:
-                for (int i = 0; i < NUM_OF_CELLS; i++) {
-                    if (i == 0)
-                        subdivisions[i] = 1;
-                    else if (i == 1 || i == 4 || i == 5)
-                        subdivisions[i] = 2;
-                    else if (i == 2 || i == 6 || i == 8 || i == 9 || i == 10)
-                        subdivisions[i] = 3;
-                    else
-                        subdivisions[i] = 5;
+                for (int i = 0; i < numCells; i++) {
+                    int d = getCornerDistance(i);
+                    subdivisions[i] = d < 3 ? d + 1 : 5;
                 }
                 break;
             case 12:
-                for (int i = 0; i < NUM_OF_CELLS; i++) {
-                    if (i == 0)
-                        subdivisions[i] = 5;
-                    else if (i == 1 || i == 4 || i == 5)
-                        subdivisions[i] = 3;
-                    else if (i == 2 || i == 6 || i == 8 || i == 9 || i == 10)
-                        subdivisions[i] = 2;
-                    else
-                        subdivisions[i] = 1;
+                for (int i = 0; i < numCells; i++) {
+                    int d = getCornerDistance(i);
+                    subdivisions[i] = d > 0 ? 4 - d : 5;
                 }
                 break;
             case 13:
-                for (int i = 0; i < NUM_OF_CELLS; i++) {
-                    int r = static_cast<int>(random::uniform() * 4);
+                for (int i = 0; i < numCells; i++) {
+                    int r = static_cast<int>(patternRandom.uniform() * 4);
                     if (r == 0)
                         subdivisions[i] = 1;
                     else if (r == 1)
@@ -640,8 +949,8 @@ struct StochSeqGrid : Module {
                 }
                 break;
             case 14:
-                for (int i = 0; i < NUM_OF_CELLS; i++) {
-                    int r = static_cast<int>(random::uniform() * 3);
+                for (int i = 0; i < numCells; i++) {
+                    int r = static_cast<int>(patternRandom.uniform() * 3);
                     if (r == 0)
                         subdivisions[i] = 1;
                     else if (r == 1)
@@ -651,16 +960,33 @@ struct StochSeqGrid : Module {
                 }
                 break;
             case 15:
-                for (int i = 0; i < NUM_OF_CELLS; i++) {
-                    subdivisions[i] = static_cast<int>(random::uniform() * (i + 1)) + 1;
+                // up to 16 at the last cell whatever the size
+                for (int i = 0; i < numCells; i++) {
+                    subdivisions[i] = static_cast<int>(patternRandom.uniform() * (i * NUM_OF_CELLS / numCells + 1)) + 1;
                 }
                 break;
             default:
-                for (int i = 0; i < NUM_OF_CELLS; i++) {
-                    subdivisions[i] = static_cast<int>(random::uniform() * NUM_OF_CELLS) + 1;
+                for (int i = 0; i < numCells; i++) {
+                    int sd = static_cast<int>(patternRandom.uniform() * NUM_OF_CELLS) + 1;
+                    subdivisions[i] = std::min(sd, MAX_SUBDIVISIONS);
                 }
                 break;
         }
+        cellsChanged();
+    }
+
+    // the middle half of the grid, the 4 center cells of a 4×4
+    bool isInsideCell(int i) {
+        int x = i % gridSize;
+        int y = i / gridSize;
+        int edge = gridSize / 4;
+        return x >= edge && x < gridSize - edge && y >= edge && y < gridSize - edge;
+    }
+
+    // 0 to 3 rings out from the top left, rings are 2 cells wide in an 8×8
+    int getCornerDistance(int i) {
+        int ring = std::max(i % gridSize, i / gridSize);
+        return ring * GRID_SIZE / gridSize;
     }
 
     void resetSeqs() {
@@ -670,99 +996,86 @@ struct StochSeqGrid : Module {
     }
 
     void resetRhythms(int _index) {
-        for (int i = 0; i < MAX_SUBDIVISIONS; i++) {
-            beats[_index][i] = true;
-        }
+        beats[_index] = ~0u;
     }
 
     int getCurrentSubdivision() {
-        int _index = clamp(currentCellX, 0, 3) + clamp(currentCellY, 0, 3) * 4;
-        return subdivisions[_index];
-    }
-
-    int getSubdivision(int cellX, int cellY) {
-        int _index = clamp(cellX, 0, 3) + clamp(cellY, 0, 3) * 4;
-        return subdivisions[_index];
+        return subdivisions[getCurrentCellIndex()];
     }
 
     int getCurrentCellIndex() {
-        return clamp(currentCellX, 0, 3) + clamp(currentCellY, 0, 3) * 4;
+        return clamp(currentCellX, 0, gridSize - 1) + clamp(currentCellY, 0, gridSize - 1) * gridSize;
     }
 
     void process(const ProcessArgs &args) override {
+        bool updateLights = lightDivider.process(args.sampleRate);
+
+        Command command;
+        while (commands.pop(command)) {
+            applyCommand(command);
+        }
+
+        // reset stays at audio rate so it lines up with the clock
         if (resetTrig.process(params[RESET_PARAM].getValue() + inputs[RESET_INPUT].getVoltage())) {
             resetMode = true;
             isFirstTime = true;
         }
 
-        if (toggleTrig.process(params[CLOCK_TOGGLE_PARAM].getValue())) {
-            clockOn ^= true;
-        }
+        if (controls.process(this, args.sampleRate)) {
+            PROFILE_SCOPE(profiler, CONTROLS_PHASE);
+            if (toggleTrig.process(controls.get(CLOCK_TOGGLE_CONTROL))) {
+                clockOn ^= true;
+            }
 
-		if (params[PATTERN_PARAM].getValue() != currentPattern) {
-			currentPattern = (int)params[PATTERN_PARAM].getValue();
-            // int patt = (int)params[PATTERN_PARAM].getValue();
+            if (controls.get(PATTERN_CONTROL) != currentPattern) {
+                currentPattern = (int)controls.get(PATTERN_CONTROL);
+                // int patt = (int)params[PATTERN_PARAM].getValue();
 
-            // for (int i = 0; i < NUM_OF_CELLS; i++) {
-            //     subdivisions[i] = currentPattern;
-            // }
-			genPatterns(currentPattern);
-		}
-        
-        for (int i = 0; i < NUM_SEQ; i++) {
-            seqs[i].isOn = params[ON_PARAMS + i].getValue();
-            seqs[i].rhythm = params[RHYTHM_PARAMS + i].getValue();
-            seqs[i].duration = params[DUR_PARAMS + i].getValue();
-            seqs[i].currentPath = (PathIds)params[PATHS_PARAM + i].getValue();
+                // for (int i = 0; i < NUM_OF_CELLS; i++) {
+                //     subdivisions[i] = currentPattern;
+                // }
+                genPatterns(currentPattern);
+            }
+
+            if (controls.changed(BPM_CONTROL)) {
+                bpmFreq = std::pow(2.0, controls.get(BPM_CONTROL));
+                timeOut = bpmFreq * 0.9;
+            }
+
+            for (int i = 0; i < NUM_SEQ; i++) {
+                seqs[i].isOn = controls.get(ON_CONTROLS + i);
+                seqs[i].currentPath = (PathIds)controls.get(PATHS_CONTROLS + i);
+                seqs[i].length = controls.get(LENGTH_CONTROLS + i) * getLengthScale();
+                if (controls.changed(RHYTHM_CONTROLS + i) || controls.changed(DUR_CONTROLS + i)) {
+                    seqs[i].rhythm = controls.get(RHYTHM_CONTROLS + i);
+                    seqs[i].duration = controls.get(DUR_CONTROLS + i);
+                    seqs[i].rhythmFraction = seqs[i].rhythm / seqs[i].duration;
+                }
+            }
         }
 
         bool bpmDetect = false;
         if (inputs[EXT_CLOCK_INPUT].isConnected()) {
-            float bpmParam = params[BPM_PARAM].getValue();
-            timeOut = std::pow(2.0, bpmParam) * 0.9;
             if (bpmInputMode == BPM_CV) {
                 clockFreq = 2.0 * std::pow(2.0, inputs[EXT_CLOCK_INPUT].getVoltage());
             } else {
-                bpmDetect = bpmInputTrig.process(inputs[EXT_CLOCK_INPUT].getVoltage());
+                bpmDetect = clockFollower.process(inputs[EXT_CLOCK_INPUT].getVoltage(), args.sampleTime);
                 if (bpmDetect && overrideExtClk)
                     clockOn = true;
-                switch(bpmInputMode) {
-                    case BPM_P2: 
-                        ppqn = 2; 
-                        break;
-                    case BPM_P4: 
-                        ppqn = 4;
-                        break;
-                    case BPM_P8:
-                        ppqn = 8;
-                        break;
-                    case BPM_P12:
-                        ppqn = 12;
-                        break;
-                    case BPM_P24:
-                        ppqn = 24;
-                        break;
-                }
             }
         } else {
-            float bpmParam = params[BPM_PARAM].getValue();
-            clockFreq = std::pow(2.0, bpmParam);
+            clockFreq = bpmFreq;
         }
 
         if (clockOn) {
+            PROFILE_SCOPE(profiler, SEQUENCERS_PHASE);
             if (bpmInputMode != BPM_CV && inputs[EXT_CLOCK_INPUT].isConnected()) {
-                period += args.sampleTime;
-                if (period > timeOut && overrideExtClk) 
+                if (clockFollower.getTimeSinceEdge() > timeOut && overrideExtClk) {
                     clockOn = false;
-                if (bpmDetect) {
-                    if (extPulseIndex > 1) {
-                        clockFreq = (1.0 / period) / (float)ppqn;
-                    }
-
-                    extPulseIndex++;
-                    if (extPulseIndex >= ppqn) extPulseIndex = 0;
-                    period = 0.0;
+                    clockFollower.reset();
                 }
+                if (bpmDetect && clockFollower.isLocked())
+                    clockFreq = clockFollower.getFrequency(getPPQN(bpmInputMode));
             }
             
             // float bpmParam = params[BPM_PARAM].getValue();
@@ -774,98 +1087,80 @@ struct StochSeqGrid : Module {
             }
 
             for (int i = 0; i < NUM_SEQ; i++) {
-                seqs[i].length = params[LENGTH_PARAMS + i].getValue();
-                float rhythmFraction = seqs[i].rhythm / seqs[i].duration;
-                seqs[i].phase += clockFreq * rhythmFraction * args.sampleTime;
-                seqs[i].subPhase += clockFreq * rhythmFraction * getSubdivision(seqs[i].currentCellX, seqs[i].currentCellY) * args.sampleTime;
+                SeqCell &seq = seqs[i];
+                float rate = clockFreq * seq.rhythmFraction * args.sampleTime;
+                if (rate > 0.f && rate != seq.cellRate) seq.setRate(rate);
+
+                SeqCell::Events event;
+                if (isFirstTime) {
+                    seq.samplePos += 1.0;
+                    event = SeqCell::NEW_CELL;
+                } else {
+                    event = seq.tick();
+                    if (event == SeqCell::NEW_CELL) seq.clockStep();
+                }
                 bool voltSH = false;
 
-                if (seqs[i].isOn) {
-                    seqs[i].clockGate = (seqs[i].subPhase < 0.5);
-
-                    if (seqs[i].phase >= 1.0 || isFirstTime) {
-                        seqs[i].subPhase = 0.0;
-                        seqs[i].playCellRhythms = false;
-
-                        if (!isFirstTime) {
-                            seqs[i].phase -= 1.0;
-                            seqs[i].clockStep();
-                        }
-
-                        int _index = seqs[i].getCurrentCellIndex();
-
-
-                        float gateProb = params[CELL_PROB_PARAM + _index].getValue();
-                        float cVolt = params[CV_PARAM + _index].getValue();
-                        float rhythmProb = params[SUBDIVISION_PARAM + _index].getValue();
-                        seqs[i].volts = cVolt;
-
-                        if (random::uniform() < gateProb) {
+                if (event == SeqCell::NEW_CELL) {
+                    int _index = seq.getCurrentCellIndex();
+                    seq.schedule(subdivisions[_index], &beats[_index]);
+                    seq.playCellRhythms = false;
+                    seq.clockGate = true;
+                    seq.gateOn = false;
+
+                    if (seq.isOn) {
+                        int knob = getKnobIndex(_index);
+                        float gateProb = params[CELL_PROB_PARAM + knob].getValue();
+                        float cVolt = params[CV_PARAM + knob].getValue();
+                        float rhythmProb = params[SUBDIVISION_PARAM + knob].getValue();
+                        seq.volts = cVolt;
+
+                        // both are drawn every step so the rolls stay in sync
+                        float gateRoll = seq.gateRolls.next();
+                        float rhythmRoll = seq.rhythmRolls.next();
+                        if (gateRoll < gateProb) {
                             voltSH = true;
-                            if (subdivisions[_index] == 1) { // if 1 subdivision then don't check rhythm probability
-                                seqs[i].gatePulse.trigger(1e-3);
-                                seqs[i].gateOn = true;
-                            } else if (random::uniform() < rhythmProb) {
-                                seqs[i].playCellRhythms = true;
-                                if (beats[_index][seqs[i].cellRhythmIndex]) {
-                                    seqs[i].gatePulse.trigger(1e-3);
-                                    seqs[i].gateOn = true;
-                                } else {
-                                    seqs[i].gateOn = false;
+                            if (seq.subdivision == 1) { // if 1 subdivision then don't check rhythm probability
+                                seq.gatePulse.trigger(1e-3);
+                                seq.gateOn = true;
+                            } else if (rhythmRoll < rhythmProb) {
+                                seq.playCellRhythms = true;
+                                if (getBeat(_index, seq.cellRhythmIndex)) {
+                                    seq.gatePulse.trigger(1e-3);
+                                    seq.gateOn = true;
                                 }
                             } else {
-                                seqs[i].gatePulse.trigger(1e-3);
-                                seqs[i].gateOn = true;
+                                seq.gatePulse.trigger(1e-3);
+                                seq.gateOn = true;
                             }
-                        } else {
-                            seqs[i].gateOn = false;
                         }
                     }
-
-                    if (seqs[i].subPhase >= 1.0) {
-                        seqs[i].subPhase -= 1.0;
-
-                        if (subdivisions[seqs[i].getCurrentCellIndex()] > 1) seqs[i].cellRhythmIndex++;
-                        // clockGate = (phase < 0.5);
-
-                        if (seqs[i].playCellRhythms && beats[seqs[i].getCurrentCellIndex()][seqs[i].cellRhythmIndex]) {
-                            seqs[i].gatePulse.trigger(1e-3);
-                            seqs[i].gateOn = true;
-                        } else {
-                            seqs[i].gateOn = false;
-                        }
-                    }
-
-                } else {
-                    if (seqs[i].phase >= 1.0 || isFirstTime) {
-                        seqs[i].subPhase = 0.0;
-                        seqs[i].playCellRhythms = false;
-                        seqs[i].gateOn = false;
-
-                        if (!isFirstTime) {
-                            seqs[i].phase -= 1.0;
-                            seqs[i].clockStep();
-                        }
+                } else if (event == SeqCell::STEP) {
+                    seq.clockGate = true;
+                    seq.gateOn = false;
+                    if (seq.isOn && seq.playCellRhythms && getBeat(seq.cellIndex, seq.cellRhythmIndex)) {
+                        seq.gatePulse.trigger(1e-3);
+                        seq.gateOn = true;
                     }
+                } else if (event == SeqCell::HALF_STEP) {
+                    seq.clockGate = false;
                 }
 
-                seqs[i].setBeatPulse();
-
-                // seqs[i].beatPulse[seqs[i].getCurrentCellIndex()][seqs[i].cellRhythmIndex] = seqs[i].gateOn && seqs[i].clockGate;
+                if (updateLights) seq.setBeatPulse();
 
                 bool gateVolt = false;
                 if (gateMode == GATE_MODE) {
-                    gateVolt = seqs[i].gateOn && seqs[i].clockGate;
+                    gateVolt = seq.gateOn && seq.clockGate;
                 } else {
-                    gateVolt = seqs[i].gatePulse.process(args.sampleTime);
+                    gateVolt = seq.gatePulse.process(args.sampleTime);
                 }
 
                 outputs[GATES_OUTPUT + i].setVoltage(gateVolt ? 10.0 : 0.0);
 
                 if (voltMode == VOLT_SAMPHOLD_MODE && voltSH)
-                    outputs[VOLTS_OUTPUT + i].setVoltage(seqs[i].volts);
+                    outputs[VOLTS_OUTPUT + i].setVoltage(seq.volts);
                 else if (voltMode == VOLT_INDEPENDENT_MODE)
-                    outputs[VOLTS_OUTPUT + i].setVoltage(seqs[i].volts);
+                    outputs[VOLTS_OUTPUT + i].setVoltage(seq.volts);
             }
 
             isFirstTime = false;
@@ -873,11 +1168,11 @@ struct StochSeqGrid : Module {
         } else {
             for (int i = 0; i < NUM_SEQ; i++) {
                 seqs[i].gateOn = false;
-                seqs[i].setBeatPulse();
+                if (updateLights) seqs[i].setBeatPulse();
             }
         }
 
-        lights[TOGGLE_LIGHT].setBrightness(clockOn ? 1.0 : 0.0);
+        if (updateLights) lights[TOGGLE_LIGHT].setBrightness(clockOn ? 1.0 : 0.0);
     }
 };
 
@@ -890,12 +1185,13 @@ struct HighlightDisplay : Widget {
         if (module == NULL) return;
 
         Vec pos = module->getXYfromIndex(module->hoverCell);
+        float cellSize = box.size.x / module->gridSize;
 
         nvgFillColor(args.vg, nvgRGBA(255, 255, 255, 100));
         // nvgFillColor(args.vg, getAqua());
 
         nvgBeginPath(args.vg);
-        nvgRect(args.vg, pos.x * 6, pos.y * 6, 6, 6);
+        nvgRect(args.vg, pos.x * cellSize, pos.y * cellSize, cellSize, cellSize);
         nvgFill(args.vg);
 
         // NVGcolor nvgLerpRGBA(NVGcolor c0, NVGcolor c1, float u);
@@ -939,16 +1235,18 @@ struct CellOverlay : Widget {
     void draw(const DrawArgs &args) override {
         if (module == NULL) return;
 
-        for (int y = 0; y < 4; y++) {
-            for (int x = 0; x < 4; x++) {
-                int index = x + y * 4;
+        int size = module->gridSize;
+        float cellSize = box.size.x / size;
+        for (int y = 0; y < size; y++) {
+            for (int x = 0; x < size; x++) {
+                int index = module->getKnobIndex(x + y * size);
                 float alpha = rescale(module->getParam(StochSeqGrid::CELL_PROB_PARAM + index).getValue(), 0.0, 1.0, 175, 0);
                 nvgStrokeColor(args.vg, nvgRGB(60, 60, 73));
                 nvgFillColor(args.vg, nvgRGBA(0, 0, 0, alpha));
                 nvgBeginPath(args.vg);
-                float xPos = x * CELL_SIZE;
-                float yPos = y * CELL_SIZE;
-                nvgRect(args.vg, xPos, yPos, CELL_SIZE, CELL_SIZE);
+                float xPos = x * cellSize;
+                float yPos = y * cellSize;
+                nvgRect(args.vg, xPos, yPos, cellSize, cellSize);
                 nvgFill(args.vg);
             }
         }
@@ -956,24 +1254,106 @@ struct CellOverlay : Widget {
 };
 
 struct BGGrid : Widget {
+    StochSeqGrid *module;
 
     void draw(const DrawArgs &args) override {
+        int size = module ? module->gridSize : GRID_SIZE;
+        float cellSize = box.size.x / size;
 
-        for (int y = 0; y < 4; y++) {
-            for (int x = 0; x < 4; x++) {
+        for (int y = 0; y < size; y++) {
+            for (int x = 0; x < size; x++) {
                 nvgStrokeColor(args.vg, nvgRGB(60, 60, 73));
                 nvgBeginPath(args.vg);
-                float xPos = x * CELL_SIZE;
-                float yPos = y * CELL_SIZE;
-                nvgRect(args.vg, xPos, yPos, CELL_SIZE, CELL_SIZE);
+                float xPos = x * cellSize;
+                float yPos = y * cellSize;
+                nvgRect(args.vg, xPos, yPos, cellSize, cellSize);
                 nvgStroke(args.vg);
             }
         }
     }  
 };
 
+// sub rhythms go clockwise around the cell, starting at 12 o'clock
+inline Vec getSubdivisionPos(int i, int subRhythms, Vec center) {
+    float angle = rescale((float)i, 0.0, subRhythms, -M_PI/2, M_PI*2.0 - M_PI/2);
+    return Vec(std::cos(angle), std::sin(angle)).mult(SUBDIVISION_RADIUS).plus(center);
+}
+
+// same sizes as before up to 16, then small enough that they don't overlap
+inline float getSubdivisionRadius(int subRhythms) {
+    return std::min(rescale((float)subRhythms, 2.0, 16.0, 16.0 / 2, 8.0 / 2), (float)(M_PI * SUBDIVISION_RADIUS / subRhythms));
+}
+
+// lines & circles of a cell. only redrawn when its rhythms change
+struct SubdivisionCircles : Widget {
+    int index;
+    StochSeqGrid *module;
+
+    void draw(const DrawArgs &args) override {
+        // drawn at the size of a 4×4 cell, smaller ones are scaled down
+        float scale = box.size.x / CELL_SIZE;
+        nvgScale(args.vg, scale, scale);
+        Vec center = Vec(CELL_SIZE / 2, CELL_SIZE / 2);
+        // draws random rhythms for the preview
+        int subRhythms = module ? module->subdivisions[index] : (int)randRange(1, 12);
+
+        // if only one beat
+        if (subRhythms == 1) {
+            nvgBeginPath(args.vg);
+            nvgCircle(args.vg, center.x, center.y, 35.0/2);
+            nvgFill(args.vg);
+            return;
+        }
+
+        float circleRad = getSubdivisionRadius(subRhythms);
+        float alpha = 200;
+        bool displayCircles = false;
+        if (module) {
+            alpha = rescale(module->getParam(StochSeqGrid::SUBDIVISION_PARAM + module->getKnobIndex(index)).getValue(), 0.0, 1.0, 25, 200);
+            displayCircles = module->displayCircles;
+        }
+
+        if (displayCircles) {
+            nvgStrokeColor(args.vg, nvgRGBA(255, 255, 255, alpha));
+            nvgStrokeWidth(args.vg, 1.0);
+            nvgBeginPath(args.vg);
+            nvgCircle(args.vg, center.x, center.y, SUBDIVISION_RADIUS);
+            nvgStroke(args.vg);
+        }
+
+        for (int i = 0; i < subRhythms; i++) {
+            bool beatOn = module ? module->getBeat(index, i) : true;
+            Vec pos = getSubdivisionPos(i, subRhythms, center);
+
+            // connected lines
+            if (beatOn && !displayCircles) {
+                nvgStrokeColor(args.vg, nvgRGBA(255, 255, 255, alpha));
+                nvgStrokeWidth(args.vg, i == 0 ? 2.5 : 1.0);
+                nvgBeginPath(args.vg);
+                nvgMoveTo(args.vg, center.x, center.y);
+                nvgLineTo(args.vg, pos.x, pos.y);
+                nvgStroke(args.vg);
+            }
+
+            nvgBeginPath(args.vg);
+            nvgCircle(args.vg, pos.x, pos.y, circleRad);
+            if (beatOn) {
+                nvgFillColor(args.vg, nvgRGB(255, 255, 255));
+            } else {
+                nvgFillColor(args.vg, nvgRGB(51, 51, 51));
+                nvgStrokeColor(args.vg, nvgRGB(255, 255, 255));
+                nvgStrokeWidth(args.vg, 2.0);
+                nvgStroke(args.vg);
+            }
+            nvgFill(args.vg);
+        }
+    }
+};
+
 struct SubdivisionDisplay : Widget {
-    Vec positions[16] = {};
+    Vec positions[MAX_SUBDIVISIONS] = {};
+    int numPositions = 0; // 0 when they have to be worked out again
+    float scale = 1.0; // of the cell to a 4×4 one
     bool isBeatOn = false;
     bool clickedOnBeat = false;
     float circleRad;
@@ -1009,10 +1389,7 @@ struct SubdivisionDisplay : Widget {
                 module->isCtrlClick = false;
                 e.consume(this);
                 // module->resetRhythms(index);
-                int rhythms = module->subdivisions[index];
-                rhythms *= 2;
-                if (rhythms <= MAX_SUBDIVISIONS)
-                    module->subdivisions[index] = rhythms;
+                module->sendCommand(StochSeqGrid::DOUBLE_SUBDIVISIONS, index);
             } else {
                 module->isCtrlClick = false;
                 e.consume(this);
@@ -1042,16 +1419,16 @@ struct SubdivisionDisplay : Widget {
     }
 
     void incrementSubdivisions() {
-        module->subdivisions[index] = clamp(++module->subdivisions[index], 1, MAX_SUBDIVISIONS);
+        module->sendCommand(StochSeqGrid::ADD_SUBDIVISIONS, index, 0, 1);
     }
 
     void incrementSubdivisions(float dy) {
-        int sd = static_cast<int>(round(module->subdivisions[index] + dy * 0.25));
-        module->subdivisions[index] = clamp(sd, 1, MAX_SUBDIVISIONS);
+        int delta = static_cast<int>(round(dy * 0.25));
+        if (delta != 0) module->sendCommand(StochSeqGrid::ADD_SUBDIVISIONS, index, 0, delta);
     }
 
     void decrementSubdivisions() {
-        module->subdivisions[index] = clamp(--module->subdivisions[index], 1, MAX_SUBDIVISIONS);
+        module->sendCommand(StochSeqGrid::ADD_SUBDIVISIONS, index, 0, -1);
     }
 
     void toggleRhythms(float currentX, float currentY, bool on) {
@@ -1060,7 +1437,7 @@ struct SubdivisionDisplay : Widget {
         for (int i = 0; i < subRhythms; i++) {
             float d = dist(mouse, positions[i]);
             if (d < circleRad) {
-                module->beats[index][i] = on;
+                module->sendCommand(StochSeqGrid::SET_BEAT, index, i, on);
                 clickedOnBeat = true;
             }
         }
@@ -1072,126 +1449,56 @@ struct SubdivisionDisplay : Widget {
         for (int i = 0; i < subRhythms; i++) {
             float d = dist(mouse, positions[i]);
             if (d < circleRad) {
-                return module->beats[index][i];
+                return module->getBeat(index, i);
             }
         }
         return false;
     }
 
-    void draw(const DrawArgs &args) override {
-        if (module == NULL) {
-            // draw stuff for preview
-            float radius = 22.0;
-            Vec center = Vec(box.size.x / 2, box.size.y / 2);
-            int subRhythms = (int)randRange(1, 12);
-
-            // if only one beat
-            if (subRhythms == 1) {
-                nvgBeginPath(args.vg);
-                nvgCircle(args.vg, center.x, center.y, 35.0/2);
-                nvgFill(args.vg);
-            } else {
-                circleRad = rescale(subRhythms, 2.0, MAX_SUBDIVISIONS, 16.0 / 2, 8.0 / 2);
-
+    void step() override {
+        if (module) {
+            // only when the number of sub rhythms changes
+            int subRhythms = module->subdivisions[index];
+            if (subRhythms != numPositions) {
+                numPositions = subRhythms;
+                scale = box.size.x / CELL_SIZE;
+                circleRad = getSubdivisionRadius(subRhythms) * scale;
+                Vec center = Vec(CELL_SIZE / 2, CELL_SIZE / 2);
                 for (int i = 0; i < subRhythms; i++) {
-                    float angle = rescale((float)i, 0.0, subRhythms, -M_PI/2, M_PI*2.0 - M_PI/2);
-                    float x = cos(angle) * radius;
-                    float y = sin(angle) * radius;
-                    Vec pos = Vec(x, y).plus(center);
-                    positions[i] = pos;
-
-                    // connected lines
-                    nvgStrokeColor(args.vg, nvgRGBA(255, 255, 255, 200));
-                    nvgStrokeWidth(args.vg, i == 0 ? 2.5 : 1.0);
-                    nvgBeginPath(args.vg);
-                    nvgMoveTo(args.vg, center.x, center.y);
-                    nvgLineTo(args.vg, pos.x, pos.y);
-                    nvgStroke(args.vg);
-
-                    nvgBeginPath(args.vg);
-                    nvgCircle(args.vg, pos.x, pos.y, circleRad);
-                    nvgFillColor(args.vg, nvgRGB(255, 255, 255));
-                    nvgFill(args.vg);
+                    positions[i] = getSubdivisionPos(i, subRhythms, center).mult(scale);
                 }
             }
+        }
+        Widget::step();
+    }
 
+    // visual pulses, the circles themselves are cached in SubdivisionCircles
+    void draw(const DrawArgs &args) override {
+        if (module == NULL) return;
 
-
-            return;
-        }
-        
-        float radius = 22.0;
-        Vec center = Vec(box.size.x / 2, box.size.y / 2);
         int subRhythms = module->subdivisions[index];
 
         // if only one beat
         if (subRhythms == 1) {
-            nvgBeginPath(args.vg);
-            nvgCircle(args.vg, center.x, center.y, 35.0/2);
-            nvgFill(args.vg);
-
+            Vec center = Vec(box.size.x / 2, box.size.y / 2);
             for (int i = 0; i < NUM_SEQ; i++) {
-                // visual pulse stuff
-                if (module->seqs[i].beatPulse[index][0])  {
+                if (module->seqs[i].isPulsing(index, 0))  {
                     nvgBeginPath(args.vg);
-                    nvgCircle(args.vg, center.x, center.y, radius);
+                    nvgCircle(args.vg, center.x, center.y, SUBDIVISION_RADIUS * scale);
                     nvgStrokeColor(args.vg, nvgRGBA(255, 255, 255, 200));
                     nvgStroke(args.vg);
                 }
             }
-        } else {
-            circleRad = rescale(subRhythms, 2.0, MAX_SUBDIVISIONS, 16.0 / 2, 8.0 / 2);
-            float alpha = rescale(module->getParam(StochSeqGrid::SUBDIVISION_PARAM + index).getValue(), 0.0, 1.0, 25, 200);
-            
-            if (module->displayCircles) {
-                nvgFillColor(args.vg, nvgRGB(255, 255, 255));
-                nvgStrokeColor(args.vg, nvgRGBA(255, 255, 255, alpha));
-                nvgStrokeWidth(args.vg, 1.0);
-                nvgBeginPath(args.vg);
-                nvgCircle(args.vg, center.x, center.y, radius);
-                nvgStroke(args.vg);
-            }
-
+        } else if (subRhythms == numPositions) {
             for (int i = 0; i < subRhythms; i++) {
-                bool beatOn = module->beats[index][i];
-
-                float angle = rescale((float)i, 0.0, subRhythms, -M_PI/2, M_PI*2.0 - M_PI/2);
-                float x = cos(angle) * radius;
-                float y = sin(angle) * radius;
-                Vec pos = Vec(x, y).plus(center);
-                positions[i] = pos;
-
-                // connected lines
-                if (beatOn && !module->displayCircles) {
-                    nvgStrokeColor(args.vg, nvgRGBA(255, 255, 255, alpha));
-                    nvgStrokeWidth(args.vg, i == 0 ? 2.5 : 1.0);
-                    nvgBeginPath(args.vg);
-                    nvgMoveTo(args.vg, center.x, center.y);
-                    nvgLineTo(args.vg, pos.x, pos.y);
-                    nvgStroke(args.vg);
-                }
-
-                nvgBeginPath(args.vg);
-                nvgCircle(args.vg, pos.x, pos.y, circleRad);
-                if (beatOn) {
-                    nvgFillColor(args.vg, nvgRGB(255, 255, 255));
-                } else {
-                    nvgFillColor(args.vg, nvgRGB(51, 51, 51));
-                    nvgStrokeColor(args.vg, nvgRGB(255, 255, 255));
-                    nvgStrokeWidth(args.vg, 2.0);
-                    nvgStroke(args.vg);
-                }
-                nvgFill(args.vg);
-
+                if (!module->getBeat(index, i)) continue;
                 for (int j = 0; j < NUM_SEQ; j++) {
-                    // visual pulse stuff
-                    if (module->seqs[j].beatPulse[index][i] && beatOn)  {
+                    if (module->seqs[j].isPulsing(index, i))  {
                         nvgBeginPath(args.vg);
-                        nvgCircle(args.vg, pos.x, pos.y, circleRad * 1.2);
+                        nvgCircle(args.vg, positions[i].x, positions[i].y, circleRad * 1.2);
                         nvgFillColor(args.vg, nvgRGBA(255, 255, 255, 200));
                         nvgFill(args.vg);
                     }
-
                 }
             }
         }
@@ -1225,10 +1532,11 @@ struct CellsDisplay : Widget {
         if (module == NULL) return;
 
         if (layer == 1) {
+            float cellSize = box.size.x / module->gridSize;
             for (int i = 0; i < NUM_SEQ; i++) {            
                     if (module->seqs[i].isOn) {
-                        int xPos = clamp(module->seqs[i].currentCellX, 0, 3);
-                        int yPos = clamp(module->seqs[i].currentCellY, 0, 3);
+                        int xPos = clamp(module->seqs[i].currentCellX, 0, module->gridSize - 1);
+                        int yPos = clamp(module->seqs[i].currentCellY, 0, module->gridSize - 1);
 
                         if (module->resetMode) {
                             Vec rPos = module->seqs[i].getStartPos();
@@ -1239,7 +1547,7 @@ struct CellsDisplay : Widget {
                         nvgStrokeColor(args.vg, module->seqs[i].color);
                         nvgFillColor(args.vg, nvgTransRGBA(module->seqs[i].color, 32)); // 35
                         nvgBeginPath(args.vg);
-                        nvgRect(args.vg, xPos * CELL_SIZE, yPos * CELL_SIZE, CELL_SIZE, CELL_SIZE);
+                        nvgRect(args.vg, xPos * cellSize, yPos * cellSize, cellSize, cellSize);
                         nvgFill(args.vg);
                         nvgStrokeWidth(args.vg, 2.0);
                         nvgStroke(args.vg);
@@ -1287,6 +1595,11 @@ struct RatioDisplayLabel : Widget {
 };
 
 struct StochSeqGridWidget : ModuleWidget {
+    // all 64 cells, the ones past the grid size are hidden
+    CachedLayer *circleLayers[MAX_CELLS];
+    SubdivisionDisplay *subdivisionDisplays[MAX_CELLS];
+    int gridSize = 0;
+
     StochSeqGridWidget(StochSeqGrid *module) {
         setModule(module);
         setPanel(createPanel(asset::plugin(pluginInstance, "res/StochSeqGrid.svg"), asset::plugin(pluginInstance, "res/StochSeqGrid-dark.svg")));
@@ -1304,9 +1617,12 @@ struct StochSeqGridWidget : ModuleWidget {
         addChild(rhythmDisplay);
 
         BGGrid *gridDisplay = new BGGrid();
+        gridDisplay->module = module;
         gridDisplay->box.pos = Vec(82.5, 54.8);
         gridDisplay->box.size = Vec(270, 270);
-        addChild(gridDisplay);
+        CachedLayer *gridLayer = createCachedLayer(gridDisplay);
+        if (module) gridLayer->getRevision = [=]() { return module->gridSize; };
+        addChild(gridLayer);
 
         CellsDisplay *cells = new CellsDisplay();
         cells->module = module;
@@ -1314,26 +1630,28 @@ struct StochSeqGridWidget : ModuleWidget {
         cells->box.size = Vec(270, 270);
         addChild(cells);
 
-        for (int y = 0; y < 4; y++) {
-            for (int x = 0; x < 4; x++) {
-                int _index = x + y * 4;
-                float xPos = 82.5 + x * CELL_SIZE;
-                float yPos = 54.8 + y * CELL_SIZE;
-
-                SubdivisionDisplay *subdivision = new SubdivisionDisplay();
-                subdivision->module = module;
-                subdivision->index = _index;
-                subdivision->box.pos = Vec(xPos, yPos);
-                subdivision->box.size = Vec(CELL_SIZE, CELL_SIZE);
-                addChild(subdivision);
-            }
+        for (int i = 0; i < MAX_CELLS; i++) {
+            SubdivisionCircles *circles = new SubdivisionCircles();
+            circles->module = module;
+            circles->index = i;
+            circleLayers[i] = createCachedLayer(circles);
+            if (module) circleLayers[i]->getRevision = [=]() { return module->getCellRevision(i); };
+            addChild(circleLayers[i]);
+
+            subdivisionDisplays[i] = new SubdivisionDisplay();
+            subdivisionDisplays[i]->module = module;
+            subdivisionDisplays[i]->index = i;
+            addChild(subdivisionDisplays[i]);
         }
+        layoutCells(module ? module->gridSize : GRID_SIZE);
 
         CellOverlay *cellOverlay = new CellOverlay();
         cellOverlay->module = module;
         cellOverlay->box.pos = Vec(82.5, 54.8);
         cellOverlay->box.size = Vec(270, 270);
-        addChild(cellOverlay);
+        CachedLayer *overlayLayer = createCachedLayer(cellOverlay);
+        if (module) overlayLayer->getRevision = [=]() { return module->getOverlayRevision(); };
+        addChild(overlayLayer);
 
         for (int i = 0; i < NUM_SEQ; i++) {
             RatioDisplayLabel *ratioLabel = new RatioDisplayLabel();
@@ -1352,9 +1670,9 @@ struct StochSeqGridWidget : ModuleWidget {
         addInput(createInputCentered<TinyPJ301M>(Vec(28.3, 116.1), module, StochSeqGrid::RESET_INPUT));
         addInput(createInputCentered<TinyPJ301M>(Vec(52.4, 116.1), module, StochSeqGrid::EXT_CLOCK_INPUT));
 
-        for (int y = 0; y < 4; y++) {
-            for (int x = 0; x < 4; x++) {
-                int index = x + y * 4;
+        for (int y = 0; y < GRID_SIZE; y++) {
+            for (int x = 0; x < GRID_SIZE; x++) {
+                int index = x + y * GRID_SIZE;
                 addParam(createParamCentered<TinyWhiteKnob>(Vec(116.3 + (x * CELL_SIZE), 88.5 + (y * CELL_SIZE)), module, StochSeqGrid::SUBDIVISION_PARAM + index));
                 // addParam(createParamCentered<NanoWhiteKnob>(Vec(116.3 + (x * CELL_SIZE), 88.5 + (y * CELL_SIZE)), module, StochSeqGrid::SUBDIVISION_PARAM + index));
                 addParam(createParamCentered<NanoWhiteKnob>(Vec(89.4 + (x * CELL_SIZE), 61.7 + (y * CELL_SIZE)), module, StochSeqGrid::CELL_PROB_PARAM + index));
@@ -1408,6 +1726,30 @@ struct StochSeqGridWidget : ModuleWidget {
         addOutput(createOutputCentered<PJ301MRed>(Vec(309.9, 347.6), module, StochSeqGrid::GATES_OUTPUT + RED_SEQ));
     }
 
+    void layoutCells(int size) {
+        gridSize = size;
+        float cellSize = CELL_SIZE * GRID_SIZE / size;
+        for (int i = 0; i < MAX_CELLS; i++) {
+            Rect box = Rect(Vec(82.5 + (i % size) * cellSize, 54.8 + (i / size) * cellSize), Vec(cellSize, cellSize));
+            bool visible = i < size * size;
+
+            circleLayers[i]->box = box;
+            circleLayers[i]->children.front()->box.size = box.size;
+            circleLayers[i]->visible = visible;
+            circleLayers[i]->setDirty();
+
+            subdivisionDisplays[i]->box = box;
+            subdivisionDisplays[i]->visible = visible;
+            subdivisionDisplays[i]->numPositions = 0;
+        }
+    }
+
+    void step() override {
+        StochSeqGrid *module = dynamic_cast<StochSeqGrid *>(this->module);
+        if (module && module->gridSize != gridSize) layoutCells(module->gridSize);
+        ModuleWidget::step();
+    }
+
     void appendContextMenu(Menu *menu) override {
         StochSeqGrid *module = dynamic_cast<StochSeqGrid *>(this->module);
 
@@ -1421,11 +1763,23 @@ struct StochSeqGridWidget : ModuleWidget {
         menu->addChild(new MenuEntry);
         
         menu->addChild(createIndexPtrSubmenuItem("External Clock Mode", {"CV (0V = 120 bpm)", "2 PPQN", "4 PPQN", "8 PPQN", "12 PPQN", "24 PPQN"}, &module->bpmInputMode));
+        menu->addChild(createIndexPtrSubmenuItem("External Clock Smoothing", {"Off", "Light", "Heavy"}, &module->clockFollower.smoothing));
         menu->addChild(createBoolPtrMenuItem("Ext Clk Auto Start", "", &module->overrideExtClk));
 
         menu->addChild(new MenuEntry);
 
+        menu->addChild(createIndexSubmenuItem("Grid", {"4×4", "8×8"},
+            [=]() {
+                return module->gridSize == MAX_GRID_SIZE;
+            },
+            [=](int i) {
+                module->sendCommand(StochSeqGrid::SET_GRID_SIZE, 0, 0, i ? MAX_GRID_SIZE : GRID_SIZE);
+            }
+        ));
         menu->addChild(createIndexPtrSubmenuItem("Display", {"blooms", "circles"}, &module->displayCircles));
+        menu->addChild(createBoolPtrMenuItem("Fixed random seed", "", &module->fixedSeed));
+
+        module->profiler.appendMenu(menu);
     }
 };
 
@@ -1,5 +1,7 @@
 #include "plugin.hpp"
 
+using simd::float_4;
+
 #define MAX_CHANNELS 16
 
 // {step: ratio}
@@ -28,21 +30,21 @@ struct PitchSet {
     int currentOctave = 0;
     int transposition = 0;
     int playIndeces[MAX_CHANNELS];
-    Note *sortedNotes = new Note[MAX_CHANNELS];
-    Note *notesAsPlayed = new Note[MAX_CHANNELS];
-    std::vector<Note> notesQueue;
+    Note sortedNotes[MAX_CHANNELS];
+    Note notesAsPlayed[MAX_CHANNELS];
+    int sortedIndex[MAX_CHANNELS]; // channel -> index in sortedNotes, -1 if it isn't playing
+    // new notes wait here until the next step, at most one per channel
+    Note notesQueue[MAX_CHANNELS];
+    int queueCount = 0;
+    int version = 0; // goes up whenever a note or its octave changes
 
     PitchSet() {
         for (int i = 0; i < MAX_CHANNELS; i++) {
             playIndeces[i] = 0;
+            sortedIndex[i] = -1;
         }
     }
 
-    ~PitchSet() {
-        delete [] sortedNotes;
-        delete [] notesAsPlayed;
-    }
-
     void resetSortedNotes(int index) {
         sortedNotes[index].pitch = -5.0;
         sortedNotes[index].channel = -1;
@@ -54,54 +56,108 @@ struct PitchSet {
         notesAsPlayed[index].channel = -1;
     }
 
+    void clear() {
+        for (int i = 0; i < MAX_CHANNELS; i++) {
+            resetSortedNotes(i);
+            resetNotesAsPlayed(i);
+            sortedIndex[i] = -1;
+        }
+        noteCount = 0;
+        currentOctave = 0;
+        version++;
+    }
+
+    void queueNote(float _pitch, int _channel) {
+        for (int i = 0; i < queueCount; i++) {
+            if (notesQueue[i].channel == _channel) {
+                notesQueue[i].pitch = _pitch;
+                return;
+            }
+        }
+        if (queueCount < MAX_CHANNELS)
+            notesQueue[queueCount++] = Note(_pitch, _channel);
+    }
+
+    void removeFromQueue(int _channel) {
+        int count = 0;
+        for (int i = 0; i < queueCount; i++) {
+            if (notesQueue[i].channel != _channel)
+                notesQueue[count++] = notesQueue[i];
+        }
+        queueCount = count;
+    }
+
+    // polyrhythm mode skips pitches that are already playing
+    void addQueuedNotes(bool skipSamePitch = false) {
+        for (int i = 0; i < queueCount; i++) {
+            if (!skipSamePitch || !hasPitch(notesQueue[i].pitch))
+                addNote(notesQueue[i].pitch, notesQueue[i].channel);
+        }
+        queueCount = 0;
+    }
+
     void addNote(float _pitch, int _channel) {
-        noteCount++;
+        if (_channel < 0 || _channel >= MAX_CHANNELS) return;
+        // only the playing note gets replaced, addQueuedNotes is still going through the queue
+        if (sortedIndex[_channel] >= 0) removeSortedNote(_channel);
+
         Note n(_pitch, _channel);
-        if (noteCount == 1) {
-            sortedNotes[0] = n;
-            notesAsPlayed[0] = n;
+        if (noteCount == 0)
             transposition = static_cast<int>(std::round(n.pitch * 12.0));
-        } else {
-            // find insertion index
-            int insertIndex = 0;
-            while (_pitch >= sortedNotes[insertIndex].pitch && insertIndex < noteCount-1) {
-                insertIndex++;
-            }
-            for (int i = noteCount; i > insertIndex; i--) {
-                sortedNotes[i] = sortedNotes[i-1];
-            }
-            sortedNotes[insertIndex] = n;
-            notesAsPlayed[noteCount-1] = n;
+
+        // find insertion index, after any equal pitches
+        int insertIndex = 0;
+        while (insertIndex < noteCount && _pitch >= sortedNotes[insertIndex].pitch) {
+            insertIndex++;
         }
+        for (int i = noteCount; i > insertIndex; i--) {
+            sortedNotes[i] = sortedNotes[i-1];
+            sortedIndex[sortedNotes[i].channel] = i;
+        }
+        sortedNotes[insertIndex] = n;
+        sortedIndex[_channel] = insertIndex;
+        notesAsPlayed[noteCount] = n;
+        noteCount++;
+        version++;
     }
 
     void removeNote(int _channel) {
-        // TODO: clean this up since a lot of this is redundant
+        removeFromQueue(_channel);
+        removeSortedNote(_channel);
+    }
 
-        if (noteCount > 0) noteCount--;
+    void removeSortedNote(int _channel) {
+        if (_channel < 0 || _channel >= MAX_CHANNELS) return;
+        int removeIndex = sortedIndex[_channel];
+        if (removeIndex < 0) return;
+
+        noteCount--;
         // sorted notes
-        int removeIndex = 0;
-        while (sortedNotes[removeIndex].channel != _channel && removeIndex < noteCount) {
-            removeIndex++;
-        }
-        for (int i = noteCount+1; removeIndex < i; removeIndex++) {
-            sortedNotes[removeIndex] = sortedNotes[removeIndex+1];
-        }
-        for (int i = noteCount+1; i < MAX_CHANNELS; i++) {
-            resetSortedNotes(i);
+        for (int i = removeIndex; i < noteCount; i++) {
+            sortedNotes[i] = sortedNotes[i+1];
+            sortedIndex[sortedNotes[i].channel] = i;
         }
+        resetSortedNotes(noteCount);
+        sortedIndex[_channel] = -1;
 
         // as played notes
-        removeIndex = 0;
-        while (notesAsPlayed[removeIndex].channel != _channel && removeIndex < noteCount) {
-            removeIndex++;
+        int i = 0;
+        while (notesAsPlayed[i].channel != _channel && i < noteCount) {
+            i++;
         }
-        for (int i = noteCount+1; removeIndex < i; removeIndex++) {
-            notesAsPlayed[removeIndex] = notesAsPlayed[removeIndex+1];
+        for (; i < noteCount; i++) {
+            notesAsPlayed[i] = notesAsPlayed[i+1];
         }
-        for (int i = noteCount+1; i < MAX_CHANNELS; i++) {
-            resetNotesAsPlayed(i);
+        resetNotesAsPlayed(noteCount);
+        version++;
+    }
+
+    bool hasPitch(float _pitch) {
+        for (int i = 0; i < noteCount; i++) {
+            if (sortedNotes[i].pitch == _pitch)
+                return true;
         }
+        return false;
     }
 
     float getNextPitch(int playIndex) {
@@ -113,12 +169,7 @@ struct PitchSet {
     }
 
     float getPitchFromChannel(int _channel) {
-        // find index
-        int i = 0;
-        while (sortedNotes[i].channel != _channel) {
-            i++;
-        }
-        return sortedNotes[i].pitch;
+        return sortedNotes[sortedIndex[_channel]].pitch;
     }
 
     int getChannel(int _index) {
@@ -126,30 +177,19 @@ struct PitchSet {
     }
 
     bool isNoteFromChannel(int _channel) {
-        for (int i = 0; i < noteCount; i++) {
-            if (sortedNotes[i].channel == _channel)
-                return true;
-        }
-        return false;
+        return sortedIndex[_channel] >= 0;
     }
 
     int getOctaveFromChannel(int _channel) {
-        // find index
-        int i = 0;
-        while (sortedNotes[i].channel != _channel) {
-            i++;
-        }
-        return sortedNotes[i].polyOctave;
+        return sortedNotes[sortedIndex[_channel]].polyOctave;
     }
 
     void incrementOctaveFromChannel(int _channel, int _octaveCount) {
-        // find index
-        int i = 0;
-        while (sortedNotes[i].channel != _channel && i < MAX_CHANNELS) {
-            i++;
-        }
-        if (i < MAX_CHANNELS)
+        int i = sortedIndex[_channel];
+        if (i >= 0) {
             sortedNotes[i].polyOctave = (sortedNotes[i].polyOctave + 1) % _octaveCount;
+            version++;
+        }
     }
 };
 
@@ -208,33 +248,61 @@ struct Talea : Module {
         NUM_LIGHTS = OCT_LIGHT + NUM_OCT_LIGHTS
     };
 
-    dsp::SchmittTrigger toggleTrig, bpmInputTrig, octTrig, holdTrig, polyrhythmModeTrig;
+    dsp::SchmittTrigger toggleTrig, octTrig, holdTrig, polyrhythmModeTrig;
+    ClockFollower clockFollower;
     dsp::SchmittTrigger gateTriggers[MAX_CHANNELS];
     bool clockOn = true;
     bool anyGateOn = false;
     int bpmInputMode = BPM_P24;
-    int ppqn = 0;
-    float period = 0.0;
     float gateLength = 0.5;
     int timeOut = 2; // seconds
-    int extPulseIndex = 0;
     int currentPitch = 0;
     int playIndex = 0;
     int playIndexDouble = 0;
     int octaveCount = 1;
     int arpMode = Talea::UP;
-    int checkParams = 0;
+    enum ControlIds {
+        OCT_CONTROL,
+        HOLD_CONTROL,
+        POLYRHYTHM_MODE_CONTROL,
+        CLOCK_TOGGLE_CONTROL,
+        GATE_LENGTH_CONTROL,
+        MODE_CONTROL,
+        BPM_CONTROL,
+        NUM_CONTROLS
+    };
+    ControlRate<NUM_CONTROLS> controls;
+    float bpmFreq = 2.0; // Hz, from the BPM knob
     float clockFreq = 2.0; // Hz
     bool holdPattern = false;
     bool polyrhythmMode = false;
     bool fixedMode = true;
     float phases[MAX_CHANNELS] = {};
     float volts[MAX_CHANNELS] = {};
+    // polyrhythm mode, only updated when the notes change
+    float channelRatios[MAX_CHANNELS] = {};
+    float channelVolts[MAX_CHANNELS] = {};
+    float channelOn[MAX_CHANNELS] = {};
+    int cachedVersion = -1;
+    int cachedTrans = 0;
+    bool cachedDown = false;
     bool gates[MAX_CHANNELS];
     bool gatesHigh[MAX_CHANNELS];
     // {1 : 16:15, 2 : 9:8, 3 : 6:5, 4 : 5:4, 5 : 4:3, 6 : 7:5, 7 : 3:2, 8 : 8:5, 9 : 5:3, 10 : 9:5, 11 : 15:8, 12 : 2:1}
     float ratios[13] = {1.0, 1.0666666666666667, 1.125, 1.2, 1.25, 1.3333333333333333, 1.4, 1.5, 1.6, 1.6666666666666667, 1.8, 1.875, 2.0};
     PitchSet pitchSet;
+    FastRandom rng; // random pattern mode
+    uint64_t seed = random::u64();
+    bool fixedSeed = false; // saved with the patch so it plays the same every time
+
+    // the channel cache is rebuilt inside the arpeggiator phase, so its time is counted in both
+    enum PerfPhases {
+        CONTROLS_PHASE,
+        ARP_PHASE,
+        CACHE_PHASE,
+        NUM_PERF_PHASES
+    };
+    Profiler<NUM_PERF_PHASES> profiler{"Controls", "Arpeggiator & outputs", "Channel cache"};
 
     Talea() {
         config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
@@ -258,6 +326,15 @@ struct Talea : Module {
             gates[i] = false;
             gatesHigh[i] = false;
         }
+        rng.seed(seed);
+
+        controls.configParam(OCT_CONTROL, OCT_PARAM);
+        controls.configParam(HOLD_CONTROL, HOLD_PARAM);
+        controls.configParam(POLYRHYTHM_MODE_CONTROL, POLYRHYTHM_MODE_PARAM);
+        controls.configParam(CLOCK_TOGGLE_CONTROL, CLOCK_TOGGLE_PARAM);
+        controls.configParam(GATE_LENGTH_CONTROL, GATE_LENGTH_PARAM);
+        controls.configParam(MODE_CONTROL, MODE_PARAM);
+        controls.configParam(BPM_CONTROL, BPM_PARAM);
     }
 
     void incPlayIndex() {
@@ -282,8 +359,8 @@ struct Talea : Module {
                     playIndexDouble = (playIndexDouble+1) % 2;
                     break;
                 case Talea::RANDOM:
-                    playIndex = static_cast<int>(random::uniform() * pitchSet.noteCount);
-                    incrementOct = random::uniform() < 0.5;
+                    playIndex = static_cast<int>(rng.uniform() * pitchSet.noteCount);
+                    incrementOct = rng.uniform() < 0.5;
                     break;
                 default:
                     playIndex = 0;
@@ -303,13 +380,7 @@ struct Talea : Module {
     // }
 
     void checkPhases(int index, int channels) {
-        if (pitchSet.notesQueue.size() > 0) {
-            for (unsigned int i = 0; i < pitchSet.notesQueue.size(); i++) {
-                PitchSet::Note n = pitchSet.notesQueue[i];
-                pitchSet.addNote(n.pitch, n.channel);
-            }
-            pitchSet.notesQueue.clear();
-        }
+        pitchSet.addQueuedNotes();
         if (phases[index] >= 1.0) {
             phases[index] -= 1.0;
             // phases[index] = 0.0;
@@ -344,23 +415,32 @@ struct Talea : Module {
         return ratios[index] * std::pow(2.0, octave);
     }
 
+    void updateChannelCache() {
+        PROFILE_SCOPE(profiler, CACHE_PHASE);
+        for (int c = 0; c < MAX_CHANNELS; c++) {
+            if (pitchSet.isNoteFromChannel(c)) {
+                float v = pitchSet.getPitchFromChannel(c);
+                int _oct = pitchSet.getOctaveFromChannel(c);
+                if (arpMode == DOWN) _oct *= -1;
+                channelRatios[c] = getRatioFromVolts(v);
+                channelVolts[c] = v + _oct;
+                channelOn[c] = 1.0;
+            } else {
+                // keeps its last pitch like before
+                channelRatios[c] = 1.0;
+                channelOn[c] = 0.0;
+            }
+        }
+        cachedVersion = pitchSet.version;
+        cachedTrans = fixedMode ? 0 : pitchSet.transposition;
+        cachedDown = (arpMode == DOWN);
+    }
+
     void checkPhases(int _index) { // (overloaded for polyrhythm stuff)
         if (phases[_index] >= 1.0) {
             phases[_index] -= 1.0;
 
-            if (pitchSet.notesQueue.size() > 0) {
-                for (unsigned int i = 0; i < pitchSet.notesQueue.size(); i++) {
-                    PitchSet::Note n = pitchSet.notesQueue[i];
-                    bool newNote = true;
-                    for (int j = 0; j < pitchSet.noteCount; j++) {
-                        if (n.pitch == pitchSet.sortedNotes[j].pitch)
-                            newNote = false;
-                    }
-                    if (newNote) 
-                        pitchSet.addNote(n.pitch, n.channel);
-                }
-                pitchSet.notesQueue.clear();
-            }
+            pitchSet.addQueuedNotes(true);
             // incPlayIndex();
             // incPlayIndex(_index);
             if (pitchSet.noteCount > 0)
@@ -370,12 +450,7 @@ struct Talea : Module {
     }
 
     void removeAllNotes(int _channels) {
-        for (int c = 0; c < _channels; c++) {
-            pitchSet.resetSortedNotes(c);
-            pitchSet.resetNotesAsPlayed(c);
-        }
-        pitchSet.noteCount = 0;
-        pitchSet.currentOctave = 0;
+        pitchSet.clear();
         playIndexDouble = 0;
     }
 
@@ -386,7 +461,11 @@ struct Talea : Module {
         json_object_set_new(rootJ, "polyrhythmMode", json_boolean(polyrhythmMode));
         json_object_set_new(rootJ, "fixedMode", json_boolean(fixedMode));
         json_object_set_new(rootJ, "extmode", json_integer(bpmInputMode));
+        json_object_set_new(rootJ, "clockSmoothing", json_integer(clockFollower.smoothing));
         json_object_set_new(rootJ, "octaveCount", json_integer(octaveCount));
+        if (fixedSeed)
+            json_object_set_new(rootJ, "seed", json_integer((json_int_t)seed));
+        setProfilerJson(rootJ, profiler);
 
         return rootJ;
     }
@@ -404,21 +483,36 @@ struct Talea : Module {
         json_t *extmodeJ = json_object_get(rootJ, "extmode");
         if (extmodeJ) bpmInputMode = json_integer_value(extmodeJ);
 
+        json_t *clockSmoothingJ = json_object_get(rootJ, "clockSmoothing");
+        if (clockSmoothingJ) clockFollower.smoothing = json_integer_value(clockSmoothingJ);
+
         json_t *octaveCountJ = json_object_get(rootJ, "octaveCount");
         if (octaveCountJ) octaveCount = json_integer_value(octaveCountJ);
+
+        json_t *seedJ = json_object_get(rootJ, "seed");
+        if (seedJ) {
+            fixedSeed = true;
+            seed = (uint64_t)json_integer_value(seedJ);
+            rng.seed(seed);
+        } else {
+            fixedSeed = false;
+            seed = random::u64();
+            rng.seed(seed);
+        }
     }
 
     void process(const ProcessArgs &args) override {
 
-        if (checkParams == 0) {
+        if (controls.process(this, args.sampleRate)) {
+            PROFILE_SCOPE(profiler, CONTROLS_PHASE);
             // if (octTrig.process(params[OCT_PARAM].getValue())) {
             //     octaveCount = octaveCount < 5 ? (octaveCount + 1) : 1;
             // }
-            octaveCount = params[OCT_PARAM].getValue();
-            holdPattern = (params[HOLD_PARAM].getValue() == 1);
-            polyrhythmMode = (params[POLYRHYTHM_MODE_PARAM].getValue() == 1);
+            octaveCount = controls.get(OCT_CONTROL);
+            holdPattern = (controls.get(HOLD_CONTROL) == 1);
+            polyrhythmMode = (controls.get(POLYRHYTHM_MODE_CONTROL) == 1);
 
-            if (toggleTrig.process(params[CLOCK_TOGGLE_PARAM].getValue())) {
+            if (toggleTrig.process(controls.get(CLOCK_TOGGLE_CONTROL))) {
                 clockOn = !clockOn;
             }
 
@@ -430,11 +524,13 @@ struct Talea : Module {
             //     polyrhythmMode = !polyrhythmMode;
             // }
 
-            gateLength = params[GATE_LENGTH_PARAM].getValue();
+            gateLength = controls.get(GATE_LENGTH_CONTROL);
             
-            arpMode = static_cast<int>(params[MODE_PARAM].getValue());
+            arpMode = static_cast<int>(controls.get(MODE_CONTROL));
+
+            if (controls.changed(BPM_CONTROL))
+                bpmFreq = std::pow(2.0, controls.get(BPM_CONTROL));
         }
-        checkParams = (checkParams+1) % 4;
 
         lights[TOGGLE_LIGHT].setBrightness(clockOn ? 1.0 : 0.0);
         lights[HOLD_LIGHT].setBrightness(holdPattern ? 1.0 : 0.0);
@@ -450,59 +546,25 @@ struct Talea : Module {
             if (bpmInputMode == BPM_CV) {
                 clockFreq = 2.0 * std::pow(2.0, inputs[EXT_CLOCK_INPUT].getVoltage());
             } else {
-                bpmDetect = bpmInputTrig.process(inputs[EXT_CLOCK_INPUT].getVoltage());
+                bpmDetect = clockFollower.process(inputs[EXT_CLOCK_INPUT].getVoltage(), args.sampleTime);
                 if (bpmDetect)
                     clockOn = true;
-                switch(bpmInputMode) {
-                    case BPM_P2:
-                        ppqn = 2;
-                        break;
-                    case BPM_P4:
-                        ppqn = 4;
-                        break;
-                    case BPM_P8:
-                        ppqn = 8;
-                        break;
-                    case BPM_P12:
-                        ppqn = 12;
-                        break;
-                    case BPM_P24:
-                        ppqn = 24;
-                        break;
-                }
             }
-            
-            // else if (bpmInputMode == BPM_P12) {
-            //     ppqn = 12; 
-            //     bpmDetect = bpmInputTrig.process(inputs[EXT_CLOCK_INPUT].getVoltage());
-            //     if (bpmDetect)
-            //         clockOn = true;
-            // } else {
-            //     ppqn = 24;
-            //     bpmDetect = bpmInputTrig.process(inputs[EXT_CLOCK_INPUT].getVoltage());
-            //     if (bpmDetect)
-            //         clockOn = true;
-            // }
         } else {
-            float bpmParam = params[BPM_PARAM].getValue();
-            clockFreq = std::pow(2.0, bpmParam);
+            clockFreq = bpmFreq;
         }
 
         if (inputs[VOLTS_INPUT].isConnected() && inputs[GATES_INPUT].isConnected()) {
             int channels = inputs[VOLTS_INPUT].getChannels();
             if (clockOn) {
+                PROFILE_SCOPE(profiler, ARP_PHASE);
                 if (bpmInputMode != BPM_CV && inputs[EXT_CLOCK_INPUT].isConnected()) {
-                    period += args.sampleTime;
-                    if (period > timeOut) clockOn = false;
-                    if (bpmDetect) {
-                        if (extPulseIndex > 0) {
-                            clockFreq = (1.0 / period) / (float)ppqn;
-                        }
-
-                        extPulseIndex++;
-                        if (extPulseIndex >= ppqn) extPulseIndex = 0;
-                        period = 0.0;
+                    if (clockFollower.getTimeSinceEdge() > timeOut) {
+                        clockOn = false;
+                        clockFollower.reset();
                     }
+                    if (bpmDetect && clockFollower.isLocked())
+                        clockFreq = clockFollower.getFrequency(getPPQN(bpmInputMode));
                 }
             
                 // code inspired from
@@ -515,8 +577,7 @@ struct Talea : Module {
                         if (firstNote && holdPattern && !wasGateOn) {
                             removeAllNotes(channels);
                         }
-                        PitchSet::Note n(inputs[VOLTS_INPUT].getPolyVoltage(c), c);
-                        pitchSet.notesQueue.push_back(n);
+                        pitchSet.queueNote(inputs[VOLTS_INPUT].getPolyVoltage(c), c);
                         gatesHigh[c] = true;
                         anyGateOn = true;
                         firstNote = false;
@@ -532,28 +593,34 @@ struct Talea : Module {
                     }
                 }
                 if (anyGateOn || holdPattern) {
-                    if (pitchSet.noteCount > 0 || pitchSet.notesQueue.size() > 0) {
+                    if (pitchSet.noteCount > 0 || pitchSet.queueCount > 0) {
                         if (polyrhythmMode) {
                             outputs[VOLTS_OUTPUT].setChannels(channels);
                             outputs[GATES_OUTPUT].setChannels(channels);
-                            for (int c = 0; c < channels; c++) {
-                                float fractionRhythm = 1.0;
-                                if (pitchSet.isNoteFromChannel(c)) {
-                                    float volts = pitchSet.getPitchFromChannel(c);
-                                    fractionRhythm = getRatioFromVolts(volts);
-                                    int _oct = pitchSet.getOctaveFromChannel(c);
-                                    if (arpMode == DOWN) _oct *= -1;
-                                    volts += _oct;
-                                    outputs[VOLTS_OUTPUT].setVoltage(volts, c);
-                                    outputs[GATES_OUTPUT].setVoltage(gates[c] ? 5.0 : 0.0, c);
-
-                                } else {
-                                    outputs[GATES_OUTPUT].setVoltage(0.0, c);
+                            int trans = fixedMode ? 0 : pitchSet.transposition;
+                            if (pitchSet.version != cachedVersion || trans != cachedTrans || (arpMode == DOWN) != cachedDown)
+                                updateChannelCache();
+
+                            float_4 delta = clockFreq * args.sampleTime;
+                            for (int c = 0; c < channels; c += 4) {
+                                float_4 phase = float_4::load(&phases[c]);
+                                float_4 on = float_4::load(&channelOn[c]);
+                                float_4 gate = simd::ifelse(phase < gateLength, 5.f, 0.f) * on;
+                                float_4 v = simd::ifelse(on > 0.f, float_4::load(&channelVolts[c]), outputs[VOLTS_OUTPUT].getVoltageSimd<float_4>(c));
+                                outputs[VOLTS_OUTPUT].setVoltageSimd(v, c);
+                                outputs[GATES_OUTPUT].setVoltageSimd(gate, c);
+
+                                phase += delta * float_4::load(&channelRatios[c]);
+                                phase.store(&phases[c]);
+
+                                int wrapped = simd::movemask(phase >= 1.f);
+                                for (int i = 0; wrapped && i < 4; i++) {
+                                    if (!(wrapped & (1 << i))) continue;
+                                    if (c + i < channels)
+                                        checkPhases(c + i);
+                                    else
+                                        phases[c + i] -= 1.0; // unused lane
                                 }
-
-                                phases[c] += clockFreq * args.sampleTime * fractionRhythm;
-
-                                checkPhases(c);
                             }
                         } else {
                             outputs[VOLTS_OUTPUT].setChannels(channels);
@@ -711,12 +778,16 @@ struct TaleaWidget : ModuleWidget {
         extClockModeItem->rightText = RIGHT_ARROW;
         extClockModeItem->module = module;
         menu->addChild(extClockModeItem);
+        menu->addChild(createIndexPtrSubmenuItem("External Clock Smoothing", {"Off", "Light", "Heavy"}, &module->clockFollower.smoothing));
 
         TaleaNS::PolyrhythmModeItem *polyModeItem = new TaleaNS::PolyrhythmModeItem;
         polyModeItem->text = "Polyrhythm Mode";
         polyModeItem->rightText = RIGHT_ARROW;
         polyModeItem->module = module;
         menu->addChild(polyModeItem);
+        menu->addChild(createBoolPtrMenuItem("Fixed random seed", "", &module->fixedSeed));
+
+        module->profiler.appendMenu(menu);
     }
 
 };
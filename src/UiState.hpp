@@ -0,0 +1,62 @@
+#pragma once
+#include <rack.hpp>
+#include <atomic>
+
+using namespace rack;
+
+// the engine & GUI threads shouldn't write into the same state. process()
+// publishes what the displays need into a TripleBuffer at UI rate and the
+// widgets send their edits through a CommandQueue that process() drains.
+// neither one locks or allocates
+
+// one writer (process) and one reader (the GUI). the writer fills the back
+// buffer and swaps it with the middle one, the reader swaps the middle one
+// with its front buffer when there's something new
+template <typename T>
+struct TripleBuffer {
+    static const int FRESH = 4;
+    T buffers[3] = {};
+    std::atomic<int> middle{1};
+    int back = 0;
+    int front = 2;
+
+    T &write() {
+        return buffers[back];
+    }
+
+    void publish() {
+        back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & 3;
+    }
+
+    // always the latest published state, never one that's being written
+    const T &read() {
+        if (middle.load(std::memory_order_relaxed) & FRESH)
+            front = middle.exchange(front, std::memory_order_acq_rel) & 3;
+        return buffers[front];
+    }
+};
+
+// single producer (the GUI) single consumer (process) queue
+template <typename T, size_t S>
+struct CommandQueue {
+    T data[S];
+    std::atomic<size_t> head{0}; // next to pop
+    std::atomic<size_t> tail{0}; // next to push
+
+    // drops the command when process() isn't keeping up, i.e. the engine is off
+    bool push(const T &command) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) >= S) return false;
+        data[t % S] = command;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T &command) {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire)) return false;
+        command = data[h % S];
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+};
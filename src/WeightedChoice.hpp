@@ -0,0 +1,85 @@
+#pragma once
+#include <rack.hpp>
+
+using namespace rack;
+
+// Walker's alias method: picks one of N outcomes with any weights from a
+// single random number. The tables only get rebuilt when the weights change.
+template <int N>
+struct WeightedChoice {
+    float weights[N];
+    float prob[N];
+    int alias[N];
+
+    WeightedChoice() {
+        for (int i = 0; i < N; i++) {
+            weights[i] = 1.0;
+        }
+        build();
+    }
+
+    // returns true when the tables had to be rebuilt
+    bool setWeights(const float *w) {
+        bool changed = false;
+        for (int i = 0; i < N; i++) {
+            if (w[i] != weights[i]) {
+                weights[i] = w[i];
+                changed = true;
+            }
+        }
+        if (changed) build();
+        return changed;
+    }
+
+    void build() {
+        float sum = 0.0;
+        for (int i = 0; i < N; i++) {
+            sum += std::max(weights[i], 0.f);
+        }
+
+        float scaled[N];
+        int small[N], large[N];
+        int numSmall = 0, numLarge = 0;
+        for (int i = 0; i < N; i++) {
+            // all zero weights fall back to uniform
+            scaled[i] = (sum > 0.0) ? std::max(weights[i], 0.f) * N / sum : 1.0;
+            if (scaled[i] < 1.0)
+                small[numSmall++] = i;
+            else
+                large[numLarge++] = i;
+        }
+
+        while (numSmall > 0 && numLarge > 0) {
+            int s = small[--numSmall];
+            int l = large[--numLarge];
+            prob[s] = scaled[s];
+            alias[s] = l;
+            scaled[l] -= 1.0 - scaled[s];
+            if (scaled[l] < 1.0)
+                small[numSmall++] = l;
+            else
+                large[numLarge++] = l;
+        }
+        // leftovers are only off by rounding errors
+        while (numLarge > 0) {
+            int l = large[--numLarge];
+            prob[l] = 1.0;
+            alias[l] = l;
+        }
+        while (numSmall > 0) {
+            int s = small[--numSmall];
+            prob[s] = 1.0;
+            alias[s] = s;
+        }
+    }
+
+    int choose(float r) { // r is uniform in [0, 1)
+        float u = r * N;
+        int i = std::min(static_cast<int>(u), N - 1);
+        return (u - i < prob[i]) ? i : alias[i];
+    }
+
+    int choose() {
+        return choose(random::uniform());
+    }
+};
@@ -2,6 +2,15 @@
 #include <rack.hpp>
 #include "Quantize.cpp"
 #include "Constellations.cpp"
+#include "FastRandom.hpp"
+#include "WeightedChoice.hpp"
+#include "PatternTransforms.hpp"
+#include "Lookahead.hpp"
+#include "ClockFollower.hpp"
+#include "UiState.hpp"
+#include "Profiler.hpp"
+#include "PackedData.hpp"
+#include "PatternBank.hpp"
 // #include "Vec3.cpp";
 
 using namespace rack;
@@ -65,15 +74,15 @@ inline float freqToVolts(float freq) {
 }
 
 inline float randRange(float max) { // returns random float up to max
-    return random::uniform() * max;
+    return getFastRandom().uniform() * max;
 }
 
 inline float randRange(float min, float max) { // returns random float within min/max range
-    return random::uniform() * fabs(max-min) + min;
+    return getFastRandom().range(min, max);
 }
 
 inline int randRange(int max) {
-    return static_cast<int>(random::uniform() * max);
+    return static_cast<int>(getFastRandom().uniform() * max);
 }
 
 inline NVGcolor getPurple() {
@@ -111,6 +120,133 @@ inline int *getRedAsArray() {
     static int a[] = {255, 0, 0};
     return a;
 }
+
+/************************** LIGHT DIVIDER **************************/
+
+#define LIGHT_RATE 240.0 // Hz
+
+// lights & display state don't need to be updated every sample
+struct LightDivider {
+    dsp::ClockDivider divider;
+    float sampleRate = 0.0;
+
+    // true about LIGHT_RATE times a second
+    bool process(float newSampleRate) {
+        if (newSampleRate != sampleRate) {
+            sampleRate = newSampleRate;
+            divider.setDivision(std::max(1, (int)(sampleRate / LIGHT_RATE)));
+            divider.reset();
+        }
+        return divider.process();
+    }
+
+    // deltaTime to use with setSmoothBrightness() so it fades the same as
+    // calling it every sample with the original deltaTime
+    float smoothTime(float deltaTime, float lambda = 30.0) {
+        float k = std::min(deltaTime * lambda, 1.f);
+        return (1.0 - std::pow(1.0 - k, (float)divider.getDivision())) / lambda;
+    }
+};
+
+/************************** CONTROL RATE **************************/
+
+#define CONTROL_DIVISION 4 // samples
+
+// params & inputs that don't need to be read every sample. the module declares
+// the ones it wants, process() takes a snapshot of all of them every
+// CONTROL_DIVISION samples and remembers which ones changed, so derived values
+// only get recomputed when they need to be
+template <int N>
+struct ControlRate {
+    static_assert(N <= 32, "one change bit per control");
+    enum SourceIds {
+        PARAM_SOURCE,
+        INPUT_SOURCE
+    };
+    int sources[N] = {};
+    int ids[N] = {};
+    float values[N] = {};
+    uint32_t connections = 0;
+    uint32_t changes = 0;
+    bool invalid = true;
+    float sampleRate = 0.0;
+    dsp::ClockDivider divider;
+
+    ControlRate() {
+        divider.setDivision(CONTROL_DIVISION);
+    }
+
+    void configParam(int control, int paramId) {
+        sources[control] = PARAM_SOURCE;
+        ids[control] = paramId;
+    }
+
+    void configInput(int control, int inputId) {
+        sources[control] = INPUT_SOURCE;
+        ids[control] = inputId;
+    }
+
+    void setDivision(int division) {
+        divider.setDivision(std::max(1, division));
+    }
+
+    // everything counts as changed in the next snapshot
+    void invalidate() {
+        invalid = true;
+    }
+
+    // true when there's a new snapshot, right away on the first sample or
+    // when invalid. a new sample rate changes everything since that's what
+    // most of the derived values depend on
+    bool process(Module *module, float newSampleRate) {
+        if (newSampleRate != sampleRate) {
+            sampleRate = newSampleRate;
+            invalid = true;
+        }
+        if (!divider.process() && !invalid) return false;
+        changes = 0;
+        for (int i = 0; i < N; i++) {
+            uint32_t bit = 1u << i;
+            float v;
+            uint32_t connected = 0;
+            if (sources[i] == PARAM_SOURCE) {
+                v = module->params[ids[i]].getValue();
+            } else {
+                v = module->inputs[ids[i]].getVoltage();
+                if (module->inputs[ids[i]].isConnected()) connected = bit;
+            }
+            if (invalid || v != values[i] || connected != (connections & bit)) {
+                values[i] = v;
+                connections = (connections & ~bit) | connected;
+                changes |= bit;
+            }
+        }
+        invalid = false;
+        return true;
+    }
+
+    float get(int control) {
+        return values[control];
+    }
+
+    bool isConnected(int control) {
+        return connections & (1u << control);
+    }
+
+    bool changed(int control) {
+        return changes & (1u << control);
+    }
+};
+
+/************************** EXPANDER MESSAGES **************************/
+
+// StochSeq4 -> StochSeq4X, only sent when a step or gate changes
+struct StochSeq4Message {
+    uint32_t sequence = 0; // goes up with every new message
+    int8_t gateIndex[4] = {-1, -1, -1, -1};
+    uint8_t gates = 0; // 1 bit per sequencer
+};
+
 /************************** LABEL **************************/
 
 struct LeftAlignedLabel : Widget {
@@ -146,6 +282,44 @@ struct CenterAlignedLabel : Widget {
     }
 };
 
+/************************** CACHED DISPLAYS **************************/
+
+// fingerprint of the state a cached display draws (FNV-1a)
+inline uint32_t hashState(const void *data, size_t size, uint32_t hash = 2166136261u) {
+    const uint8_t *bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+// draws its child into a framebuffer that is only redrawn when the revision
+// changes. without getRevision it's drawn once, for things that never change
+struct CachedLayer : FramebufferWidget {
+    std::function<uint32_t()> getRevision;
+    uint32_t revision = 0;
+
+    void step() override {
+        if (getRevision) {
+            uint32_t r = getRevision();
+            if (r != revision) {
+                revision = r;
+                setDirty();
+            }
+        }
+        FramebufferWidget::step();
+    }
+};
+
+// takes over the widget's position, so it's positioned like any other display
+inline CachedLayer *createCachedLayer(Widget *widget) {
+    CachedLayer *layer = new CachedLayer;
+    layer->box = widget->box;
+    widget->box.pos = Vec(0, 0);
+    layer->addChild(widget);
+    return layer;
+}
+
 /************************** PORTS **************************/
 
 struct DefaultPort : SvgPort {
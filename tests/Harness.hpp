@@ -0,0 +1,70 @@
+#pragma once
+#include "../src/plugin.hpp"
+#include <functional>
+
+// headless runs of the modules for `make test`. the patch, the scripted inputs
+// and every random seed are fixed, so a run's outputs can be compared against
+// a golden file recorded by an earlier run
+
+// an output channel changed to value on frame
+struct Event {
+    uint32_t frame;
+    uint16_t output;
+    uint16_t channel;
+    float value;
+};
+
+struct Scenario {
+    std::string name;
+    Model **model;
+    float sampleRate = 48000.f;
+    int64_t frames = 0;
+    // module JSON, loaded with dataFromJson() before the run
+    std::function<void(json_t *rootJ)> patch;
+    // params and connected inputs
+    std::function<void(Module *module)> setup;
+    // called before every process()
+    std::function<void(Module *module, int64_t frame)> script;
+    // outputs that get recorded, all of them when empty
+    std::vector<int> outputs;
+    // module state that isn't on an output, recorded like more outputs after
+    // the real ones. called after every process(), it can leave values empty
+    std::function<void(Module *module, int64_t frame, std::vector<float> &values)> probe;
+    // false only times the run
+    bool golden = true;
+    float tolerance = 0.f;
+    // for modules that run on their own clock, how many frames an event can
+    // move from where the golden file has it
+    int frameTolerance = 0;
+    // only the first this many frames get recorded, 0 for all of them, so a
+    // long run for timing doesn't need a huge golden file
+    int64_t recordFrames = 0;
+    // a check of its own on the recorded events, an empty string when it passes
+    std::function<std::string(const std::vector<Event> &events)> verify;
+};
+
+std::vector<Scenario> &getScenarios();
+
+// 10V for the first half of every period
+inline float square(int64_t frame, int64_t period) {
+    return (frame % period < period / 2) ? 10.f : 0.f;
+}
+
+// a short trigger starting on frame at
+inline float trigger(int64_t frame, int64_t at) {
+    return (frame >= at && frame < at + 64) ? 10.f : 0.f;
+}
+
+// a 5V sine at 48 kHz, from a table so the script costs less than the module
+inline float sine(int64_t frame, float hz) {
+    static const std::vector<float> table = []() {
+        std::vector<float> t(48000);
+        for (int i = 0; i < 48000; i++) t[i] = 5.0 * std::sin(2.0 * M_PI * i / 48000.0);
+        return t;
+    }();
+    return table[(int64_t)(frame * (double)hz) % 48000];
+}
+
+inline void connect(Port &port, int channels = 1) {
+    port.channels = channels;
+}
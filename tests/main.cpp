@@ -0,0 +1,287 @@
+#include "Harness.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <new>
+
+// heap allocations made while a module's process() is running
+static bool countAllocations = false;
+static int allocations = 0;
+
+void *operator new(size_t size) {
+    if (countAllocations) allocations++;
+    void *p = std::malloc(size ? size : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void *operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void *p) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void *p) noexcept {
+    std::free(p);
+}
+
+// golden files are a header and then the events, all little endian
+struct GoldenHeader {
+    char magic[4]; // "SBGO"
+    uint32_t version;
+    uint32_t frames;
+    uint32_t count;
+};
+
+static std::string goldenPath(const Scenario &s) {
+    return "golden/" + s.name + ".bin";
+}
+
+static bool loadGolden(const std::string &path, uint32_t &frames, std::vector<Event> &events) {
+    FILE *file = std::fopen(path.c_str(), "rb");
+    if (!file) return false;
+    GoldenHeader header;
+    bool ok = std::fread(&header, sizeof(header), 1, file) == 1 && std::memcmp(header.magic, "SBGO", 4) == 0
+        && header.version == 1;
+    if (ok) {
+        frames = header.frames;
+        events.resize(header.count);
+        ok = header.count == 0 || std::fread(events.data(), sizeof(Event), header.count, file) == header.count;
+    }
+    std::fclose(file);
+    return ok;
+}
+
+static bool saveGolden(const std::string &path, uint32_t frames, const std::vector<Event> &events) {
+    FILE *file = std::fopen(path.c_str(), "wb");
+    if (!file) return false;
+    GoldenHeader header;
+    std::memcpy(header.magic, "SBGO", 4);
+    header.version = 1;
+    header.frames = frames;
+    header.count = events.size();
+    bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1
+        && (events.empty() || std::fwrite(events.data(), sizeof(Event), events.size(), file) == events.size());
+    std::fclose(file);
+    return ok;
+}
+
+// every output's events one to one, each within frameTolerance frames of the golden's
+static std::string compareShifted(const std::vector<Event> &events, const std::vector<Event> &golden, float tolerance,
+    int frameTolerance) {
+    std::map<uint32_t, std::vector<Event>> byOutput, goldenByOutput;
+    for (const Event &e : events) byOutput[(uint32_t)e.output << 16 | e.channel].push_back(e);
+    for (const Event &e : golden) goldenByOutput[(uint32_t)e.output << 16 | e.channel].push_back(e);
+    for (auto &g : goldenByOutput) byOutput[g.first];
+    for (auto &o : byOutput) {
+        const std::vector<Event> &a = o.second;
+        const std::vector<Event> &b = goldenByOutput[o.first];
+        for (size_t i = 0; i < std::max(a.size(), b.size()); i++) {
+            if (i == a.size() || i == b.size()) {
+                uint32_t frame = (i == a.size()) ? b[i].frame : a[i].frame;
+                return string::f("output %u channel %u has %d events, golden %d, from frame %u", o.first >> 16,
+                    o.first & 0xffff, (int)a.size(), (int)b.size(), frame);
+            }
+            if (std::abs((int64_t)a[i].frame - (int64_t)b[i].frame) > frameTolerance
+                || !(std::fabs(a[i].value - b[i].value) <= tolerance)) {
+                return string::f("output %u channel %u is %g at frame %u, golden %g at frame %u", o.first >> 16,
+                    o.first & 0xffff, a[i].value, a[i].frame, b[i].value, b[i].frame);
+            }
+        }
+    }
+    return "";
+}
+
+// replays both, so a value that only moved within the tolerance still matches
+static std::string compare(const std::vector<Event> &events, const std::vector<Event> &golden, float tolerance) {
+    std::map<uint32_t, float> values, goldenValues;
+    std::vector<uint32_t> touched;
+    size_t i = 0, j = 0;
+    while (i < events.size() || j < golden.size()) {
+        uint32_t frame = UINT32_MAX;
+        if (i < events.size()) frame = events[i].frame;
+        if (j < golden.size()) frame = std::min(frame, golden[j].frame);
+
+        touched.clear();
+        for (; i < events.size() && events[i].frame == frame; i++) {
+            uint32_t key = (uint32_t)events[i].output << 16 | events[i].channel;
+            values[key] = events[i].value;
+            touched.push_back(key);
+        }
+        for (; j < golden.size() && golden[j].frame == frame; j++) {
+            uint32_t key = (uint32_t)golden[j].output << 16 | golden[j].channel;
+            goldenValues[key] = golden[j].value;
+            touched.push_back(key);
+        }
+        for (uint32_t key : touched) {
+            float a = values[key];
+            float b = goldenValues[key];
+            if (!(std::fabs(a - b) <= tolerance)) {
+                return string::f("frame %u, output %u channel %u is %g, golden %g", frame, key >> 16, key & 0xffff, a, b);
+            }
+        }
+    }
+    return "";
+}
+
+struct Run {
+    std::vector<Event> events;
+    double seconds = 0.0;
+    int allocations = 0;
+};
+
+static Run run(const Scenario &s) {
+    Run r;
+    // the same random numbers on every run, for anything the patch doesn't pin
+    // down. FastRandom's first use takes a number from Rack's, so it goes first
+    getFastRandom().seed(0x5ba4b);
+    random::local().seed(0x5ba4b, 0x5e0);
+    APP->engine->setSampleRate(s.sampleRate);
+
+    Module *module = (*s.model)->createModule();
+    for (Output &output : module->outputs) connect(output);
+    if (s.patch) {
+        json_t *rootJ = json_object();
+        s.patch(rootJ);
+        module->dataFromJson(rootJ);
+        json_decref(rootJ);
+    }
+    if (s.setup) s.setup(module);
+    Module::AddEvent eAdd;
+    module->onAdd(eAdd);
+    Module::SampleRateChangeEvent eSampleRate;
+    eSampleRate.sampleRate = s.sampleRate;
+    eSampleRate.sampleTime = 1.f / s.sampleRate;
+    module->onSampleRateChange(eSampleRate);
+
+    std::vector<int> outputs = s.outputs;
+    if (outputs.empty()) {
+        for (int i = 0; i < (int)module->outputs.size(); i++) outputs.push_back(i);
+    }
+    std::vector<float> last(outputs.size() * PORT_MAX_CHANNELS, 0.f);
+    std::vector<int> lastChannels(outputs.size(), 0);
+    std::vector<float> probed, lastProbed;
+
+    Module::ProcessArgs args;
+    args.sampleRate = s.sampleRate;
+    args.sampleTime = 1.f / s.sampleRate;
+    allocations = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int64_t frame = 0; frame < s.frames; frame++) {
+        if (s.script) s.script(module, frame);
+        args.frame = frame;
+        countAllocations = true;
+        module->process(args);
+        countAllocations = false;
+        if (s.recordFrames > 0 && frame >= s.recordFrames) continue;
+
+        for (size_t k = 0; k < outputs.size(); k++) {
+            Output &output = module->outputs[outputs[k]];
+            // channels that were dropped go back to 0V
+            int channels = std::max(output.getChannels(), lastChannels[k]);
+            lastChannels[k] = output.getChannels();
+            for (int c = 0; c < channels; c++) {
+                float v = (c < output.getChannels()) ? output.getVoltage(c) : 0.f;
+                float &l = last[k * PORT_MAX_CHANNELS + c];
+                if (v != l) {
+                    l = v;
+                    Event e;
+                    e.frame = frame;
+                    e.output = outputs[k];
+                    e.channel = c;
+                    e.value = v;
+                    r.events.push_back(e);
+                }
+            }
+        }
+
+        if (s.probe) {
+            probed.clear();
+            s.probe(module, frame, probed);
+            if (lastProbed.size() < probed.size()) lastProbed.resize(probed.size(), 0.f);
+            for (size_t k = 0; k < probed.size(); k++) {
+                if (probed[k] != lastProbed[k]) {
+                    lastProbed[k] = probed[k];
+                    Event e;
+                    e.frame = frame;
+                    e.output = module->outputs.size() + k;
+                    e.channel = 0;
+                    e.value = probed[k];
+                    r.events.push_back(e);
+                }
+            }
+        }
+    }
+    r.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    r.allocations = allocations;
+    delete module;
+    return r;
+}
+
+int main(int argc, char **argv) {
+    bool update = false;
+    std::vector<std::string> filters;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--update") update = true;
+        else filters.push_back(arg);
+    }
+
+    random::init();
+    contextSet(new Context);
+    APP->engine = new engine::Engine;
+    // the modules find their res/ files through it, `make test` runs in tests/
+    pluginInstance = new Plugin;
+    pluginInstance->path = "..";
+
+    int failures = 0;
+    int count = 0;
+    for (const Scenario &s : getScenarios()) {
+        bool selected = filters.empty();
+        for (const std::string &filter : filters) {
+            if (s.name.find(filter) != std::string::npos) selected = true;
+        }
+        if (!selected) continue;
+        count++;
+
+        Run r = run(s);
+        std::string error;
+        if (r.allocations > 0) error = string::f("%d heap allocations in process()", r.allocations);
+        if (error.empty() && s.verify) error = s.verify(r.events);
+        if (error.empty() && s.golden) {
+            std::string path = goldenPath(s);
+            uint32_t frames = 0;
+            std::vector<Event> golden;
+            if (update) {
+                if (!saveGolden(path, s.frames, r.events)) error = "can't write " + path;
+            }
+            else if (!loadGolden(path, frames, golden)) {
+                error = "no golden file, run `make test UPDATE=1`";
+            }
+            else if (frames != s.frames) {
+                error = string::f("golden file has %u frames, the run has %lld", frames, (long long)s.frames);
+            }
+            else if (s.frameTolerance > 0) {
+                error = compareShifted(r.events, golden, s.tolerance, s.frameTolerance);
+            }
+            else {
+                error = compare(r.events, golden, s.tolerance);
+            }
+        }
+
+        double audioSeconds = s.frames / s.sampleRate;
+        std::printf("%-32s %-6s %9.1f ms %8.1f ns/sample %8.0fx realtime\n", s.name.c_str(),
+            error.empty() ? (update && s.golden ? "saved" : "ok") : "FAIL", r.seconds * 1e3,
+            r.seconds * 1e9 / s.frames, audioSeconds / r.seconds);
+        if (!error.empty()) {
+            std::printf("    %s\n", error.c_str());
+            failures++;
+        }
+    }
+
+    std::printf("%d of %d passed\n", count - failures, count);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,746 @@
+#include "Harness.hpp"
+
+// port and param ids, copied from the enums in src/
+namespace stochseq {
+    enum { RESET_PARAM = 0, LENGTH_PARAM = 5, SPREAD_PARAM = 6 };
+    enum { RANDOM_INPUT, INVERT_INPUT, DIMINUTION_INPUT, CLOCK_INPUT, RESET_INPUT, MEM_BANK_INPUT };
+    enum { GATE_MAIN_OUTPUT = 64, NOT_GATE_MAIN_OUTPUT, INV_VOLT_OUTPUT, VOLT_OUTPUT };
+}
+namespace stochseq4 {
+    enum { ROOT_NOTE_PARAM = 0, SCALE_PARAM = 1, PATTERN_PARAMS = 4, RANDOM_PARAMS = 8, INVERT_PARAMS = 12,
+        DIMINUTION_PARAMS = 16, LENGTH_PARAMS = 20 };
+    enum { MASTER_CLOCK_INPUT = 0, CLOCK_INPUTS = 4, RESET_INPUTS = 8, RANDOM_INPUTS = 12, INVERT_INPUTS = 16,
+        DIMINUTION_INPUTS = 20, BANK_INPUT = 24 };
+    enum { OR_OUTPUT = 0 };
+}
+namespace stochseqgrid {
+    enum { BPM_PARAM = 1, LENGTH_PARAMS = 2, PATHS_PARAM = 6, RHYTHM_PARAMS = 10, DUR_PARAMS = 14,
+        CELL_PROB_PARAM = 18, SUBDIVISION_PARAM = 34, CV_PARAM = 50, PATTERN_PARAM = 71 };
+    enum { RANDOM_INPUT, DIMINUTION_INPUT, EXT_CLOCK_INPUT, RESET_INPUT };
+}
+namespace talea {
+    enum { GATE_LENGTH_PARAM = 6 };
+    enum { EXT_CLOCK_INPUT, VOLTS_INPUT, GATES_INPUT };
+}
+namespace polyrhythmclock {
+    enum { TUPLET1_RHYTHM_PARAM = 2, TUPLET1_DUR_PARAM, TUPLET2_RHYTHM_PARAM, TUPLET2_DUR_PARAM,
+        TUPLET3_RHYTHM_PARAM, TUPLET3_DUR_PARAM };
+    enum { TUPLET1_RHYTHM_INPUT = 2, TUPLET1_DUR_INPUT };
+    enum { MASTER_PULSE_OUTPUT, TUPLET1_OUTPUT, TUPLET2_OUTPUT, TUPLET3_OUTPUT };
+}
+namespace randgates {
+    enum { WEIGHTING_PARAM, PERCENTAGE_PARAM };
+    enum { TRIGGER_INPUT = 0, GATES_INPUT = 4 };
+}
+namespace randroute {
+    enum { WEIGHTING_PARAM, PERCENTAGE_PARAM };
+    enum { TRIGGER_INPUT, GATE_INPUT };
+}
+namespace qubitcrusher {
+    enum { BITS_PARAM, BITS_MOD_PARAM, SAMP_HOLD_PARAM, SAMP_HOLD_MOD_PARAM };
+    enum { BITS_MOD_INPUT, RAND_BITS_INPUT, SAMP_HOLD_MOD_INPUT, RAND_SAMP_INPUT, MAIN_INPUT };
+}
+namespace photron {
+    enum { SEPARATE_INPUT, ALIGN_INPUT, COHESION_INPUT, TARGET_INPUT, WAVEFORM_INPUT, COLOR_TRIGGER_INPUT,
+        PATTERN_INPUT, X_INPUT, Y_INPUT };
+}
+
+// a ramp of probabilities with a few empty and a few sure steps
+static void fillProbabilities(float *probs, int size, int offset) {
+    for (int i = 0; i < size; i++) {
+        probs[i] = ((i * 7 + offset) % 11) / 10.f;
+    }
+}
+
+// the rising edges on one output
+static std::vector<uint32_t> risingEdges(const std::vector<Event> &events, int output) {
+    std::vector<uint32_t> frames;
+    float last = 0.f;
+    for (const Event &e : events) {
+        if (e.output != output || e.channel != 0) continue;
+        if (last <= 0.f && e.value > 0.f) frames.push_back(e.frame);
+        last = e.value;
+    }
+    return frames;
+}
+
+static Scenario stochSeqClocked() {
+    using namespace stochseq;
+    Scenario s;
+    s.name = "stochseq-clocked";
+    s.model = &modelStochSeq;
+    s.frames = 48000 * 20;
+    s.patch = [](json_t *rootJ) {
+        setDataVersion(rootJ);
+        json_object_set_new(rootJ, "seed", json_integer(1234));
+        float probs[32];
+        fillProbabilities(probs, 32, 0);
+        json_object_set_new(rootJ, "probs", packProbabilities(probs, 32));
+    };
+    s.setup = [](Module *m) {
+        m->params[LENGTH_PARAM].setValue(13);
+        m->params[SPREAD_PARAM].setValue(2);
+        connect(m->inputs[CLOCK_INPUT]);
+        connect(m->inputs[RESET_INPUT]);
+        connect(m->inputs[RANDOM_INPUT]);
+        connect(m->inputs[INVERT_INPUT]);
+        connect(m->inputs[DIMINUTION_INPUT]);
+    };
+    s.script = [](Module *m, int64_t frame) {
+        // 16th notes at 120 bpm, with the pattern transforms and a reset along the way
+        m->inputs[CLOCK_INPUT].setVoltage(square(frame, 6000));
+        m->inputs[INVERT_INPUT].setVoltage(trigger(frame, 48000 * 4));
+        m->inputs[DIMINUTION_INPUT].setVoltage(trigger(frame, 48000 * 8));
+        m->inputs[RANDOM_INPUT].setVoltage(trigger(frame, 48000 * 12));
+        m->inputs[RESET_INPUT].setVoltage(trigger(frame, 48000 * 16 + 3000));
+    };
+    s.outputs = {GATE_MAIN_OUTPUT, NOT_GATE_MAIN_OUTPUT, INV_VOLT_OUTPUT, VOLT_OUTPUT};
+    return s;
+}
+
+// an invert while halfway between a bank that always plays and one that never
+// does. it has to invert the first bank itself, not save the blend over it, so
+// once the cv is back on that bank nothing plays
+static Scenario stochSeqMorphEdit() {
+    using namespace stochseq;
+    Scenario s;
+    s.name = "stochseq-morph-edit";
+    s.model = &modelStochSeq;
+    s.frames = 48000 * 10;
+    s.patch = [](json_t *rootJ) {
+        setDataVersion(rootJ);
+        json_object_set_new(rootJ, "seed", json_integer(2223));
+        json_object_set_new(rootJ, "morphBanks", json_boolean(true));
+        // triggers, so every step that plays is a rising edge
+        json_object_set_new(rootJ, "gateMode", json_integer(1));
+        float probs[32];
+        std::fill(probs, probs + 32, 1.f);
+        json_object_set_new(rootJ, "probs", packProbabilities(probs, 32));
+        json_t *memBankProbsJ = json_array();
+        json_t *onJ = json_array();
+        json_t *lengthsJ = json_array();
+        for (int i = 0; i < 12; i++) {
+            std::fill(probs, probs + 32, (i == 0) ? 1.f : 0.f);
+            json_array_append_new(memBankProbsJ, packProbabilities(probs, 32));
+            json_array_append_new(onJ, json_boolean(i < 2));
+            json_array_append_new(lengthsJ, json_integer(32));
+        }
+        json_object_set_new(rootJ, "memBankProbs", memBankProbsJ);
+        json_object_set_new(rootJ, "isOn", onJ);
+        json_object_set_new(rootJ, "lengths", lengthsJ);
+    };
+    s.setup = [](Module *m) {
+        connect(m->inputs[CLOCK_INPUT]);
+        connect(m->inputs[MEM_BANK_INPUT]);
+        connect(m->inputs[INVERT_INPUT]);
+    };
+    s.script = [](Module *m, int64_t frame) {
+        m->inputs[CLOCK_INPUT].setVoltage(square(frame, 6000));
+        // the first bank, halfway to the second, then back
+        bool halfway = frame >= 48000 * 2 && frame < 48000 * 6;
+        m->inputs[MEM_BANK_INPUT].setVoltage(halfway ? 0.5f / 12.f : 0.f);
+        m->inputs[INVERT_INPUT].setVoltage(trigger(frame, 48000 * 4));
+    };
+    s.outputs = {GATE_MAIN_OUTPUT};
+    s.verify = [](const std::vector<Event> &events) -> std::string {
+        std::vector<uint32_t> gates = risingEdges(events, GATE_MAIN_OUTPUT);
+        int before = 0;
+        for (uint32_t frame : gates) {
+            if (frame < 48000 * 2) before++;
+            if (frame >= 48000 * 6 + 6000) return string::f("a gate at frame %u, the first bank got the blend", frame);
+        }
+        if (before < 15) return string::f("only %d gates from the first bank before the invert", before);
+        return "";
+    };
+    return s;
+}
+
+static Scenario stochSeq4Clocked() {
+    using namespace stochseq4;
+    Scenario s;
+    s.name = "stochseq4-clocked";
+    s.model = &modelStochSeq4;
+    s.frames = 48000 * 20;
+    s.patch = [](json_t *rootJ) {
+        setDataVersion(rootJ);
+        json_object_set_new(rootJ, "seed", json_integer(5678));
+        json_t *currentPatternsJ = json_array();
+        json_t *seqsProbsJ = json_array();
+        for (int i = 0; i < 4; i++) {
+            float probs[32];
+            fillProbabilities(probs, 32, i * 3);
+            json_array_append_new(currentPatternsJ, json_integer(0));
+            json_array_append_new(seqsProbsJ, packProbabilities(probs, 32));
+        }
+        json_object_set_new(rootJ, "currentPatterns", currentPatternsJ);
+        json_object_set_new(rootJ, "seqsProbs", seqsProbsJ);
+    };
+    s.setup = [](Module *m) {
+        for (int i = 0; i < 4; i++) {
+            m->params[LENGTH_PARAMS + i].setValue(5 + i * 3);
+        }
+        connect(m->inputs[MASTER_CLOCK_INPUT]);
+        // the second sequencer gets a clock of its own
+        connect(m->inputs[CLOCK_INPUTS + 1]);
+        connect(m->inputs[RESET_INPUTS + 3]);
+        connect(m->inputs[RANDOM_INPUTS + 2]);
+        connect(m->inputs[INVERT_INPUTS + 1]);
+        connect(m->inputs[DIMINUTION_INPUTS + 0]);
+    };
+    s.script = [](Module *m, int64_t frame) {
+        m->inputs[MASTER_CLOCK_INPUT].setVoltage(square(frame, 6000));
+        m->inputs[CLOCK_INPUTS + 1].setVoltage(square(frame, 8000));
+        m->inputs[DIMINUTION_INPUTS + 0].setVoltage(trigger(frame, 48000 * 4));
+        m->inputs[INVERT_INPUTS + 1].setVoltage(trigger(frame, 48000 * 8));
+        m->inputs[RANDOM_INPUTS + 2].setVoltage(trigger(frame, 48000 * 12));
+        m->inputs[RESET_INPUTS + 3].setVoltage(trigger(frame, 48000 * 16 + 1000));
+    };
+    return s;
+}
+
+// every pattern edit process() makes on its own, none of them may allocate
+static Scenario stochSeq4Edits() {
+    using namespace stochseq4;
+    Scenario s;
+    s.name = "stochseq4-edits";
+    s.model = &modelStochSeq4;
+    s.frames = 48000 * 10;
+    s.patch = [](json_t *rootJ) {
+        json_object_set_new(rootJ, "seed", json_integer(2021));
+    };
+    s.setup = [](Module *m) {
+        connect(m->inputs[MASTER_CLOCK_INPUT]);
+    };
+    s.script = [](Module *m, int64_t frame) {
+        m->inputs[MASTER_CLOCK_INPUT].setVoltage(square(frame, 3000));
+        int64_t second = frame / 48000;
+        if (frame % 48000 != 0) {
+            // the buttons only get held for a moment
+            if (frame % 48000 == 64) {
+                for (int i = 0; i < 4; i++) {
+                    m->params[RANDOM_PARAMS + i].setValue(0.f);
+                    m->params[INVERT_PARAMS + i].setValue(0.f);
+                    m->params[DIMINUTION_PARAMS + i].setValue(0.f);
+                }
+            }
+            return;
+        }
+        for (int i = 0; i < 4; i++) {
+            // every preset pattern, random ones included
+            m->params[PATTERN_PARAMS + i].setValue((second + i * 2) % 9);
+            m->params[LENGTH_PARAMS + i].setValue(1 + (second * 7 + i * 5) % 32);
+        }
+        m->params[RANDOM_PARAMS + second % 4].setValue(1.f);
+        m->params[INVERT_PARAMS + (second + 1) % 4].setValue(1.f);
+        m->params[DIMINUTION_PARAMS + (second + 2) % 4].setValue(1.f);
+        m->params[ROOT_NOTE_PARAM].setValue(second % 12);
+        m->params[SCALE_PARAM].setValue(second % 5);
+    };
+    return s;
+}
+
+static std::string bankFile(const std::string &name) {
+    return system::join(P_tmpdir, "shabang-" + name + ".sbpb");
+}
+
+// every step of every sequencer at probability
+static PatternRecord patternRecord(float probability) {
+    PatternRecord record;
+    for (int i = 0; i < PATTERN_BANK_SEQS; i++) {
+        std::fill(record.probabilities[i], record.probabilities[i] + PATTERN_BANK_STEPS, probability);
+        record.lengths[i] = 16;
+    }
+    return record;
+}
+
+// a bank that plays every step & one that plays none, swapped by patch loads
+// every half second with no widget around to delete the old ones. then one
+// gets a pattern added while it's playing, which the cv picks
+static Scenario stochSeq4BankReloads() {
+    using namespace stochseq4;
+    Scenario s;
+    s.name = "stochseq4-bank-reloads";
+    s.model = &modelStochSeq4;
+    s.frames = 48000 * 14;
+    s.golden = false;
+    s.patch = [](json_t *rootJ) {
+        json_object_set_new(rootJ, "seed", json_integer(2425));
+        json_object_set_new(rootJ, "gateMode", json_integer(1));
+    };
+    s.setup = [](Module *m) {
+        system::remove(bankFile("all"));
+        system::remove(bankFile("none"));
+        appendPatternRecord(bankFile("all"), patternRecord(1.f));
+        appendPatternRecord(bankFile("none"), patternRecord(0.f));
+        connect(m->inputs[MASTER_CLOCK_INPUT]);
+        connect(m->inputs[BANK_INPUT]);
+    };
+    s.script = [](Module *m, int64_t frame) {
+        m->inputs[MASTER_CLOCK_INPUT].setVoltage(square(frame, 3000));
+        if (frame == 48000 * 12) {
+            appendPatternRecord(bankFile("none"), patternRecord(1.f));
+            m->inputs[BANK_INPUT].setVoltage(10.f);
+        }
+        if (frame % 24000 != 0) return;
+        bool all = frame / 24000 % 2 == 0 && frame < 48000 * 12;
+        json_t *rootJ = json_object();
+        json_object_set_new(rootJ, "seed", json_integer(2425));
+        json_object_set_new(rootJ, "bankPath", json_string(bankFile(all ? "all" : "none").c_str()));
+        m->dataFromJson(rootJ);
+        json_decref(rootJ);
+    };
+    s.outputs = {OR_OUTPUT};
+    s.verify = [](const std::vector<Event> &events) -> std::string {
+        std::vector<uint32_t> gates = risingEdges(events, OR_OUTPUT);
+        for (int window = 0; window < 28; window++) {
+            // a step after the load, so the last one from the bank before is done
+            uint32_t start = window * 24000 + 3000, end = (window + 1) * 24000;
+            int count = std::count_if(gates.begin(), gates.end(), [=](uint32_t f) { return f >= start && f < end; });
+            bool all = window % 2 == 0 || window >= 24;
+            if (all && count < 5) return string::f("only %d gates after load %d, it didn't get the bank", count, window);
+            if (!all && count > 0) return string::f("%d gates after load %d, it didn't get the bank", count, window);
+        }
+        return "";
+    };
+    return s;
+}
+
+static Scenario stochSeqGridInternal() {
+    using namespace stochseqgrid;
+    Scenario s;
+    s.name = "stochseqgrid-internal-clock";
+    s.model = &modelStochSeqGrid;
+    s.frames = 48000 * 20;
+    s.frameTolerance = 1;
+    s.patch = [](json_t *rootJ) {
+        setDataVersion(rootJ);
+        json_object_set_new(rootJ, "seed", json_integer(91011));
+        json_object_set_new(rootJ, "run", json_boolean(true));
+        json_t *subdivisionsJ = json_array();
+        uint32_t beats[16];
+        for (int i = 0; i < 16; i++) {
+            int subdivision = 1 + (i * 5) % 7;
+            json_array_append_new(subdivisionsJ, json_integer(subdivision));
+            // every other beat of the cell
+            beats[i] = 0x55555555u & ((1u << subdivision) - 1);
+        }
+        json_object_set_new(rootJ, "subdivisions", subdivisionsJ);
+        json_object_set_new(rootJ, "beats", packMasks(beats, 16));
+    };
+    s.setup = [](Module *m) {
+        m->params[BPM_PARAM].setValue(1.5);
+        for (int i = 0; i < 4; i++) {
+            m->params[LENGTH_PARAMS + i].setValue(4 + i * 3);
+            m->params[PATHS_PARAM + i].setValue(i % 3);
+            m->params[RHYTHM_PARAMS + i].setValue(1 + i);
+            m->params[DUR_PARAMS + i].setValue(1 + i % 2);
+        }
+        for (int i = 0; i < 16; i++) {
+            m->params[CELL_PROB_PARAM + i].setValue((i % 4) / 3.f);
+            m->params[SUBDIVISION_PARAM + i].setValue(1.f - (i % 3) / 4.f);
+            m->params[CV_PARAM + i].setValue(i - 8.f);
+        }
+        connect(m->inputs[RANDOM_INPUT]);
+        connect(m->inputs[DIMINUTION_INPUT]);
+    };
+    s.script = [](Module *m, int64_t frame) {
+        m->inputs[RANDOM_INPUT].setVoltage(trigger(frame, 48000 * 7));
+        m->inputs[DIMINUTION_INPUT].setVoltage(trigger(frame, 48000 * 13));
+    };
+    return s;
+}
+
+// random subdivisions & paths on the 8×8 grid, then merged back to 4×4 like a
+// preset being loaded
+static Scenario stochSeqGrid8x8() {
+    using namespace stochseqgrid;
+    Scenario s;
+    s.name = "stochseqgrid-8x8";
+    s.model = &modelStochSeqGrid;
+    s.frames = 48000 * 20;
+    s.frameTolerance = 1;
+    s.patch = [](json_t *rootJ) {
+        setDataVersion(rootJ);
+        json_object_set_new(rootJ, "seed", json_integer(121314));
+        json_object_set_new(rootJ, "run", json_boolean(true));
+        json_object_set_new(rootJ, "gridSize", json_integer(8));
+    };
+    s.setup = [](Module *m) {
+        m->params[BPM_PARAM].setValue(2.0);
+        m->params[PATTERN_PARAM].setValue(16);
+        for (int i = 0; i < 4; i++) {
+            // 16 to 64 cells on the 8×8 grid
+            m->params[LENGTH_PARAMS + i].setValue(4 + i * 4);
+            m->params[PATHS_PARAM + i].setValue(i % 3);
+            m->params[RHYTHM_PARAMS + i].setValue(1 + i);
+        }
+        for (int i = 0; i < 16; i++) {
+            m->params[CELL_PROB_PARAM + i].setValue(0.5f + (i % 3) / 4.f);
+            m->params[SUBDIVISION_PARAM + i].setValue((i % 4) / 3.f);
+            m->params[CV_PARAM + i].setValue(i - 8.f);
+        }
+    };
+    s.script = [](Module *m, int64_t frame) {
+        if (frame == 48000 * 12) {
+            json_t *rootJ = json_object();
+            json_object_set_new(rootJ, "seed", json_integer(121314));
+            json_object_set_new(rootJ, "gridSize", json_integer(4));
+            m->dataFromJson(rootJ);
+            json_decref(rootJ);
+        }
+    };
+    return s;
+}
+
+static Scenario taleaHeldChord() {
+    using namespace talea;
+    Scenario s;
+    s.name = "talea-held-chord";
+    s.model = &modelTalea;
+    s.frames = 48000 * 20;
+    s.frameTolerance = 1;
+    s.patch = [](json_t *rootJ) {
+        json_object_set_new(rootJ, "clockOn", json_boolean(true));
+        json_object_set_new(rootJ, "seed", json_integer(1213));
+    };
+    s.setup = [](Module *m) {
+        m->params[GATE_LENGTH_PARAM].setValue(0.3);
+        connect(m->inputs[VOLTS_INPUT], 3);
+        connect(m->inputs[GATES_INPUT], 3);
+    };
+    s.script = [](Module *m, int64_t frame) {
+        // a chord that changes its notes while they are held, one note at a time
+        static const float chords[3][3] = {{0.f, 4 / 12.f, 7 / 12.f}, {0.f, 5 / 12.f, 9 / 12.f}, {-1 / 12.f, 5 / 12.f, 8 / 12.f}};
+        int chord = (frame / (48000 * 3)) % 3;
+        int64_t inChord = frame % (48000 * 3);
+        for (int c = 0; c < 3; c++) {
+            // each voice lets go briefly before the next chord
+            bool held = inChord < 48000 * 3 - 2000 * (c + 1);
+            m->inputs[VOLTS_INPUT].setVoltage(chords[chord][c], c);
+            m->inputs[GATES_INPUT].setVoltage(held ? 10.f : 0.f, c);
+        }
+    };
+    return s;
+}
+
+static Scenario polyrhythmClockTuplets() {
+    using namespace polyrhythmclock;
+    Scenario s;
+    s.name = "polyrhythmclock-tuplets";
+    s.model = &modelPolyrhythmClock;
+    s.frames = 48000 * 20;
+    s.frameTolerance = 1;
+    s.patch = [](json_t *rootJ) {
+        json_object_set_new(rootJ, "clockOn", json_boolean(true));
+    };
+    s.setup = [](Module *m) {
+        m->params[TUPLET1_RHYTHM_PARAM].setValue(3);
+        m->params[TUPLET1_DUR_PARAM].setValue(2);
+        m->params[TUPLET2_RHYTHM_PARAM].setValue(5);
+        m->params[TUPLET2_DUR_PARAM].setValue(4);
+        m->params[TUPLET3_RHYTHM_PARAM].setValue(7);
+        m->params[TUPLET3_DUR_PARAM].setValue(3);
+    };
+    return s;
+}
+
+// an hour of nested tuplets: however long it runs, every cycle of a tuplet has
+// to start on a main pulse and have exactly its number of evenly spaced pulses
+// CV a little off from 3:2, which has to play as 3:2 and not truncate to 2:2
+static Scenario polyrhythmClockTupletCV() {
+    using namespace polyrhythmclock;
+    Scenario s;
+    s.name = "polyrhythmclock-tuplet-cv";
+    s.model = &modelPolyrhythmClock;
+    s.frames = 48000 * 10;
+    s.golden = false;
+    s.patch = [](json_t *rootJ) {
+        json_object_set_new(rootJ, "clockOn", json_boolean(true));
+    };
+    s.setup = [](Module *m) {
+        connect(m->inputs[TUPLET1_RHYTHM_INPUT]);
+        connect(m->inputs[TUPLET1_DUR_INPUT]);
+    };
+    s.script = [](Module *m, int64_t frame) {
+        m->inputs[TUPLET1_RHYTHM_INPUT].setVoltage(2.9f / 12.f);
+        m->inputs[TUPLET1_DUR_INPUT].setVoltage(2.2f / 12.f);
+    };
+    s.outputs = {MASTER_PULSE_OUTPUT, TUPLET1_OUTPUT};
+    s.verify = [](const std::vector<Event> &events) -> std::string {
+        size_t beats = risingEdges(events, MASTER_PULSE_OUTPUT).size();
+        size_t tuplets = risingEdges(events, TUPLET1_OUTPUT).size();
+        // within one tuplet of 3 for every 2 beats, however the run ends
+        if (beats < 10 || tuplets * 2 + 3 < beats * 3 || tuplets * 2 > beats * 3 + 3)
+            return string::f("%zu tuplets for %zu beats, not 3:2", tuplets, beats);
+        return "";
+    };
+    return s;
+}
+
+static Scenario polyrhythmClockDrift() {
+    using namespace polyrhythmclock;
+    Scenario s;
+    s.name = "polyrhythmclock-drift-1h";
+    s.model = &modelPolyrhythmClock;
+    s.frames = 48000LL * 3600;
+    s.golden = false;
+    s.patch = [](json_t *rootJ) {
+        json_object_set_new(rootJ, "clockOn", json_boolean(true));
+    };
+    s.setup = [](Module *m) {
+        // 7:4, then 5:3 and 3:2 of that, so 7/4, 35/12 and 35/8 pulses a beat
+        m->params[TUPLET1_RHYTHM_PARAM].setValue(7);
+        m->params[TUPLET1_DUR_PARAM].setValue(4);
+        m->params[TUPLET2_RHYTHM_PARAM].setValue(5);
+        m->params[TUPLET2_DUR_PARAM].setValue(3);
+        m->params[TUPLET3_RHYTHM_PARAM].setValue(3);
+        m->params[TUPLET3_DUR_PARAM].setValue(2);
+    };
+    s.verify = [](const std::vector<Event> &events) -> std::string {
+        static const int pulses[3] = {7, 35, 35};
+        static const int beats[3] = {4, 12, 8};
+        std::vector<uint32_t> main = risingEdges(events, MASTER_PULSE_OUTPUT);
+        if (main.size() < 7000) return string::f("only %d main pulses", (int)main.size());
+
+        for (int t = 0; t < 3; t++) {
+            std::vector<uint32_t> tuplet = risingEdges(events, TUPLET1_OUTPUT + t);
+            // the knobs get picked up on the first main pulse, so the cycles
+            // start there and then on every beats[t]-th main pulse
+            size_t k = 0;
+            for (size_t start = 0; start + beats[t] < main.size(); start += beats[t]) {
+                uint32_t a = main[start];
+                uint32_t b = main[start + beats[t]];
+                while (k < tuplet.size() && tuplet[k] < a) k++;
+                if (k == tuplet.size() || tuplet[k] != a) {
+                    return string::f("tuplet %d cycle at frame %u doesn't start on the main pulse", t + 1, a);
+                }
+                for (int p = 0; p < pulses[t]; p++, k++) {
+                    if (k == tuplet.size() || tuplet[k] >= b) {
+                        return string::f("tuplet %d cycle at frame %u has %d pulses, not %d", t + 1, a, p, pulses[t]);
+                    }
+                    // evenly spaced, give or take the rounding to whole samples
+                    double expected = a + (double)p * (b - a) / pulses[t];
+                    if (std::fabs(tuplet[k] - expected) > 2.0) {
+                        return string::f("tuplet %d pulse at frame %u, expected %.0f", t + 1, tuplet[k], expected);
+                    }
+                }
+                if (k < tuplet.size() && tuplet[k] < b) {
+                    return string::f("tuplet %d cycle at frame %u has too many pulses", t + 1, a);
+                }
+            }
+        }
+        return "";
+    };
+    return s;
+}
+
+static Scenario randGatesClocked() {
+    using namespace randgates;
+    Scenario s;
+    s.name = "randgates-clocked";
+    s.model = &modelRandGates;
+    s.frames = 48000 * 10;
+    s.patch = [](json_t *rootJ) {
+        json_object_set_new(rootJ, "seed", json_integer(1415));
+    };
+    s.setup = [](Module *m) {
+        m->params[WEIGHTING_PARAM].setValue(0.7);
+        connect(m->inputs[TRIGGER_INPUT]);
+        for (int i = 0; i < 4; i++) {
+            connect(m->inputs[GATES_INPUT + i]);
+            m->inputs[GATES_INPUT + i].setVoltage(i + 1.f);
+        }
+    };
+    s.script = [](Module *m, int64_t frame) {
+        m->inputs[TRIGGER_INPUT].setVoltage(square(frame, 2400));
+    };
+    return s;
+}
+
+static Scenario randRouteClocked() {
+    using namespace randroute;
+    Scenario s;
+    s.name = "randroute-clocked";
+    s.model = &modelRandRoute;
+    s.frames = 48000 * 10;
+    s.patch = [](json_t *rootJ) {
+        json_object_set_new(rootJ, "seed", json_integer(1617));
+    };
+    s.setup = [](Module *m) {
+        m->params[WEIGHTING_PARAM].setValue(0.4);
+        connect(m->inputs[TRIGGER_INPUT]);
+        connect(m->inputs[GATE_INPUT]);
+        m->inputs[GATE_INPUT].setVoltage(5.f);
+    };
+    s.script = [](Module *m, int64_t frame) {
+        m->inputs[TRIGGER_INPUT].setVoltage(square(frame, 2400));
+    };
+    return s;
+}
+
+static Scenario randRouteMultinoulli() {
+    using namespace randroute;
+    Scenario s;
+    s.name = "randroute-multinoulli";
+    s.model = &modelRandRoute;
+    s.frames = 48000 * 10;
+    s.patch = [](json_t *rootJ) {
+        json_object_set_new(rootJ, "seed", json_integer(1819));
+    };
+    s.setup = [](Module *m) {
+        connect(m->inputs[GATE_INPUT], 2);
+    };
+    s.script = [](Module *m, int64_t frame) {
+        m->inputs[GATE_INPUT].setVoltage(square(frame, 3000), 0);
+        m->inputs[GATE_INPUT].setVoltage(square(frame + 700, 4200), 1);
+    };
+    return s;
+}
+
+// the oversampled paths use Rack's minBLEP table, which is only the same to
+// within the rounding of the FFT it's made with, so they get more room
+static Scenario qubitCrusher(const std::string &name, int oversample, int channels) {
+    using namespace qubitcrusher;
+    Scenario s;
+    s.name = name;
+    s.model = &modelQubitCrusher;
+    s.frames = (channels == 1) ? 48000 : 48000 * 5;
+    s.tolerance = (oversample == 0) ? 1e-5f : 1e-2f;
+    // the polyphonic runs are for timing, a few cycles of them are enough to check
+    if (channels > 1) s.recordFrames = 1200;
+    s.patch = [oversample](json_t *rootJ) {
+        json_object_set_new(rootJ, "oversample", json_integer(oversample));
+    };
+    s.setup = [channels](Module *m) {
+        m->params[BITS_PARAM].setValue(5);
+        m->params[SAMP_HOLD_PARAM].setValue(0.3);
+        m->params[SAMP_HOLD_MOD_PARAM].setValue(0.5);
+        connect(m->inputs[MAIN_INPUT], channels);
+        connect(m->inputs[SAMP_HOLD_MOD_INPUT]);
+    };
+    s.script = [channels](Module *m, int64_t frame) {
+        for (int c = 0; c < channels; c++) {
+            m->inputs[MAIN_INPUT].setVoltage(sine(frame, 110.f * (c + 1)), c);
+        }
+        m->inputs[SAMP_HOLD_MOD_INPUT].setVoltage(sine(frame, 0.5f));
+    };
+    return s;
+}
+
+// the oversampling changing 100 times a second, to time the switch itself
+static Scenario qubitCrusherSwitching() {
+    Scenario s = qubitCrusher("qubitcrusher-16ch-switching", 1, 16);
+    auto script = s.script;
+    s.script = [script](Module *m, int64_t frame) {
+        if (frame % 480 == 0) {
+            json_t *rootJ = json_object();
+            json_object_set_new(rootJ, "oversample", json_integer(frame / 480 % 4));
+            m->dataFromJson(rootJ);
+            json_decref(rootJ);
+        }
+        script(m, frame);
+    };
+    return s;
+}
+
+static Scenario neutrinodeNodes() {
+    Scenario s;
+    s.name = "neutrinode-particles";
+    s.model = &modelNeutrinode;
+    s.frames = 48000 * 10;
+    s.frameTolerance = 1;
+    s.patch = [](json_t *rootJ) {
+        json_object_set_new(rootJ, "start", json_boolean(true));
+        json_object_set_new(rootJ, "movement", json_boolean(false));
+        json_t *nodesJ = json_array();
+        for (int i = 0; i < 4; i++) {
+            json_t *dataJ = json_array();
+            json_array_append_new(dataJ, json_boolean(true));
+            json_array_append_new(dataJ, json_real(60.0 + 250.0 * (i % 2)));
+            json_array_append_new(dataJ, json_real(60.0 + 250.0 * (i / 2)));
+            json_array_append_new(dataJ, json_real(1.0 + i * 0.5));
+            json_array_append_new(dataJ, json_real(0.0));
+            json_array_append_new(dataJ, json_real(0.0));
+            json_array_append_new(nodesJ, dataJ);
+        }
+        json_object_set_new(rootJ, "nodes", nodesJ);
+        json_t *particlesJ = json_array();
+        for (int i = 0; i < 8; i++) {
+            json_t *pDataJ = json_array();
+            json_array_append_new(pDataJ, json_boolean(true));
+            json_array_append_new(pDataJ, json_real(40.0 + i * 40.0));
+            json_array_append_new(pDataJ, json_real(340.0 - i * 35.0));
+            json_array_append_new(pDataJ, json_real(8.0 + i * 3.0));
+            json_array_append_new(particlesJ, pDataJ);
+        }
+        json_object_set_new(rootJ, "particles", particlesJ);
+    };
+    return s;
+}
+
+// Photron has no outputs, so what it draws gets recorded instead: the red,
+// green and blue of each row of blocks added up, twice a second
+static Scenario photronDrawing() {
+    using namespace photron;
+    Scenario s;
+    s.name = "photron-inputs";
+    s.model = &modelPhotron;
+    s.frames = 48000 * 5;
+    // the colors are saved as whole numbers, one on the edge can round either way
+    s.tolerance = 3.f;
+    s.probe = [](Module *m, int64_t frame, std::vector<float> &values) {
+        if (frame % 24000 != 0) return;
+        static const int cols = 69;
+        json_t *rootJ = m->dataToJson();
+        json_t *blocksJ = json_object_get(rootJ, "blocks");
+        int rows = json_array_size(blocksJ) / cols;
+        values.assign(rows * 3, 0.f);
+        for (int i = 0; i < rows * cols; i++) {
+            json_t *rgbJ = json_array_get(blocksJ, i);
+            for (int k = 0; k < 3; k++) values[i / cols * 3 + k] += json_integer_value(json_array_get(rgbJ, k));
+        }
+        json_decref(rootJ);
+    };
+    s.setup = [](Module *m) {
+        connect(m->inputs[TARGET_INPUT]);
+        connect(m->inputs[PATTERN_INPUT]);
+        connect(m->inputs[X_INPUT]);
+        connect(m->inputs[Y_INPUT]);
+    };
+    s.script = [](Module *m, int64_t frame) {
+        // a lissajous figure, with the target color moving and a new pattern every 2 seconds
+        m->inputs[X_INPUT].setVoltage(sine(frame, 110.f));
+        m->inputs[Y_INPUT].setVoltage(sine(frame, 165.f));
+        m->inputs[TARGET_INPUT].setVoltage(5.f + sine(frame, 0.25f));
+        m->inputs[PATTERN_INPUT].setVoltage(square(frame, 48000 * 2));
+    };
+    return s;
+}
+
+std::vector<Scenario> &getScenarios() {
+    static std::vector<Scenario> scenarios = {
+        stochSeqClocked(),
+        stochSeqMorphEdit(),
+        stochSeq4Clocked(),
+        stochSeq4Edits(),
+        stochSeq4BankReloads(),
+        stochSeqGridInternal(),
+        stochSeqGrid8x8(),
+        taleaHeldChord(),
+        polyrhythmClockTuplets(),
+        polyrhythmClockTupletCV(),
+        polyrhythmClockDrift(),
+        randGatesClocked(),
+        randRouteClocked(),
+        randRouteMultinoulli(),
+        qubitCrusher("qubitcrusher-mono", 0, 1),
+        qubitCrusher("qubitcrusher-16ch", 0, 16),
+        qubitCrusher("qubitcrusher-16ch-2x", 1, 16),
+        qubitCrusher("qubitcrusher-16ch-4x", 2, 16),
+        qubitCrusher("qubitcrusher-16ch-8x", 3, 16),
+        qubitCrusherSwitching(),
+        neutrinodeNodes(),
+        photronDrawing(),
+    };
+    return scenarios;
+}